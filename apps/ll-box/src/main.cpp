@@ -11,14 +11,27 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <array>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <thread>
 
+#include "linglong/container/cgroup_stats.h"
 #include "linglong/container/container.h"
-#include "linglong/container/helper.h"
+#include "linglong/container/exec.h"
+#include "linglong/container/launcher.h"
+#include "linglong/container/state_table.h"
 #include "linglong/utils/logger.h"
 #include "linglong/utils/oci_runtime.h"
+#include "linglong/utils/platform.h"
+#include "linglong/utils/runtime_cache.h"
+#include "linglong/utils/trace.h"
 
 const char *argp_program_bug_address =
     "https://github.com/linuxdeepin/linglong/issues";  // NOLINT
@@ -37,49 +50,55 @@ struct arg_run {
   struct arg_global *global{nullptr};
   std::string bundle{std::filesystem::current_path()};
   std::string config{"config.json"};
+  std::string trace;
+};
+
+struct arg_serve {
+  struct arg_global *global{nullptr};
+  std::string socket;
+  unsigned int pool{4};
 };
 
 struct arg_exec {
   struct arg_global *global{nullptr};
-  std::string uid{"0"};
-  std::string gid{"0"};
+  // empty keeps the caller's credentials
+  std::string uid;
+  std::string gid;
   std::string cwd{"/"};
 };
 
+struct arg_stats {
+  struct arg_global *global{nullptr};
+  std::string format{"table"};
+  // zero prints a single sample
+  std::chrono::milliseconds stream{0};
+};
+
 enum globalOption { OPTION_CGROUP_MANAGER = 1000 };
 
+enum runOption { OPTION_TRACE = 1000 };
+
 enum execOption { OPTION_CWD = 1000 };
 
-void containerJsonCleanUp() {
-  auto containers = linglong::container::readAllContainerJson();
+enum serveOption { OPTION_SOCKET = 1000, OPTION_POOL };
 
-  auto it = containers.begin();  // NOLINT
-  while (it != containers.end()) {
-    auto boxPid = it->value("pid", -1);
-    if (boxPid == -1) {
-      ++it;
-      continue;
-    }
+enum statsOption { OPTION_STREAM = 1000 };
 
-    if (kill(boxPid, 0) != 0) {
-      auto jsonPath = std::filesystem::path("/run") / "user" /
-                      std::to_string(getuid()) / "linglong" / "box" /
-                      (it->value("id", "unknown") + ".json");
+int list(struct arg_list *arg) noexcept try {
+  auto states = linglong::container::StateTable::Open();
+  if (!states) {
+    return -1;
+  }
 
-      if (!std::filesystem::remove(jsonPath)) {
-        logErr() << "remove" << jsonPath << "failed";
-      }
-      it = containers.erase(it);
-    } else {
-      ++it;
+  auto containers = states->List();
+  for (auto &container : containers) {
+    if (!container.Alive()) {
+      container.status = "stopped";
     }
   }
-}
 
-int list(struct arg_list *arg) noexcept {
-  auto containers = linglong::container::readAllContainerJson();
   if (arg->format == "json") {
-    std::cout << containers.dump() << std::endl;
+    std::cout << linglong::container::toJson(containers).dump() << std::endl;
     return 0;
   }
 
@@ -89,243 +108,356 @@ int list(struct arg_list *arg) noexcept {
   std::cout << "ID" << sep << "PID" << sep << "STATUS" << sep << "BUNDLE" << sep
             << "CREATED" << sep << "OWNER" << std::endl;
   for (const auto &container : containers) {
-    std::cout << container.value("id", "unknown") << halfSep
-              << container.value("pid", -1) << halfSep
-              << container.value("status", "unknown") << halfSep
-              << container.value("bundle", "unknown") << halfSep
-              << container.value("created", "unknown") << halfSep
-              << container.value("owner", "unknown") << std::endl;
+    std::cout << container.id << halfSep << container.pid << halfSep
+              << container.status << halfSep << container.bundle << halfSep
+              << "unknown" << halfSep << "unknown" << std::endl;
   }
 
   return 0;
+} catch (const std::exception &e) {
+  logErr() << "list failed:" << e.what();
+  return -1;
 }
 
-pid_t findParentPid(const std::filesystem::path &process) noexcept {
-  auto stat = process / "stat";
-  std::ifstream stream{stat};
-  if (!stream.is_open()) {
-    logErr() << "couldn't open stat file" << stat.string();
+int gc() noexcept try {
+  auto states = linglong::container::StateTable::Open();
+  if (!states) {
     return -1;
   }
 
-  std::string content;
-  if (!std::getline(stream, content, '\n')) {
-    logErr() << "couldn't read from stat file";
-    return -1;
+  for (const auto &container : states->RemoveDead()) {
+    std::cout << container.id << std::endl;
   }
-  stream.close();
-
-  std::istringstream sstream{content};
-  std::string element;
-  for (int i = 0; i < 4; std::getline(sstream, element, ' '), ++i) {
-  }
-  return std::stoi(element);
+  return 0;
+} catch (const std::exception &e) {
+  logErr() << "gc failed:" << e.what();
+  return -1;
 }
 
-pid_t findLastBoxFallback(pid_t rootPid) noexcept {
-  std::error_code ec;
-  auto proc_iterator = std::filesystem::directory_iterator("/proc", ec);
-  if (ec) {
-    logErr() << "create directory iterator of /proc error:" << ec.message();
-    return -1;
+// The entry of a running container, entries of stopped ones are dropped.
+std::optional<linglong::container::ContainerState> findContainer(
+    linglong::container::StateTable &states, const std::string &id) {
+  auto container = states.Get(id);
+  if (!container) {
+    logErr() << "couldn't find container" << id;
+    return std::nullopt;
   }
 
-  auto boxBinPath = std::filesystem::read_symlink("/proc/self/exe", ec);
-  if (ec) {
-    logErr() << "read symlink error:" << ec.message();
-    return -1;
+  if (!container->Alive()) {
+    logErr() << "container" << id << "is not running";
+    states.Remove(container->id, container->pid);
+    return std::nullopt;
   }
-  auto boxBinName = boxBinPath.filename().string();
 
-  std::map<pid_t, std::filesystem::path> processes;
-  for (const auto &entry : proc_iterator) {
-    if (!entry.is_directory(ec)) {
-      if (ec) {
-        logErr() << "filesystem error:" << ec.message();
-        return -1;
-      }
-
-      continue;
-    }
-
-    pid_t pid{-1};
-    try {
-      pid = std::stoi(entry.path().filename().string());
-    } catch (std::invalid_argument &e) {
-      // ignore these directory
-      continue;
-    }
-
-    if (pid <= rootPid) {
-      continue;
-    }
+  return container;
+}
 
-    processes.insert({pid, entry.path()});
+int exec(struct arg_exec *arg, int argc, char **argv) noexcept {
+  std::string containerID = argv[0];
+  auto states = linglong::container::StateTable::Open();
+  auto container = states ? findContainer(*states, containerID) : std::nullopt;
+  if (!container) {
+    return -1;
   }
 
-  auto currentPid = rootPid;
-  pid_t lastBox{-1};
-  for (const auto &[pid, path] : processes) {
-    auto parent = findParentPid(path);
-    if (parent != currentPid) {
-      continue;
+  linglong::container::ExecOptions options;
+  options.cwd = arg->cwd;
+  try {
+    if (!arg->uid.empty()) {
+      options.uid = std::stoul(arg->uid);
     }
-
-    auto bin = std::filesystem::read_symlink(path / "exe", ec);
-    if (ec) {
-      logErr() << "read symlink error:" << ec.message();
-      return -1;
-    }
-
-    if (auto binStr = bin.filename().string(); binStr == boxBinName) {
-      lastBox = currentPid;
-      currentPid = pid;
-      continue;
+    if (!arg->gid.empty()) {
+      options.gid = std::stoul(arg->gid);
     }
-
-    break;
+  } catch (const std::exception &e) {
+    logErr() << "invalid user" << arg->uid + ":" + arg->gid;
+    return -1;
   }
+  options.args.assign(argv + 1, argv + argc);  // NOLINT
 
-  return lastBox;
+  return linglong::container::ExecInContainer(*container, options);
 }
 
-pid_t findLastBox(pid_t rootPid) noexcept {
-  std::filesystem::path proc{"/proc"};
-  if (!std::filesystem::exists(proc)) {
-    logFal() << "/proc doesn't exist.";
+int run(struct arg_run *arg, const std::string &containerID,
+        const std::function<void(pid_t)> &started = nullptr) noexcept try {
+  if (arg->bundle.at(0) != '/') {
+    arg->bundle = std::filesystem::current_path() / arg->bundle;
   }
 
-  auto pidStr = std::to_string(rootPid);
-  auto children = proc / pidStr / "task" / pidStr / "children";
-  if (!std::filesystem::exists(children)) {
-    logDbg() << children.string() << "not exist, fallback to stat file";
-    return findLastBoxFallback(rootPid);
+  if (!arg->trace.empty() && !linglong::utils::Tracer::open(arg->trace)) {
+    return -1;
   }
+  linglong::utils::defer closeTrace{[] { linglong::utils::Tracer::close(); }};
 
-  auto boxBin = std::filesystem::read_symlink("/proc/self/exe");
-  std::error_code ec;  // NOLINT
-  while (true) {
-    std::ifstream stream{children};
-    if (!stream.is_open()) {
-      logErr() << "couldn't open" << children;
-      return -1;
-    }
+  linglong::utils::TraceSpan parseSpan("parse config");
+  auto bundleDir = std::filesystem::path(arg->bundle);
+  auto configFile = bundleDir / arg->config;
+  auto configFileStream = std::ifstream(configFile);
+  if (!configFileStream.is_open()) {
+    logErr() << "failed to open config" << configFile;
+    return -1;
+  }
 
-    int chPid{-1};
-    bool childBoxFound{false};
-    while (stream >> chPid) {
-      auto exe = proc / std::to_string(chPid) / "exe";
-      auto realExe = std::filesystem::read_symlink(exe, ec);
-      if (ec) {
-        logErr() << "failed to read symlink" << exe << ":" << ec.message();
-        return -1;
-      }
+  std::string content((std::istreambuf_iterator<char>(configFileStream)),
+                      std::istreambuf_iterator<char>());
+  auto runtime = linglong::utils::runtimeFromConfig(content);
+  parseSpan.end();
 
-      if (realExe.filename() == boxBin.filename()) {
-        childBoxFound = true;
-        break;
-      }
-    }
+  linglong::container::Container container(bundleDir, configFile, containerID,
+                                           runtime);
+  return container.Start(started);
+} catch (const std::exception &e) {
+  logErr() << "run failed:" << e.what();
+  return -1;
+}
 
-    if (childBoxFound) {
-      pidStr = std::to_string(chPid);
-      children = proc / pidStr / "task" / pidStr / "children";
-      continue;
-    }
+int serve(struct arg_serve *arg) noexcept try {
+  if (arg->socket.empty()) {
+    arg->socket = std::filesystem::path("/run") / "user" /
+                  std::to_string(getuid()) / "linglong" / "box.sock";
+  }
+
+  auto *global = arg->global;
+  linglong::container::Launcher launcher(
+      arg->socket, arg->pool,
+      [global](const linglong::container::LaunchRequest &request,
+               const linglong::container::Launcher::StartedCallback &started) {
+        struct arg_run run_arg {
+          .global = global, .bundle = request.bundle, .config = request.config,
+          .trace = request.trace,
+        };
+        return run(&run_arg, request.id, started);
+      });
+
+  return launcher.Serve();
+} catch (const std::exception &e) {
+  logErr() << "serve failed:" << e.what();
+  return -1;
+}
 
-    break;
+int kill(const std::string &containerID, const std::string &signal) noexcept {
+  int sig = SIGTERM;
+  if (!signal.empty()) {
+    if (std::all_of(signal.cbegin(), signal.cend(), ::isdigit)) {
+      sig = std::stoi(signal);
+    }
+    // TODO: parse signal string
   }
 
-  return std::stoi(pidStr);
-}
-
-int exec(struct arg_exec *arg, int argc, char **argv) noexcept {
-  std::string containerID = argv[0];
-  auto containers = linglong::container::readAllContainerJson();
-  auto container =
-      std::find_if(containers.cbegin(), containers.cend(),
-                   [&containerID](const nlohmann::json &container) {
-                     return container["id"] == containerID;
-                   });
-  if (container == containers.cend()) {
-    logErr() << "couldn't find container" << containerID;
+  auto states = linglong::container::StateTable::Open();
+  if (!states) {
     return -1;
   }
 
-  auto boxPid = container->value("pid", -1);
-  if (boxPid == -1) {
-    logErr() << "couldn't get pid of container" << containerID;
+  auto container = findContainer(*states, containerID);
+  if (!container) {
     return -1;
   }
 
-  auto lastBox = findLastBox(boxPid);
-  if (lastBox == -1) {
-    logErr() << "couldn't find pid of last ll-box";
+  // the pidfd pins the process, if the start time still matches once it is
+  // open the signal can't reach a process that reused the pid
+  auto pidfd = linglong::utils::PidfdOpen(container->pid);
+  if (pidfd == -1) {
+    return ::kill(container->pid, sig);
+  }
+  if (!container->Alive()) {
+    logErr() << "container" << containerID << "is not running";
+    ::close(pidfd);
     return -1;
   }
 
-  auto boxPidStr = std::to_string(lastBox);
-  auto wdns = linglong::utils::format("--wdns=%s", arg->cwd.c_str());
+  auto ret = linglong::utils::PidfdSendSignal(pidfd, sig);
+  ::close(pidfd);
+  return ret;
+}
 
-  std::vector<const char *> newArgv{
-      "nsenter", "-t", boxPidStr.c_str(), "-U",
-      "-m",      "-p", wdns.c_str(),      "--preserve-credentials"};
+// A container followed by `ll-box stats`, its cgroup files stay open from one
+// sample to the next.
+struct statsSource {
+  pid_t pid{-1};
+  // PSI triggers that fired, see ContainerState
+  uint64_t stalls{0};
+  uint64_t lastStall{0};
+  std::optional<linglong::container::CgroupStats> cgroup;
+  linglong::container::ResourceStats last;
+  std::chrono::steady_clock::time_point lastTime;
+  bool sampled{false};
+};
 
-  for (int i = 0; i < argc; ++i) {
-    newArgv.push_back(argv[i + 1]);
+std::string humanBytes(uint64_t bytes) {
+  static const std::array<const char *, 5> units{"B", "KiB", "MiB", "GiB",
+                                                 "TiB"};
+  auto value = static_cast<double>(bytes);
+  size_t unit = 0;
+  while (value >= 1024 && unit + 1 < units.size()) {
+    value /= 1024;
+    ++unit;
   }
+  return linglong::utils::format("%.1f%s", value, units[unit]);
+}
 
-  newArgv.push_back(nullptr);
-
-  for (decltype(newArgv.size()) i = 0; i < newArgv.size(); ++i) {
-    logDbg() << "newArgv[" << i << "]:" << newArgv[i];
+int stats(struct arg_stats *arg, const std::vector<std::string> &ids) noexcept
+    try {
+  auto states = linglong::container::StateTable::Open();
+  if (!states) {
+    return -1;
   }
 
-  return ::execvp("nsenter", const_cast<char **>(newArgv.data()));  // NOLINT
-}
+  // Follows the running containers named, or all of them, as they come and
+  // go. Sources are reopened only for containers that are new or were
+  // restarted under the same ID. Returns the containers no longer running.
+  std::map<std::string, statsSource> sources;
+  auto refresh = [&]() {
+    std::vector<linglong::container::ContainerState> containers;
+    if (ids.empty()) {
+      containers = states->List();
+    }
+    for (const auto &id : ids) {
+      if (auto container = states->Get(id)) {
+        containers.push_back(std::move(*container));
+      }
+    }
 
-int run(struct arg_run *arg, const std::string &containerID) noexcept try {
-  if (arg->bundle.at(0) != '/') {
-    arg->bundle = std::filesystem::current_path() / arg->bundle;
-  }
+    std::map<std::string, statsSource> next;
+    for (const auto &container : containers) {
+      // dead ones stay in the table until `ll-box gc` or a Put into a full
+      // table removes them, `ll-box list` only shows them as stopped
+      if (!container.Alive()) {
+        continue;
+      }
+      auto it = sources.find(container.id);
+      if (it != sources.end() && it->second.pid == container.pid) {
+        it->second.stalls = container.stalls;
+        it->second.lastStall = container.lastStall;
+        next.emplace(container.id, std::move(it->second));
+        continue;
+      }
 
-  auto bundleDir = std::filesystem::path(arg->bundle);
-  auto configFile = bundleDir / arg->config;
-  auto configFileStream = std::ifstream(configFile);
-  if (!configFileStream.is_open()) {
-    logErr() << "failed to open config" << configFile;
-    return -1;
-  }
+      statsSource source{.pid = container.pid,
+                         .stalls = container.stalls,
+                         .lastStall = container.lastStall};
+      if (container.cgroup.empty()) {
+        logDbg() << "container" << container.id << "has no cgroup";
+      } else {
+        source.cgroup =
+            linglong::container::CgroupStats::Open(container.cgroup);
+      }
+      next.emplace(container.id, std::move(source));
+    }
 
-  auto json = nlohmann::json::parse(configFileStream);
-  auto runtime = json.get<linglong::utils::Runtime>();
+    std::vector<std::string> gone;
+    for (const auto &[id, source] : sources) {
+      if (next.find(id) == next.end()) {
+        gone.push_back(id);
+      }
+    }
+    sources = std::move(next);
+    return gone;
+  };
 
-  linglong::container::Container container(bundleDir, containerID, runtime);
-  return container.Start();
-} catch (const std::exception &e) {
-  logErr() << "run failed:" << e.what();
-  return -1;
-}
+  auto reportGone = [&](const std::vector<std::string> &gone) {
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+    for (const auto &id : gone) {
+      if (arg->format == "json") {
+        nlohmann::json line{{"id", id}, {"time", time}, {"exited", true}};
+        std::cout << line.dump() << '\n';
+      } else {
+        std::cout << linglong::utils::format("%-24s exited", id.c_str())
+                  << '\n';
+      }
+    }
+  };
 
-int kill(const std::string &containerID, const std::string &signal) noexcept {
-  int sig = SIGTERM;
-  if (!signal.empty()) {
-    if (std::all_of(signal.cbegin(), signal.cend(), ::isdigit)) {
-      sig = std::stoi(signal);
+  auto sample = [&]() {
+    auto now = std::chrono::steady_clock::now();
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+    for (auto &[id, source] : sources) {
+      linglong::container::ResourceStats current;
+      if (!source.cgroup || !source.cgroup->Read(current)) {
+        source.cgroup.reset();
+        continue;
+      }
+
+      if (arg->format == "json") {
+        auto line = linglong::container::toJson(current);
+        line["id"] = id;
+        line["time"] = time;
+        line["stalls"] = {{"count", source.stalls},
+                          {"last", source.lastStall}};
+        std::cout << line.dump() << '\n';
+      } else {
+        std::string cpu{"-"};
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                           now - source.lastTime)
+                           .count();
+        if (source.sampled && elapsed > 0) {
+          cpu = linglong::utils::format(
+              "%.1f%%", static_cast<double>(current.cpuUsageUsec -
+                                            source.last.cpuUsageUsec) *
+                            100 / static_cast<double>(elapsed));
+        }
+        std::cout << linglong::utils::format(
+                         "%-24s %7s %10s %10s %6llu %10s %10s %7.2f %7.2f "
+                         "%7.2f",
+                         id.c_str(), cpu.c_str(),
+                         humanBytes(current.memoryCurrent).c_str(),
+                         humanBytes(current.memoryPeak).c_str(),
+                         static_cast<unsigned long long>(current.pids),
+                         humanBytes(current.ioReadBytes).c_str(),
+                         humanBytes(current.ioWriteBytes).c_str(),
+                         current.cpuPressure.someAvg10,
+                         current.memoryPressure.someAvg10,
+                         current.ioPressure.someAvg10)
+                  << '\n';
+      }
+
+      source.last = current;
+      source.lastTime = now;
+      source.sampled = true;
     }
-    // TODO: parse signal string
-  }
+    std::cout.flush();
+  };
 
-  auto containers = linglong::container::readAllContainerJson();
-  for (auto container : containers) {
-    if (container["id"] != containerID) {
-      continue;
+  refresh();
+  for (const auto &id : ids) {
+    if (sources.find(id) == sources.end()) {
+      logErr() << "couldn't find running container" << id;
     }
+  }
+  if (!ids.empty() && sources.empty()) {
+    return -1;
+  }
 
-    auto pid = container["pid"].get<pid_t>();
-    return ::kill(pid, sig);
+  if (arg->format == "table") {
+    std::cout << linglong::utils::format(
+                     "%-24s %7s %10s %10s %6s %10s %10s %7s %7s %7s", "ID",
+                     "CPU", "MEM", "PEAK", "PIDS", "READ", "WRITE", "PSI-CPU",
+                     "PSI-MEM", "PSI-IO")
+              << std::endl;
   }
+  sample();
 
+  if (arg->stream.count() == 0) {
+    return 0;
+  }
+  auto next = std::chrono::steady_clock::now();
+  while (true) {
+    next += arg->stream;
+    std::this_thread::sleep_until(next);
+    reportGone(refresh());
+    // every named container is gone
+    if (!ids.empty() && sources.empty()) {
+      std::cout.flush();
+      return 0;
+    }
+    sample();
+  }
+} catch (const std::exception &e) {
+  logErr() << "stats failed:" << e.what();
   return -1;
 }
 
@@ -357,6 +489,9 @@ int parse_run(int key, char *arg, struct argp_state *state) {
     case 'b': {
       input->bundle = arg;
     } break;
+    case OPTION_TRACE: {
+      input->trace = arg;
+    } break;
     case ARGP_KEY_NO_ARGS: {
       argp_usage(state);  // NOLINT
     } break;
@@ -367,6 +502,28 @@ int parse_run(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+int parse_serve(int key, char *arg, struct argp_state *state) {
+  auto *input = reinterpret_cast<struct arg_serve *>(state->input);  // NOLINT
+
+  switch (key) {
+    case OPTION_SOCKET: {
+      input->socket = arg;
+    } break;
+    case OPTION_POOL: {
+      std::string val{arg};
+      if (val.empty() || !std::all_of(val.cbegin(), val.cend(), ::isdigit)) {
+        argp_failure(state, -1, EINVAL, "invalid pool size %s",  // NOLINT
+                     arg);
+      }
+      input->pool = std::stoul(val);
+    } break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
 int parse_exec(int key, char *arg, struct argp_state *state) {
   auto *input = reinterpret_cast<struct arg_exec *>(state->input);  // NOLINT
 
@@ -397,6 +554,51 @@ int parse_exec(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+// INTERVAL of --stream: seconds, optionally fractional or suffixed with "s",
+// or milliseconds suffixed with "ms".
+std::optional<std::chrono::milliseconds> parseInterval(const char *arg) {
+  char *end{nullptr};
+  auto value = std::strtod(arg, &end);
+  if (end == arg || !(value > 0)) {
+    return std::nullopt;
+  }
+
+  std::string_view unit{end};
+  if (unit == "ms") {
+    return std::chrono::milliseconds{static_cast<int64_t>(value)};
+  }
+  if (unit.empty() || unit == "s") {
+    return std::chrono::milliseconds{static_cast<int64_t>(value * 1000)};
+  }
+  return std::nullopt;
+}
+
+int parse_stats(int key, char *arg, struct argp_state *state) {
+  auto *input = reinterpret_cast<struct arg_stats *>(state->input);  // NOLINT
+
+  switch (key) {
+    case 'f': {
+      std::string val{arg};
+      if (val != "json" && val != "table") {
+        argp_failure(state, -1, EINVAL, "invalid format %s", arg);  // NOLINT
+      }
+      input->format = std::move(val);
+    } break;
+    case OPTION_STREAM: {
+      auto interval = parseInterval(arg);
+      if (!interval || interval->count() == 0) {
+        argp_failure(state, -1, EINVAL, "invalid interval %s",  // NOLINT
+                     arg);
+      }
+      input->stream = interval.value_or(std::chrono::seconds{1});
+    } break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
 int cmd_list(struct argp_state *state) {
   struct arg_list list_arg {
     .global = reinterpret_cast<struct arg_global *>(state->input),  // NOLINT
@@ -468,6 +670,14 @@ int cmd_run(struct argp_state *state) {
               .doc = "override the config file name",
               .group = 0,
           },
+          {
+              .name = "trace",
+              .key = OPTION_TRACE,
+              .arg = "FILE",
+              .flags = 0,
+              .doc = "write startup phases as Chrome trace events to FILE",
+              .group = 0,
+          },
           {nullptr}  // NOLINT
       };
 
@@ -540,8 +750,111 @@ int cmd_exec(struct argp_state *state) {
   argv = &state->argv[state->next];  // NOLINT
   exec_arg.global->exitCode = exec(&exec_arg, argc, argv);
 
-  // consume args
+  // consume args, exec returns now that it runs the command itself
+  state->next += argc;
+  return 0;
+}
+
+int cmd_serve(struct argp_state *state) {
+  struct arg_serve serve_arg {
+    .global = reinterpret_cast<struct arg_global *>(state->input),  // NOLINT
+  };
+
+  int argc = state->argc - state->next + 1;
+  char **argv = &state->argv[state->next - 1];  // NOLINT
+  char *argv0 = argv[0];                        // NOLINT
+
+  std::string name = state->name;
+  name += " serve";
+  argv[0] = name.data();  // NOLINT
+
+  struct argp_option serve_opt[] =  // NOLINT
+      {
+          {
+              .name = "socket",
+              .key = OPTION_SOCKET,
+              .arg = "PATH",
+              .flags = 0,
+              .doc = "unix socket to accept launch requests on (default: "
+                     "\"/run/user/$UID/linglong/box.sock\")",
+              .group = 0,
+          },
+          {
+              .name = "pool",
+              .key = OPTION_POOL,
+              .arg = "COUNT",
+              .flags = 0,
+              .doc = "number of pre-forked workers kept warm (default: 4)",
+              .group = 0,
+          },
+          {nullptr}  // NOLINT
+      };
+
+  struct argp serve_argp = {.options = serve_opt,  // NOLINT
+                            .parser = parse_serve,
+                            .doc = "OCI runtime"};  // NOLINT
+
+  argp_parse(&serve_argp, argc, argv, ARGP_IN_ORDER, &argc,
+             &serve_arg);  // NOLINT
+  argv[0] = argv0;         // NOLINT
   state->next += argc - 1;
+
+  serve_arg.global->exitCode = serve(&serve_arg);
+  return 0;
+}
+
+int cmd_stats(struct argp_state *state) {
+  struct arg_stats stats_arg {
+    .global = reinterpret_cast<struct arg_global *>(state->input),  // NOLINT
+  };
+
+  int argc = state->argc - state->next + 1;
+  char **argv = &state->argv[state->next - 1];  // NOLINT
+  char *argv0 = argv[0];                        // NOLINT
+
+  std::string name = state->name;
+  name += " stats";
+  argv[0] = name.data();  // NOLINT
+
+  struct argp_option stats_opt[] =  // NOLINT
+      {
+          {
+              .name = "stream",
+              .key = OPTION_STREAM,
+              .arg = "INTERVAL",
+              .flags = 0,
+              .doc = "sample every INTERVAL (e.g. 1, 0.5s or 250ms) until "
+                     "interrupted, or until every named container exited",
+              .group = 0,
+          },
+          {
+              .name = "format",
+              .key = 'f',
+              .arg = "FORMAT",
+              .flags = 0,
+              .doc = "select one of: table or json (default: \"table\")",
+              .group = 0,
+          },
+          {nullptr}  // NOLINT
+      };
+
+  struct argp stats_argp = {.options = stats_opt,  // NOLINT
+                            .parser = parse_stats,
+                            .args_doc = "[CONTAINER...]",
+                            .doc = "OCI runtime"};  // NOLINT
+
+  argp_parse(&stats_argp, argc, argv, ARGP_IN_ORDER, &argc,
+             &stats_arg);  // NOLINT
+
+  argv[0] = argv0;  // NOLINT
+  state->next += argc - 1;
+
+  std::vector<std::string> ids;
+  while (state->argv[state->next] != nullptr) {  // NOLINT
+    ids.emplace_back(state->argv[state->next++]);  // NOLINT
+  }
+
+  stats_arg.global->exitCode = stats(&stats_arg, ids);
   return 0;
 }
 
@@ -582,6 +895,12 @@ int cmd_kill(struct argp_state *state) {
   return 0;
 }
 
+int cmd_gc(struct argp_state *state) {
+  auto *global = reinterpret_cast<struct arg_global *>(state->input);  // NOLINT
+  global->exitCode = gc();
+  return 0;
+}
+
 int parse_global(int key, char *arg, struct argp_state *state) {
   auto *input = reinterpret_cast<struct arg_global *>(state->input);  // NOLINT
 
@@ -613,6 +932,18 @@ int parse_global(int key, char *arg, struct argp_state *state) {
         return cmd_kill(state);
       }
 
+      if (::strcmp(arg, "serve") == 0) {
+        return cmd_serve(state);
+      }
+
+      if (::strcmp(arg, "gc") == 0) {
+        return cmd_gc(state);
+      }
+
+      if (::strcmp(arg, "stats") == 0) {
+        return cmd_stats(state);
+      }
+
       argp_error(state, "unknown command %s", arg);  // NOLINT
 
       return -1;
@@ -632,8 +963,6 @@ int main(int argc, char **argv) {
     logErr() << "please specify a command";
     return -1;
   }
-  // make sure that all containers status are valid
-  containerJsonCleanUp();
   struct argp_option options[] =  // NOLINT
       {
           {
@@ -652,7 +981,10 @@ int main(int argc, char **argv) {
       "\tlist        - list known containers\n"
       "\trun         - run a container\n"
       "\texec        - exec a command in a running container\n"
-      "\tkill        - send a signal to the container init process\n";
+      "\tkill        - send a signal to the container init process\n"
+      "\tserve       - launch containers from a pool of pre-forked workers\n"
+      "\tgc          - forget containers that are no longer running\n"
+      "\tstats       - show the resource usage of containers\n";
 
   struct argp global_argp = {.options = options,  // NOLINT
                              .parser = parse_global,
@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "linglong/utils/common.h"
+
+namespace {
+
+void BM_Format(benchmark::State &state) {
+  for (auto _ : state) {
+    auto path = linglong::utils::format("/proc/%d/%s", 4242, "uid_map");
+    benchmark::DoNotOptimize(path);
+  }
+}
+BENCHMARK(BM_Format);
+
+// The mount data of a linyaps mount, joined the way HostMount passes it on.
+void BM_StrVecJoin(benchmark::State &state) {
+  auto options = linglong::benchmarks::makeMount(0)
+                     .at("options")
+                     .get<linglong::utils::str_vec>();
+  for (int64_t i = options.size(); i < state.range(0); ++i) {
+    options.push_back("x-linglong.option" + std::to_string(i));
+  }
+  for (auto _ : state) {
+    auto data = linglong::utils::str_vec_join(options, ',');
+    benchmark::DoNotOptimize(data);
+  }
+  state.SetItemsProcessed(state.iterations() * options.size());
+}
+BENCHMARK(BM_StrVecJoin)->Arg(5)->Arg(64);
+
+}  // namespace
@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_BENCHMARKS_FIXTURES_H_
+#define LINGLONG_BOX_BENCHMARKS_FIXTURES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace linglong::benchmarks {
+
+// A mount as generated for linyaps applications: a read-only bind of a host
+// path or of a layer directory.
+inline nlohmann::json makeMount(size_t i) {
+  auto path = "/usr/share/app-layer-" + std::to_string(i) + "/files";
+  return {
+      {"destination", path},
+      {"type", "bind"},
+      {"source", "/var/lib/linglong/layers/main/org.example.app/" +
+                     std::to_string(i) + path},
+      {"options", {"rbind", "ro", "nosuid", "nodev", "rslave"}},
+  };
+}
+
+// A config.json shaped like the ones ll-cli generates, grown with extra
+// mounts until it is at least size bytes.
+inline std::string makeConfig(size_t size) {
+  nlohmann::json config = {
+      {"ociVersion", "1.0.1"},
+      {"hostname", "linglong"},
+      {"root", {{"path", "rootfs"}, {"readonly", true}}},
+      {"process",
+       {{"args", {"/bin/bash", "--login"}},
+        {"cwd", "/home/user"},
+        {"env", nlohmann::json::array()}}},
+      {"linux",
+       {{"namespaces",
+         {{{"type", "pid"}},
+          {{"type", "mount"}},
+          {{"type", "uts"}},
+          {{"type", "user"}}}},
+        {"uidMappings",
+         {{{"hostID", 1000}, {"containerID", 1000}, {"size", 1}}}},
+        {"gidMappings",
+         {{{"hostID", 1000}, {"containerID", 1000}, {"size", 1}}}},
+        {"resources",
+         {{"cpu", {{"shares", 1024}}},
+          {"memory", {{"limit", 8589934592}}}}}}},
+      {"mounts",
+       {{{"destination", "/proc"}, {"type", "proc"}, {"source", "proc"}},
+        {{"destination", "/dev"},
+         {"type", "tmpfs"},
+         {"source", "tmpfs"},
+         {"options", {"nosuid", "strictatime", "mode=0755", "size=65536k"}}},
+        {{"destination", "/dev/pts"},
+         {"type", "devpts"},
+         {"source", "devpts"},
+         {"options",
+          {"nosuid", "noexec", "newinstance", "ptmxmode=0666", "mode=0620"}}},
+        {{"destination", "/etc/resolv.conf"},
+         {"type", "bind"},
+         {"source", "/run/host/resolv.conf"},
+         {"options", {"rbind", "ro", "copy-symlink"}}}}},
+      {"hooks",
+       {{"startContainer",
+         {{{"path", "/sbin/ldconfig"},
+           {"args", {"/sbin/ldconfig", "-C", "/run/linglong/ld.so.cache"}}}}}}},
+  };
+
+  for (int i = 0; i < 64; ++i) {
+    config["process"]["env"].push_back("LINGLONG_ENV_" + std::to_string(i) +
+                                       "=/run/linglong/value/" +
+                                       std::to_string(i));
+  }
+
+  auto text = config.dump();
+  for (size_t i = 0; text.size() < size; ++i) {
+    config["mounts"].push_back(makeMount(i));
+    if (i % 64 == 0) {
+      text = config.dump();
+    }
+  }
+
+  return config.dump();
+}
+
+// A seccomp profile shaped like the default of docker and linyaps: an
+// allowlist of syscalls under SCMP_ACT_ERRNO, plus a few rules with argument
+// conditions.
+inline nlohmann::json makeSeccomp() {
+  nlohmann::json allowed = nlohmann::json::array();
+  for (const auto *name :
+       {"accept", "accept4", "access", "bind", "brk", "capget", "capset",
+        "chdir", "chmod", "chown", "clock_getres", "clock_gettime",
+        "clock_nanosleep", "close", "connect", "copy_file_range", "dup", "dup2",
+        "dup3", "epoll_create", "epoll_create1", "epoll_ctl", "epoll_pwait",
+        "epoll_wait", "eventfd", "eventfd2", "execve", "execveat", "exit",
+        "exit_group", "faccessat", "faccessat2", "fadvise64", "fallocate",
+        "fchdir", "fchmod", "fchmodat", "fchown", "fchownat", "fcntl",
+        "fdatasync", "flock", "fork", "fstat", "fstatfs", "fsync", "ftruncate",
+        "futex", "getcwd", "getdents", "getdents64", "getegid", "geteuid",
+        "getgid", "getgroups", "getpeername", "getpgid", "getpgrp", "getpid",
+        "getppid", "getpriority", "getrandom", "getresgid", "getresuid",
+        "getrlimit", "getrusage", "getsid", "getsockname", "getsockopt",
+        "gettid", "gettimeofday", "getuid", "inotify_add_watch",
+        "inotify_init1", "inotify_rm_watch", "ioctl", "kill", "lseek", "lstat",
+        "madvise", "memfd_create", "mkdir", "mkdirat", "mmap", "mprotect",
+        "mremap", "munmap", "nanosleep", "newfstatat", "open", "openat",
+        "openat2", "pipe", "pipe2", "poll", "ppoll", "prctl", "pread64",
+        "prlimit64", "pselect6", "pwrite64", "read", "readlink", "readlinkat",
+        "readv", "recvfrom", "recvmmsg", "recvmsg", "rename", "renameat",
+        "renameat2", "rmdir", "rt_sigaction", "rt_sigprocmask", "rt_sigreturn",
+        "sched_getaffinity", "sched_yield", "select", "sendmmsg", "sendmsg",
+        "sendto", "set_robust_list", "set_tid_address", "setitimer", "setpgid",
+        "setsid", "setsockopt", "shutdown", "sigaltstack", "socket",
+        "socketpair", "stat", "statfs", "statx", "symlink", "symlinkat",
+        "sysinfo", "tgkill", "timerfd_create", "timerfd_settime", "umask",
+        "uname", "unlink", "unlinkat", "utimensat", "vfork", "wait4", "waitid",
+        "write", "writev"}) {
+    allowed.push_back(name);
+  }
+
+  auto personality = [](uint64_t value) {
+    return nlohmann::json{
+        {"names", {"personality"}},
+        {"action", "SCMP_ACT_ALLOW"},
+        {"args", {{{"index", 0}, {"value", value}, {"op", "SCMP_CMP_EQ"}}}},
+    };
+  };
+
+  return {
+      {"defaultAction", "SCMP_ACT_ERRNO"},
+      {"architectures",
+       {"SCMP_ARCH_X86_64", "SCMP_ARCH_X86", "SCMP_ARCH_X32"}},
+      {"syscalls",
+       {{{"names", allowed}, {"action", "SCMP_ACT_ALLOW"}},
+        personality(0),
+        personality(8),
+        personality(0x20000),
+        personality(0xffffffff),
+        {{"names", {"clone"}},
+         {"action", "SCMP_ACT_ALLOW"},
+         {"args",
+          {{{"index", 0},
+            {"value", 0x7e020000},
+            {"valueTwo", 0},
+            {"op", "SCMP_CMP_MASKED_EQ"}}}}},
+        {{"names", {"socket"}},
+         {"action", "SCMP_ACT_ERRNO"},
+         {"args", {{{"index", 0}, {"value", 40}, {"op", "SCMP_CMP_EQ"}}}}}}},
+  };
+}
+
+}  // namespace linglong::benchmarks
+
+#endif /* LINGLONG_BOX_BENCHMARKS_FIXTURES_H_ */
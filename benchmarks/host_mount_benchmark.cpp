@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <filesystem>
+
+#include "linglong/container/host_mount.h"
+#include "linglong/container/mount_plan.h"
+
+namespace {
+
+using linglong::container::HostMount;
+using linglong::container::MountPlan;
+
+// The filesystem types of a linyaps config, after the first call has read
+// /proc/filesystems.
+void BM_IsDummy(benchmark::State &state) {
+  const std::vector<std::string> types{"bind", "proc",   "tmpfs", "devpts",
+                                       "mqueue", "sysfs", "cgroup2"};
+  for (auto _ : state) {
+    for (const auto &type : types) {
+      benchmark::DoNotOptimize(HostMount::isDummy(type));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * types.size());
+}
+BENCHMARK(BM_IsDummy);
+
+// Binds of the first count entries of /usr/lib, a mix of files, directories
+// and symlinks like the sources of a real config.
+std::vector<linglong::utils::Mount> makeMounts(size_t count) {
+  std::vector<linglong::utils::Mount> mounts;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator{"/usr/lib", ec}) {
+    if (mounts.size() == count) {
+      break;
+    }
+    linglong::utils::Mount mount;
+    mount.source = entry.path().string();
+    mount.destination = entry.path().string();
+    mount.type = "bind";
+    mount.fsType = linglong::utils::Mount::Bind;
+    mounts.push_back(std::move(mount));
+  }
+  return mounts;
+}
+
+// What MountContainerPath does without a usable plan.
+void BM_CompileMounts(benchmark::State &state) {
+  auto mounts = makeMounts(state.range(0));
+  for (auto _ : state) {
+    MountPlan plan;
+    for (const auto &mount : mounts) {
+      if (auto op = HostMount::Compile(mount); op) {
+        plan.Add(std::move(*op));
+      }
+    }
+    benchmark::DoNotOptimize(plan);
+  }
+  state.SetItemsProcessed(state.iterations() * mounts.size());
+}
+BENCHMARK(BM_CompileMounts)->Arg(8)->Arg(48);
+
+// A launch of a config whose plan was saved before, the key included.
+void BM_LoadMountPlan(benchmark::State &state) {
+  auto dir = std::filesystem::temp_directory_path() /
+             ("box-benchmarks-" + std::to_string(::getpid()) + ".plan");
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+
+  auto mounts = makeMounts(state.range(0));
+  auto key = MountPlan::Key("/bundle", "/bundle/rootfs", mounts);
+  auto file = MountPlan::File(dir, key);
+  MountPlan plan;
+  for (const auto &mount : mounts) {
+    if (auto op = HostMount::Compile(mount); op) {
+      plan.Add(std::move(*op));
+    }
+  }
+
+  if (!plan.Save(file, key)) {
+    state.SkipWithError("MountPlan::Save failed");
+  } else {
+    for (auto _ : state) {
+      auto current = MountPlan::Key("/bundle", "/bundle/rootfs", mounts);
+      auto loaded = MountPlan::Load(file, current);
+      if (!loaded) {
+        state.SkipWithError("MountPlan::Load failed");
+        break;
+      }
+      benchmark::DoNotOptimize(loaded);
+    }
+    state.SetItemsProcessed(state.iterations() * mounts.size());
+  }
+
+  std::filesystem::remove_all(dir, ec);
+}
+BENCHMARK(BM_LoadMountPlan)->Arg(8)->Arg(48);
+
+}  // namespace
@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "linglong/utils/json_backend.h"
+
+namespace {
+
+using linglong::benchmarks::makeConfig;
+
+void configSizes(benchmark::internal::Benchmark *b) {
+  b->Arg(10 << 10)->Arg(100 << 10)->Arg(500 << 10);
+}
+
+void BM_ParseRuntimeNlohmann(benchmark::State &state) {
+  auto config = makeConfig(state.range(0));
+  for (auto _ : state) {
+    auto runtime =
+        nlohmann::json::parse(config).get<linglong::utils::Runtime>();
+    benchmark::DoNotOptimize(runtime);
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+}
+BENCHMARK(BM_ParseRuntimeNlohmann)->Apply(configSizes);
+
+// Only the conversion of the parsed document into the structs.
+void BM_RuntimeFromJson(benchmark::State &state) {
+  auto config = nlohmann::json::parse(makeConfig(state.range(0)));
+  for (auto _ : state) {
+    auto runtime = config.get<linglong::utils::Runtime>();
+    benchmark::DoNotOptimize(runtime);
+  }
+}
+BENCHMARK(BM_RuntimeFromJson)->Apply(configSizes);
+
+#ifdef LINGLONG_BOX_ENABLE_SIMDJSON
+void BM_ParseRuntimeSimdjson(benchmark::State &state) {
+  auto config = makeConfig(state.range(0));
+  for (auto _ : state) {
+    auto runtime = linglong::utils::parseRuntimeSimdjson(config);
+    benchmark::DoNotOptimize(runtime);
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+}
+BENCHMARK(BM_ParseRuntimeSimdjson)->Apply(configSizes);
+#endif
+
+}  // namespace
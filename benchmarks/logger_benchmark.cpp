@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <sys/syslog.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "linglong/utils/common.h"
+#include "linglong/utils/logger.h"
+
+// Run without LINGLONG_LOG_LEVEL, debug records are disabled by default.
+
+namespace {
+
+using linglong::utils::Logger;
+
+void BM_DisabledLog(benchmark::State &state) {
+  std::string path = "/usr/share/app-layer-1/files";
+  for (auto _ : state) {
+    logDbg() << "mount" << path
+             << linglong::utils::format("flags %x", 0x5003)
+             << linglong::utils::errnoString();
+  }
+}
+BENCHMARK(BM_DisabledLog);
+
+// A Logger constructed unconditionally, the way the macros used to expand.
+void BM_DisabledLogEager(benchmark::State &state) {
+  std::string path = "/usr/share/app-layer-1/files";
+  for (auto _ : state) {
+    Logger(Logger::Debug, __FUNCTION__, __LINE__)
+        << "mount" << path << linglong::utils::format("flags %x", 0x5003)
+        << linglong::utils::errnoString();
+  }
+}
+BENCHMARK(BM_DisabledLogEager);
+
+// An enabled record, formatted and written to stdout. stdout goes to
+// /dev/null meanwhile, the results are printed after the run. The syslog mask
+// drops the records before they reach the journal, a run would otherwise
+// send it millions of them.
+void BM_EnabledLog(benchmark::State &state) {
+  int mask = ::setlogmask(LOG_MASK(LOG_EMERG));
+  std::cout.flush();
+  int saved = ::dup(STDOUT_FILENO);
+  int null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+  ::dup2(null, STDOUT_FILENO);
+
+  std::string path = "/usr/share/app-layer-1/files";
+  for (auto _ : state) {
+    logErr() << "mount" << path
+             << linglong::utils::format("flags %x", 0x5003)
+             << linglong::utils::errnoString();
+  }
+
+  std::cout.flush();
+  ::dup2(saved, STDOUT_FILENO);
+  ::close(saved);
+  ::close(null);
+  ::setlogmask(mask);
+}
+BENCHMARK(BM_EnabledLog);
+
+}  // namespace
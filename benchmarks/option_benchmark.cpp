@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+
+#include "fixtures.h"
+#include "linglong/utils/oci_runtime.h"
+
+namespace {
+
+using linglong::benchmarks::makeMount;
+using linglong::utils::Mount;
+
+void mountCounts(benchmark::internal::Benchmark *b) {
+  b->Arg(100)->Arg(1000);
+}
+
+std::vector<linglong::utils::str_vec> makeOptions(size_t count) {
+  std::vector<linglong::utils::str_vec> options;
+  for (size_t i = 0; i < count; ++i) {
+    options.push_back(
+        makeMount(i).at("options").get<linglong::utils::str_vec>());
+  }
+  return options;
+}
+
+size_t optionCount(const std::vector<linglong::utils::str_vec> &options) {
+  size_t count = 0;
+  for (const auto &list : options) {
+    count += list.size();
+  }
+  return count;
+}
+
+void BM_ApplyMountOptions(benchmark::State &state) {
+  auto options = makeOptions(state.range(0));
+  for (auto _ : state) {
+    for (const auto &list : options) {
+      Mount mount{};
+      for (const auto &opt : list) {
+        linglong::utils::applyMountOption(mount, opt);
+      }
+      benchmark::DoNotOptimize(mount);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * optionCount(options));
+}
+BENCHMARK(BM_ApplyMountOptions)->Apply(mountCounts);
+
+// The same lookups through std::map, the way the tables used to be stored.
+void BM_ApplyMountOptionsStdMap(benchmark::State &state) {
+  using linglong::utils::MountFlag;
+  const std::map<std::string_view, MountFlag> optionFlags = [] {
+    std::map<std::string_view, MountFlag> flags;
+    for (const auto &entry : linglong::utils::mountOptionFlags) {
+      flags.emplace(entry.key, entry.value);
+    }
+    return flags;
+  }();
+  const std::map<std::string_view, uint32_t> propagationFlags = [] {
+    std::map<std::string_view, uint32_t> flags;
+    for (const auto &entry : linglong::utils::mountPropagationFlags) {
+      flags.emplace(entry.key, entry.value);
+    }
+    return flags;
+  }();
+
+  auto options = makeOptions(state.range(0));
+  for (auto _ : state) {
+    for (const auto &list : options) {
+      Mount mount{};
+      for (const auto &opt : list) {
+        if (auto it = optionFlags.find(opt);
+            it != optionFlags.cend() && it->second.flag != 0) {
+          if (it->second.clear) {
+            mount.flags &= ~it->second.flag;
+          } else {
+            mount.flags |= it->second.flag;
+          }
+        } else if (auto it = propagationFlags.find(opt);
+                   it != propagationFlags.cend()) {
+          mount.propagationFlags |= it->second;
+        } else {
+          mount.data.push_back(opt);
+        }
+      }
+      benchmark::DoNotOptimize(mount);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * optionCount(options));
+}
+BENCHMARK(BM_ApplyMountOptionsStdMap)->Apply(mountCounts);
+
+void BM_MountFromJson(benchmark::State &state) {
+  auto mounts = nlohmann::json::array();
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    mounts.push_back(makeMount(i));
+  }
+  for (auto _ : state) {
+    auto decoded = mounts.get<std::vector<Mount>>();
+    benchmark::DoNotOptimize(decoded);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MountFromJson)->Apply(mountCounts);
+
+}  // namespace
@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <filesystem>
+
+#include "fixtures.h"
+#include "linglong/container/seccomp_p.h"
+
+namespace {
+
+using linglong::utils::Seccomp;
+
+Seccomp makeProfile() {
+  return linglong::benchmarks::makeSeccomp().get<Seccomp>();
+}
+
+void BM_ToScmpArgCmpArray(benchmark::State &state) {
+  auto profile = makeProfile();
+  size_t rules = 0;
+  for (auto _ : state) {
+    for (const auto &syscall : profile.syscalls) {
+      auto args = linglong::container::toScmpArgCmpArray(syscall.args);
+      benchmark::DoNotOptimize(args);
+    }
+    rules += profile.syscalls.size();
+  }
+  state.SetItemsProcessed(rules);
+}
+BENCHMARK(BM_ToScmpArgCmpArray);
+
+// What CompileSeccomp does on a cache miss.
+void BM_CompileSeccompUncached(benchmark::State &state) {
+  auto profile = makeProfile();
+  std::vector<sock_filter> program;
+  for (auto _ : state) {
+    program.clear();
+    if (linglong::container::CompileSeccompUncached(profile, program) != 0) {
+      state.SkipWithError("CompileSeccompUncached failed");
+      return;
+    }
+    benchmark::DoNotOptimize(program);
+  }
+}
+BENCHMARK(BM_CompileSeccompUncached);
+
+// A launch with a profile that was compiled before, served from a cache of
+// its own rather than the user's.
+void BM_CompileSeccompCached(benchmark::State &state) {
+  auto dir = std::filesystem::temp_directory_path() /
+             ("box-benchmarks-" + std::to_string(::getpid()) + ".cache");
+  auto profile = makeProfile();
+  std::vector<sock_filter> program;
+  if (linglong::container::CompileSeccomp(profile, program, dir) != 0) {
+    state.SkipWithError("CompileSeccomp failed");
+  } else {
+    for (auto _ : state) {
+      program.clear();
+      linglong::container::CompileSeccomp(profile, program, dir);
+      benchmark::DoNotOptimize(program);
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+}
+BENCHMARK(BM_CompileSeccompCached);
+
+}  // namespace
@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <filesystem>
+
+#include "linglong/container/state_table.h"
+
+namespace {
+
+using linglong::container::ContainerState;
+using linglong::container::StateTable;
+
+void stateCounts(benchmark::internal::Benchmark *b) {
+  b->Arg(10)->Arg(100)->Arg(1000);
+}
+
+// A table of its own holding count containers, removed with the fixture.
+class StateTableFixture : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State &state) override {
+    path = std::filesystem::temp_directory_path() /
+           ("box-benchmarks-" + std::to_string(::getpid()) + ".table");
+    table = StateTable::Open(path);
+    if (!table) {
+      return;
+    }
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      auto index = std::to_string(i);
+      table->Put(ContainerState{
+          .id = "org.example.app-" + index,
+          .bundle = "/run/user/1000/linglong/" + index,
+          .pid = static_cast<pid_t>(4242 + i),
+      });
+    }
+  }
+
+  void TearDown(const benchmark::State & /*unused*/) override {
+    table.reset();
+    std::filesystem::remove(path);
+  }
+
+ protected:
+  std::filesystem::path path;
+  std::optional<StateTable> table;
+};
+
+// What `ll-box list` reads, the table counterpart of reading one state file
+// per container.
+BENCHMARK_DEFINE_F(StateTableFixture, List)(benchmark::State &state) {
+  if (!table) {
+    state.SkipWithError("open state table failed");
+    return;
+  }
+  for (auto _ : state) {
+    auto states = table->List();
+    benchmark::DoNotOptimize(states);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(StateTableFixture, List)->Apply(stateCounts);
+
+// What exec and kill read, probing for the last container added.
+BENCHMARK_DEFINE_F(StateTableFixture, Get)(benchmark::State &state) {
+  if (!table) {
+    state.SkipWithError("open state table failed");
+    return;
+  }
+  auto id = "org.example.app-" + std::to_string(state.range(0) - 1);
+  for (auto _ : state) {
+    auto found = table->Get(id);
+    benchmark::DoNotOptimize(found);
+  }
+}
+BENCHMARK_REGISTER_F(StateTableFixture, Get)->Apply(stateCounts);
+
+}  // namespace
@@ -0,0 +1,367 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/cgroup_manager.h"
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "linglong/utils/logger.h"
+
+namespace linglong::container {
+
+namespace {
+
+// how long the removal waits for the last processes of the leaf to exit
+constexpr std::chrono::milliseconds kRemoveTimeout{1000};
+// the period of cpu.max when only a quota is given
+constexpr uint64_t kDefaultCpuPeriod = 100000;
+
+// Where cgroup2 is mounted, /sys/fs/cgroup/unified on hybrid hosts.
+std::optional<std::filesystem::path> cgroup2Mount() noexcept {
+  for (const auto *path : {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"}) {
+    struct statfs fs {};
+    if (::statfs(path, &fs) == 0 &&
+        static_cast<uint64_t>(fs.f_type) == CGROUP2_SUPER_MAGIC) {
+      return path;
+    }
+  }
+  return std::nullopt;
+}
+
+// The cgroup v2 path of the calling process, the "0::" line of
+// /proc/self/cgroup.
+std::optional<std::string> ownCgroup() {
+  std::ifstream file{"/proc/self/cgroup"};
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.rfind("0::", 0) == 0) {
+      return line.substr(3);
+    }
+  }
+  return std::nullopt;
+}
+
+// crun's conversion of cpu shares [2-262144] to cpu.weight [1-10000], it maps
+// the default 1024 shares to the default weight 100
+uint64_t cpuWeight(uint64_t shares) {
+  if (shares <= 2) {
+    return 1;
+  }
+  if (shares >= 262144) {
+    return 10000;
+  }
+  auto l = std::log2(static_cast<double>(shares));
+  auto exponent = (l * l + 125 * l) / 612.0 - 7.0 / 34.0;
+  return static_cast<uint64_t>(std::ceil(std::pow(10, exponent)));
+}
+
+// converts a blkio weight [10-1000] to io.weight [1-10000]
+uint64_t ioWeight(uint16_t weight) {
+  auto clamped = std::clamp<uint64_t>(weight, 10, 1000);
+  return 1 + (clamped - 10) * 9999 / 990;
+}
+
+// a key of io.max and the devices limited by it
+struct throttle {
+  const char *key;
+  const std::vector<utils::ThrottleDevice> *devices;
+};
+
+std::string device(int64_t major, int64_t minor) {
+  return std::to_string(major) + ":" + std::to_string(minor);
+}
+
+}  // namespace
+
+std::unique_ptr<CgroupManager> CgroupManager::Create(
+    const std::string &parent, const std::string &id) noexcept {
+  auto mount = cgroup2Mount();
+  if (!mount) {
+    logErr() << "cgroup v2 isn't mounted";
+    return nullptr;
+  }
+
+  std::filesystem::path parentPath;
+  try {
+    if (!parent.empty() && parent.front() == '/') {
+      parentPath = *mount / parent.substr(1);
+    } else {
+      auto own = ownCgroup();
+      if (!own) {
+        logErr() << "couldn't find the cgroup of ll-box";
+        return nullptr;
+      }
+      parentPath = *mount / own->substr(1) / parent;
+    }
+    parentPath = parentPath.lexically_normal();
+  } catch (const std::exception &e) {
+    logErr() << "resolve cgroup" << parent << "failed:" << e.what();
+    return nullptr;
+  }
+
+  int parentFd =
+      ::open(parentPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (parentFd == -1) {
+    logErr() << "open cgroup" << parentPath.string() << "failed"
+             << utils::errnoString();
+    return nullptr;
+  }
+
+  // ids may contain slashes, cgroup names can't
+  auto name = "ll-box-" + id;
+  std::replace(name.begin(), name.end(), '/', '_');
+
+  if (::mkdirat(parentFd, name.c_str(), 0755) == -1) {
+    // left behind by a container that couldn't clean up, reuse it if empty
+    if (errno != EEXIST ||
+        ::unlinkat(parentFd, name.c_str(), AT_REMOVEDIR) == -1 ||
+        ::mkdirat(parentFd, name.c_str(), 0755) == -1) {
+      logErr() << "create cgroup" << name << "in" << parentPath.string()
+               << "failed" << utils::errnoString();
+      ::close(parentFd);
+      return nullptr;
+    }
+  }
+
+  int fd = ::openat(parentFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    logErr() << "open cgroup" << name << "failed" << utils::errnoString();
+    ::unlinkat(parentFd, name.c_str(), AT_REMOVEDIR);
+    ::close(parentFd);
+    return nullptr;
+  }
+
+  auto path = (parentPath / name).string();
+  logDbg() << "created cgroup" << path;
+  return std::unique_ptr<CgroupManager>{
+      new CgroupManager(parentFd, fd, std::move(name), std::move(path))};
+}
+
+CgroupManager::CgroupManager(int parentFd, int fd, std::string name,
+                             std::string path) noexcept
+    : parentFd(parentFd),
+      fd(fd),
+      name(std::move(name)),
+      path(std::move(path)) {}
+
+CgroupManager::~CgroupManager() {
+  remove();
+  ::close(fd);
+  ::close(parentFd);
+}
+
+bool CgroupManager::enable(const std::string &controller) noexcept {
+  if (auto it = controllers.find(controller); it != controllers.end()) {
+    return it->second;
+  }
+
+  auto enabled = false;
+  int file = ::openat(parentFd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+  if (file != -1) {
+    auto value = "+" + controller;
+    enabled = ::write(file, value.c_str(), value.size()) != -1;
+    ::close(file);
+  }
+  if (!enabled) {
+    logWan() << "controller" << controller
+             << "isn't delegated, its limits are ignored"
+             << utils::errnoString();
+  }
+  controllers[controller] = enabled;
+  return enabled;
+}
+
+bool CgroupManager::Write(const std::string &file,
+                          const std::string &value) noexcept {
+  auto controller = file.substr(0, file.find('.'));
+  if (controller != "cgroup" && !enable(controller)) {
+    return true;
+  }
+
+  int out = ::openat(fd, file.c_str(), O_WRONLY | O_CLOEXEC);
+  if (out == -1 && errno == ENOENT) {
+    // e.g. io.weight without the io.cost controller
+    logWan() << "cgroup file" << file << "doesn't exist, ignore" << value;
+    return true;
+  }
+  if (out == -1 ||
+      ::write(out, value.c_str(), value.size()) !=
+          static_cast<ssize_t>(value.size())) {
+    logErr() << "write" << value << "to" << file << "failed"
+             << utils::errnoString();
+    if (out != -1) {
+      ::close(out);
+    }
+    return false;
+  }
+  ::close(out);
+  return true;
+}
+
+bool CgroupManager::Apply(const utils::Resources &resources) noexcept {
+  const auto &memory = resources.memory;
+  if (memory.limit > 0 &&
+      !Write("memory.max", std::to_string(memory.limit))) {
+    return false;
+  }
+  if (memory.reservation > 0 &&
+      !Write("memory.low", std::to_string(memory.reservation))) {
+    return false;
+  }
+  // v1 limits memory and swap together, v2 only swap
+  if (memory.swap > 0) {
+    if (memory.limit <= 0 || memory.swap < memory.limit) {
+      logErr() << "memory.swap" << memory.swap
+               << "needs a memory.limit not above it";
+      return false;
+    }
+    if (!Write("memory.swap.max", std::to_string(memory.swap - memory.limit))) {
+      return false;
+    }
+  }
+
+  const auto &cpu = resources.cpu;
+  if (cpu.shares > 0 &&
+      !Write("cpu.weight", std::to_string(cpuWeight(cpu.shares)))) {
+    return false;
+  }
+  if (cpu.quota != 0 || cpu.period != 0) {
+    auto quota = cpu.quota > 0 ? std::to_string(cpu.quota) : "max";
+    auto period = cpu.period > 0 ? cpu.period : kDefaultCpuPeriod;
+    if (!Write("cpu.max", quota + " " + std::to_string(period))) {
+      return false;
+    }
+  }
+  if (!cpu.cpus.empty() && !Write("cpuset.cpus", cpu.cpus)) {
+    return false;
+  }
+  if (!cpu.mems.empty() && !Write("cpuset.mems", cpu.mems)) {
+    return false;
+  }
+
+  if (resources.pids) {
+    auto limit = resources.pids->limit > 0
+                     ? std::to_string(resources.pids->limit)
+                     : "max";
+    if (!Write("pids.max", limit)) {
+      return false;
+    }
+  }
+
+  const auto &blockIO = resources.blockIO;
+  if (blockIO.weight > 0 &&
+      !Write("io.weight",
+             "default " + std::to_string(ioWeight(blockIO.weight)))) {
+    return false;
+  }
+  for (const auto &dev : blockIO.weightDevice) {
+    if (dev.weight > 0 &&
+        !Write("io.weight", device(dev.major, dev.minor) + " " +
+                                std::to_string(ioWeight(dev.weight)))) {
+      return false;
+    }
+  }
+  const std::array<throttle, 4> throttles{{
+      {"rbps", &blockIO.throttleReadBpsDevice},
+      {"wbps", &blockIO.throttleWriteBpsDevice},
+      {"riops", &blockIO.throttleReadIOPSDevice},
+      {"wiops", &blockIO.throttleWriteIOPSDevice},
+  }};
+  for (const auto &[key, devices] : throttles) {
+    for (const auto &dev : *devices) {
+      if (!Write("io.max", device(dev.major, dev.minor) + " " + key + "=" +
+                               std::to_string(dev.rate))) {
+        return false;
+      }
+    }
+  }
+
+  // last, so they take precedence over the converted values
+  for (const auto &[file, value] : resources.unified) {
+    if (file.empty() || file.front() == '.' ||
+        file.find('/') != std::string::npos) {
+      logErr() << "invalid cgroup file" << file;
+      return false;
+    }
+    if (!Write(file, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CgroupManager::Join(pid_t pid) noexcept {
+  return Write("cgroup.procs", std::to_string(pid));
+}
+
+void CgroupManager::remove() noexcept {
+  if (::unlinkat(parentFd, name.c_str(), AT_REMOVEDIR) == 0 ||
+      errno == ENOENT) {
+    return;
+  }
+  if (errno != EBUSY) {
+    logWan() << "remove cgroup" << path << "failed" << utils::errnoString();
+    return;
+  }
+
+  // processes of the container may still be exiting, kill whatever is left
+  // (linux 5.14) and wait for cgroup.events to report the leaf empty
+  int kill = ::openat(fd, "cgroup.kill", O_WRONLY | O_CLOEXEC);
+  if (kill != -1) {
+    if (::write(kill, "1", 1) == -1) {
+      logWan() << "kill cgroup" << path << "failed" << utils::errnoString();
+    }
+    ::close(kill);
+  }
+
+  int events = ::openat(fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+  auto deadline = std::chrono::steady_clock::now() + kRemoveTimeout;
+  while (events != -1) {
+    std::array<char, 128> buf{};
+    auto size = ::pread(events, buf.data(), buf.size() - 1, 0);
+    if (size == -1 ||
+        std::string_view{buf.data()}.find("populated 0") !=
+            std::string_view::npos) {
+      break;
+    }
+
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+      break;
+    }
+    pollfd pfd{.fd = events, .events = POLLPRI, .revents = 0};
+    if (::poll(&pfd, 1, static_cast<int>(left.count())) == -1 &&
+        errno != EINTR) {
+      break;
+    }
+  }
+  if (events != -1) {
+    ::close(events);
+  }
+
+  if (::unlinkat(parentFd, name.c_str(), AT_REMOVEDIR) == -1 &&
+      errno != ENOENT) {
+    logWan() << "remove cgroup" << path << "failed" << utils::errnoString();
+  }
+}
+
+}  // namespace linglong::container
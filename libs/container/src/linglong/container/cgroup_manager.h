@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_CGROUP_MANAGER_H_
+#define LINGLONG_BOX_SRC_CONTAINER_CGROUP_MANAGER_H_
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::container {
+
+// CgroupManager owns the cgroup v2 leaf of one container. The leaf is created
+// on the host side under a cgroup delegated to the caller, linux.cgroupsPath,
+// and removed again when the manager is destroyed.
+//
+// Every file is written with openat() and write() relative to the dirfd of
+// the leaf, which is also what clone3 needs to start the container in it.
+class CgroupManager {
+ public:
+  // Creates the leaf named after the container id under parent. An absolute
+  // parent is taken relative to the cgroup2 mount, a relative one to the
+  // cgroup of the calling process. nullptr if it couldn't be created.
+  static std::unique_ptr<CgroupManager> Create(const std::string &parent,
+                                               const std::string &id) noexcept;
+
+  CgroupManager(const CgroupManager &) = delete;
+  CgroupManager &operator=(const CgroupManager &) = delete;
+  // Kills whatever is left in the leaf and removes it.
+  ~CgroupManager();
+
+  // Enables the controllers resources needs in the parent and writes the
+  // limits. Controllers the parent doesn't delegate are skipped with a
+  // warning, values the kernel rejects fail.
+  bool Apply(const utils::Resources &resources) noexcept;
+
+  // Moves pid into the leaf, for kernels without CLONE_INTO_CGROUP.
+  bool Join(pid_t pid) noexcept;
+  // Writes value to file of the leaf. Files of controllers the parent doesn't
+  // delegate, or that don't exist, are skipped with a warning.
+  bool Write(const std::string &file, const std::string &value) noexcept;
+
+  // The dirfd of the leaf, for CLONE_INTO_CGROUP.
+  [[nodiscard]] int Fd() const noexcept { return fd; }
+  // The path of the leaf on the host.
+  [[nodiscard]] const std::string &Path() const noexcept { return path; }
+
+ private:
+  CgroupManager(int parentFd, int fd, std::string name,
+                std::string path) noexcept;
+
+  bool enable(const std::string &controller) noexcept;
+  void remove() noexcept;
+
+  int parentFd{-1};
+  int fd{-1};
+  std::string name;
+  std::string path;
+  // whether the parent delegates a controller, by name
+  std::unordered_map<std::string, bool> controllers;
+};
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_CGROUP_MANAGER_H_ */
@@ -0,0 +1,257 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/cgroup_stats.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <utility>
+
+#include "linglong/utils/logger.h"
+
+namespace linglong::container {
+
+namespace {
+
+// memory.stat is the largest file, about 2KiB on current kernels
+constexpr size_t kReadBufferSize = 8192;
+
+// in the order of CgroupStats::file
+constexpr std::array<const char *, 9> kFileNames{
+    "cpu.stat",     "memory.current",  "memory.peak",
+    "memory.stat",  "io.stat",         "pids.current",
+    "cpu.pressure", "memory.pressure", "io.pressure",
+};
+
+uint64_t toNumber(std::string_view text) noexcept {
+  uint64_t value{0};
+  std::from_chars(text.data(), text.data() + text.size(), value);
+  return value;
+}
+
+// Splits text at the first sep, the rest is empty without one.
+std::pair<std::string_view, std::string_view> cut(std::string_view text,
+                                                  char sep) noexcept {
+  auto pos = text.find(sep);
+  if (pos == std::string_view::npos) {
+    return {text, {}};
+  }
+  return {text.substr(0, pos), text.substr(pos + 1)};
+}
+
+// Calls f with every line of text.
+template <class F>
+void forEachLine(std::string_view text, F f) {
+  while (!text.empty()) {
+    auto [line, rest] = cut(text, '\n');
+    f(line);
+    text = rest;
+  }
+}
+
+// Calls f with key and value of every "key value" line, the format of
+// cpu.stat and memory.stat.
+template <class F>
+void forEachKey(std::string_view text, F f) {
+  forEachLine(text, [&f](std::string_view line) {
+    auto [key, value] = cut(line, ' ');
+    f(key, toNumber(value));
+  });
+}
+
+// "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0" per device
+void parseIoStat(std::string_view text, ResourceStats &stats) noexcept {
+  forEachLine(text, [&stats](std::string_view line) {
+    auto fields = cut(line, ' ').second;
+    while (!fields.empty()) {
+      auto [field, rest] = cut(fields, ' ');
+      auto [key, value] = cut(field, '=');
+      if (key == "rbytes") {
+        stats.ioReadBytes += toNumber(value);
+      } else if (key == "wbytes") {
+        stats.ioWriteBytes += toNumber(value);
+      } else if (key == "rios") {
+        stats.ioReadOps += toNumber(value);
+      } else if (key == "wios") {
+        stats.ioWriteOps += toNumber(value);
+      }
+      fields = rest;
+    }
+  });
+}
+
+// "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" and the same for "full".
+// text must be followed by a NUL byte, strtod reads the averages in place.
+void parsePressure(std::string_view text, PressureStats &stats) noexcept {
+  forEachLine(text, [&stats](std::string_view line) {
+    auto [kind, fields] = cut(line, ' ');
+    auto some = kind == "some";
+    if (!some && kind != "full") {
+      return;
+    }
+    while (!fields.empty()) {
+      auto [field, rest] = cut(fields, ' ');
+      auto [key, value] = cut(field, '=');
+      if (key == "avg10") {
+        (some ? stats.someAvg10 : stats.fullAvg10) =
+            std::strtod(value.data(), nullptr);
+      } else if (key == "total") {
+        (some ? stats.someTotal : stats.fullTotal) = toNumber(value);
+      }
+      fields = rest;
+    }
+  });
+}
+
+nlohmann::json toJson(const PressureStats &stats) {
+  return {
+      {"some_avg10", stats.someAvg10},
+      {"full_avg10", stats.fullAvg10},
+      {"some_total", stats.someTotal},
+      {"full_total", stats.fullTotal},
+  };
+}
+
+}  // namespace
+
+std::optional<CgroupStats> CgroupStats::Open(const std::string &path) noexcept {
+  int dir = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir == -1) {
+    logDbg() << "open cgroup" << path << "failed" << utils::errnoString();
+    return std::nullopt;
+  }
+
+  CgroupStats stats;
+  for (size_t i = 0; i < FileCount; ++i) {
+    stats.fds[i] = ::openat(dir, kFileNames[i], O_RDONLY | O_CLOEXEC);
+  }
+  ::close(dir);
+  return stats;
+}
+
+CgroupStats::CgroupStats() noexcept : buffer(kReadBufferSize) {
+  fds.fill(-1);
+}
+
+CgroupStats::CgroupStats(CgroupStats &&other) noexcept
+    : fds(other.fds),
+      buffer(std::move(other.buffer)),
+      removed(other.removed) {
+  other.fds.fill(-1);
+}
+
+CgroupStats &CgroupStats::operator=(CgroupStats &&other) noexcept {
+  if (this != &other) {
+    this->~CgroupStats();
+    fds = other.fds;
+    buffer = std::move(other.buffer);
+    removed = other.removed;
+    other.fds.fill(-1);
+  }
+  return *this;
+}
+
+CgroupStats::~CgroupStats() {
+  for (auto &fd : fds) {
+    if (fd != -1) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+}
+
+std::string_view CgroupStats::read(file f) noexcept {
+  if (fds[f] == -1) {
+    return {};
+  }
+
+  // one byte is kept for the NUL parsePressure relies on
+  auto size = ::pread(fds[f], buffer.data(), buffer.size() - 1, 0);
+  if (size == -1) {
+    removed = removed || errno == ENODEV;
+    return {};
+  }
+  buffer[static_cast<size_t>(size)] = '\0';
+  return {buffer.data(), static_cast<size_t>(size)};
+}
+
+bool CgroupStats::Read(ResourceStats &stats) noexcept {
+  stats = ResourceStats{};
+
+  forEachKey(read(CpuStat), [&stats](std::string_view key, uint64_t value) {
+    if (key == "usage_usec") {
+      stats.cpuUsageUsec = value;
+    } else if (key == "user_usec") {
+      stats.cpuUserUsec = value;
+    } else if (key == "system_usec") {
+      stats.cpuSystemUsec = value;
+    } else if (key == "nr_throttled") {
+      stats.cpuNrThrottled = value;
+    } else if (key == "throttled_usec") {
+      stats.cpuThrottledUsec = value;
+    }
+  });
+
+  stats.memoryCurrent = toNumber(read(MemoryCurrent));
+  stats.memoryPeak = toNumber(read(MemoryPeak));
+  forEachKey(read(MemoryStat), [&stats](std::string_view key, uint64_t value) {
+    if (key == "anon") {
+      stats.memoryAnon = value;
+    } else if (key == "file") {
+      stats.memoryFile = value;
+    } else if (key == "kernel") {
+      stats.memoryKernel = value;
+    }
+  });
+
+  parseIoStat(read(IoStat), stats);
+  stats.pids = toNumber(read(PidsCurrent));
+  parsePressure(read(CpuPressure), stats.cpuPressure);
+  parsePressure(read(MemoryPressure), stats.memoryPressure);
+  parsePressure(read(IoPressure), stats.ioPressure);
+  return !removed;
+}
+
+nlohmann::json toJson(const ResourceStats &stats) {
+  return {
+      {"cpu",
+       {
+           {"usage_usec", stats.cpuUsageUsec},
+           {"user_usec", stats.cpuUserUsec},
+           {"system_usec", stats.cpuSystemUsec},
+           {"nr_throttled", stats.cpuNrThrottled},
+           {"throttled_usec", stats.cpuThrottledUsec},
+       }},
+      {"memory",
+       {
+           {"current", stats.memoryCurrent},
+           {"peak", stats.memoryPeak},
+           {"anon", stats.memoryAnon},
+           {"file", stats.memoryFile},
+           {"kernel", stats.memoryKernel},
+       }},
+      {"io",
+       {
+           {"rbytes", stats.ioReadBytes},
+           {"wbytes", stats.ioWriteBytes},
+           {"rios", stats.ioReadOps},
+           {"wios", stats.ioWriteOps},
+       }},
+      {"pids", {{"current", stats.pids}}},
+      {"pressure",
+       {
+           {"cpu", toJson(stats.cpuPressure)},
+           {"memory", toJson(stats.memoryPressure)},
+           {"io", toJson(stats.ioPressure)},
+       }},
+  };
+}
+
+}  // namespace linglong::container
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_CGROUP_STATS_H_
+#define LINGLONG_BOX_SRC_CONTAINER_CGROUP_STATS_H_
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace linglong::container {
+
+// A PSI file, the "full" values stay zero for cpu.pressure before linux 5.13.
+struct PressureStats {
+  double someAvg10{0};
+  double fullAvg10{0};
+  // microseconds stalled since the cgroup was created
+  uint64_t someTotal{0};
+  uint64_t fullTotal{0};
+};
+
+// What a container consumed, as accounted by its cgroup. Counters of
+// controllers the cgroup doesn't have stay zero.
+struct ResourceStats {
+  // cpu.stat
+  uint64_t cpuUsageUsec{0};
+  uint64_t cpuUserUsec{0};
+  uint64_t cpuSystemUsec{0};
+  uint64_t cpuThrottledUsec{0};
+  uint64_t cpuNrThrottled{0};
+  // memory.current, memory.peak (linux 5.19) and memory.stat, in bytes
+  uint64_t memoryCurrent{0};
+  uint64_t memoryPeak{0};
+  uint64_t memoryAnon{0};
+  uint64_t memoryFile{0};
+  uint64_t memoryKernel{0};
+  // io.stat summed over the devices
+  uint64_t ioReadBytes{0};
+  uint64_t ioWriteBytes{0};
+  uint64_t ioReadOps{0};
+  uint64_t ioWriteOps{0};
+  // pids.current
+  uint64_t pids{0};
+  PressureStats cpuPressure;
+  PressureStats memoryPressure;
+  PressureStats ioPressure;
+};
+
+// CgroupStats reads the statistics of one cgroup v2 directory. The files are
+// opened once and re-read from offset 0 with pread, so sampling costs one
+// syscall per file and no allocation.
+class CgroupStats {
+ public:
+  // Opens the files of the cgroup at path, those the cgroup lacks are
+  // skipped. std::nullopt if there is no such cgroup.
+  static std::optional<CgroupStats> Open(const std::string &path) noexcept;
+
+  CgroupStats(CgroupStats &&other) noexcept;
+  CgroupStats &operator=(CgroupStats &&other) noexcept;
+  CgroupStats(const CgroupStats &) = delete;
+  CgroupStats &operator=(const CgroupStats &) = delete;
+  ~CgroupStats();
+
+  // Samples every file, false once the cgroup has been removed.
+  bool Read(ResourceStats &stats) noexcept;
+
+ private:
+  enum file : size_t {
+    CpuStat,
+    MemoryCurrent,
+    MemoryPeak,
+    MemoryStat,
+    IoStat,
+    PidsCurrent,
+    CpuPressure,
+    MemoryPressure,
+    IoPressure,
+    FileCount,
+  };
+
+  CgroupStats() noexcept;
+
+  // the content of f, empty if it couldn't be read
+  std::string_view read(file f) noexcept;
+
+  std::array<int, FileCount> fds{};
+  std::vector<char> buffer;
+  bool removed{false};
+};
+
+// The format of `ll-box stats --format json`, without the id.
+nlohmann::json toJson(const ResourceStats &stats);
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_CGROUP_STATS_H_ */
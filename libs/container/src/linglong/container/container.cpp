@@ -13,7 +13,7 @@
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
-#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/sysmacros.h>
@@ -21,200 +21,29 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
+#include <optional>
 
-#include "linglong/container/helper.h"
+#include "linglong/container/cgroup_manager.h"
+#include "linglong/container/hook_runner.h"
 #include "linglong/container/host_mount.h"
+#include "linglong/container/id_map.h"
+#include "linglong/container/mount_plan.h"
+#include "linglong/container/pressure_monitor.h"
+#include "linglong/container/seccomp_notify.h"
+#include "linglong/container/seccomp_p.h"
+#include "linglong/container/state_table.h"
+#include "linglong/utils/event_loop.h"
 #include "linglong/utils/logger.h"
 #include "linglong/utils/platform.h"
-
-int ConfigUserNamespace(const linglong::utils::Linux &linux, int initPid) {
-  std::string pid = "self";
-  if (initPid > 0) {
-    pid = linglong::utils::format("%d", initPid);
-  }
-
-  logDbg() << "old uid:" << getuid() << "gid:" << getgid();
-  logDbg() << "start write uid_map and pid_map" << initPid;
-
-  // write uid map
-  auto uidMap = linglong::utils::format("/proc/%s/uid_map", pid.c_str());
-  std::ofstream uidMapFile(uidMap);
-  if (!uidMapFile.is_open()) {
-    logErr() << "couldn't open file" << uidMap;
-    return -1;
-  }
-
-  for (auto const &idMap : linux.uidMappings) {
-    uidMapFile << linglong::utils::format("%lu %lu %lu\n", idMap.containerID, idMap.hostID,
-                               idMap.size);
-  }
-  uidMapFile.close();
-
-  // write gid map
-  auto setgroupsPath = linglong::utils::format("/proc/%s/setgroups", pid.c_str());
-  std::ofstream setgroupsFile(setgroupsPath);
-  if (!setgroupsFile.is_open()) {
-    logErr() << "couldn't open file" << setgroupsPath;
-    return -1;
-  }
-  setgroupsFile << "deny";
-  setgroupsFile.close();
-
-  auto gidMap = linglong::utils::format("/proc/%s/gid_map", pid.c_str());
-  std::ofstream gidMapFile(gidMap);
-  if (!gidMapFile.is_open()) {
-    logErr() << "couldn't open file" << gidMap;
-    return -1;
-  }
-
-  for (auto const &idMap : linux.gidMappings) {
-    gidMapFile << linglong::utils::format("%lu %lu %lu\n", idMap.containerID, idMap.hostID,
-                               idMap.size);
-  }
-  gidMapFile.close();
-
-  logDbg() << "new uid:" << getuid() << "gid:" << getgid();
-  return 0;
-}
+#include "linglong/utils/runtime_cache.h"
+#include "linglong/utils/trace.h"
 
 namespace linglong::container {
 
-// FIXME(iceyer): not work now
-static int ConfigCgroupV2(const std::string &cgroupsPath,
-                          const utils::Resources &res, int initPid) {
-  if (cgroupsPath.empty()) {
-    logWan() << "skip with empty cgroupsPath";
-    return 0;
-  }
-
-  auto writeConfig = [](const std::map<std::string, std::string> &cfgs) {
-    for (auto const &cfg : cfgs) {
-      logWan() << "ConfigCgroupV2" << cfg.first << cfg.second;
-      std::ofstream cfgFile(cfg.first);
-      if (!cfgFile.is_open()) {
-        logErr() << "config file isn't open" << cfg.first;
-        return false;
-      }
-
-      cfgFile << cfg.second << std::endl;
-      cfgFile.close();
-    }
-
-    return true;
-  };
-
-  auto create_directories = [](const std::filesystem::path &path,
-                               std::filesystem::perms perm,
-                               std::error_code &ec) {
-    if (!std::filesystem::create_directories(path, ec)) {
-      logErr() << "couldn't create directories " << path.string()
-               << ", error:" << ec.message();
-      return;
-    }
-
-    std::filesystem::permissions(path, perm,
-                                 std::filesystem::perm_options::replace, ec);
-    if (ec) {
-      logErr() << "set " << path.string()
-               << "permission error:" << ec.message();
-      return;
-    }
-  };
-
-  const auto dirPerm =
-      std::filesystem::perms::owner_all | std::filesystem::perms::group_read |
-      std::filesystem::perms::group_exec | std::filesystem::perms::others_read |
-      std::filesystem::perms::others_exec;  // 0755
-  std::error_code ec;
-
-  auto cgroupsRoot = std::filesystem::path{cgroupsPath};
-  create_directories(cgroupsRoot, dirPerm, ec);
-  if (ec) {
-    return -1;
-  }
-
-  if (auto ret = ::mount("cgroup2", cgroupsRoot.string().c_str(), "cgroup2", 0U,
-                         nullptr);
-      ret == -1) {
-    logErr() << "mount cgroup failed:" << utils::errnoString();
-    return -1;
-  }
-
-  // TODO: should sub path with pid?
-  auto subCgroupRoot = cgroupsRoot / "ll-box";
-  create_directories(subCgroupRoot, dirPerm, ec);
-  if (ec) {
-    return -1;
-  }
-
-  auto subCgroupPath =
-      [subCgroupRoot](const std::string &compents) -> std::string {
-    return (subCgroupRoot / compents).string();
-  };
-
-  // config memory
-  const auto memMax = res.memory.limit;
-
-  if (memMax > 0) {
-    const auto memSwapMax = res.memory.swap - memMax;
-    const auto memLow = res.memory.reservation;
-    auto ret = writeConfig({
-        {subCgroupPath("memory.max"), utils::format("%d", memMax)},
-        {subCgroupPath("memory.swap.max"), utils::format("%d", memSwapMax)},
-        {subCgroupPath("memory.low"), utils::format("%d", memLow)},
-    });
-
-    if (!ret) {
-      logErr() << "write memory config failed";
-      return -1;
-    }
-  }
-
-  // config cpu
-  const auto cpuPeriod = res.cpu.period;
-  const auto cpuMax = res.cpu.quota;
-  // convert from [2-262144] to [1-10000], 262144 is 2^18
-  const auto cpuWeight = (1 + ((res.cpu.shares - 2) * 9999) / 262142);
-
-  {
-    auto ret = writeConfig({
-        {subCgroupPath("cpu.max"), utils::format("%d %d", cpuMax, cpuPeriod)},
-        {subCgroupPath("cpu.weight"), utils::format("%d", cpuWeight)},
-    });
-
-    if (!ret) {
-      logErr() << "write cpu config failed";
-      return -1;
-    }
-  }
-
-  // config pid
-  {
-    auto ret = writeConfig({
-        {subCgroupPath("cgroup.procs"), utils::format("%d", initPid)},
-    });
-
-    if (!ret) {
-      logErr() << "write cgroup config failed";
-      return -1;
-    }
-  }
-
-  logDbg() << "move" << initPid << "to new cgroups";
-  return 0;
-}
-
-inline void epoll_ctl_add(int epfd, int fd) {
-  static epoll_event ev = {};
-  ev.events = EPOLLIN;
-  ev.data.fd = fd;
-  int ret = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
-  if (ret != 0) {
-    logWan() << utils::errnoString();
-  }
-}
-
 // if wstatus says child exit normally, return true else false
 static bool parse_wstatus(const int &wstatus, std::string &info) {
   if (WIFEXITED(wstatus)) {
@@ -232,63 +61,175 @@ static bool parse_wstatus(const int &wstatus, std::string &info) {
   return false;
 }
 
-int HookExec(const utils::Hook &hook) {
-  int execPid = fork();
-  if (execPid < 0) {
-    logErr() << "fork failed" << utils::RetErrString(execPid);
-    return -1;
+// How long the container gets to exit after SIGTERM before it is killed.
+constexpr auto kStopGracePeriod = std::chrono::seconds(10);
+
+// Stops loop once pid is reaped, with 0 if it exited normally and -1
+// otherwise.
+static bool stopOnExit(utils::EventLoop &loop, pid_t pid, int pidfd) {
+  return loop.WatchChild(pid, pidfd, [&loop](pid_t child, int wstatus) {
+    std::string info;
+    auto normal = parse_wstatus(wstatus, info);
+    info = utils::format("child [%d] [%s].", child, info.c_str());
+    if (normal) {
+      logDbg() << info;
+    } else {
+      logWan() << info;
+    }
+    loop.Stop(normal ? 0 : -1);
+  });
+}
+
+// The signals every supervisor passes on to the process it supervises, so a
+// signal sent to any of them reaches the container process. SIGTERM is
+// handled by EntryProc.
+static bool forwardSignals(utils::EventLoop &loop, pid_t pid) {
+  return loop.ForwardSignals(
+      {SIGHUP, SIGINT, SIGQUIT, SIGUSR1, SIGUSR2, SIGWINCH}, pid);
+}
+
+// Waits on fds until the parent did what for the calling process, false if
+// it gave up instead.
+static bool waitForParent(std::array<int, 2> &fds, const char *what) {
+  ::close(fds[1]);
+  char done{0};
+  ssize_t ret{-1};
+  do {
+    ret = ::read(fds[0], &done, 1);
+  } while (ret == -1 && errno == EINTR);
+  ::close(fds[0]);
+  fds = {-1, -1};
+  if (ret != 1) {
+    logErr() << "the parent failed to" << what;
+    return false;
+  }
+  return true;
+}
+
+// Runs prepare, if the child waits on fds for it, and lets the child go on
+// if it succeeded. The child gives up otherwise.
+static void releaseChild(std::array<int, 2> &fds,
+                         const std::function<bool()> &prepare) {
+  if (fds[1] == -1) {
+    return;
   }
+  ::close(fds[0]);
+  if (prepare() && ::write(fds[1], "", 1) != 1) {
+    logErr() << "release child failed" << utils::errnoString();
+  }
+  ::close(fds[1]);
+  fds = {-1, -1};
+}
 
-  if (execPid == 0) {
-    utils::str_vec argStrVec;
-    argStrVec.push_back(hook.path);
+// What ll-box init sends the ll-box that started the container once its
+// namespaces exist. Its pid comes along as SCM_CREDENTIALS, which the kernel
+// translates into the pid namespace of the receiver.
+struct namespaceReport {
+  uint64_t userNs;
+  uint64_t mountNs;
+  uint64_t pidNs;
+};
+
+static bool sendNamespaceReport(int fd) {
+  namespaceReport report{};
+  for (const auto &[path, inode] :
+       {std::pair{"/proc/self/ns/user", &report.userNs},
+        std::pair{"/proc/self/ns/mnt", &report.mountNs},
+        std::pair{"/proc/self/ns/pid", &report.pidNs}}) {
+    struct stat st {};
+    if (::stat(path, &st) == -1) {
+      logErr() << "stat" << path << "failed" << utils::errnoString();
+      return false;
+    }
+    *inode = st.st_ino;
+  }
 
-    std::copy(hook.args->begin() + 1, hook.args->end(),
-              std::back_inserter(argStrVec));
+  // the receiver set SO_PASSCRED, the kernel attaches our credentials
+  if (::send(fd, &report, sizeof(report), MSG_NOSIGNAL) != sizeof(report)) {
+    logErr() << "send namespace report failed" << utils::errnoString();
+    return false;
+  }
+  return true;
+}
 
-    utils::Exec(argStrVec, hook.env.value_or(std::vector<std::string>{}));
+static std::optional<std::pair<pid_t, namespaceReport>> receiveNamespaceReport(
+    int fd) {
+  namespaceReport report{};
+  iovec iov{.iov_base = &report, .iov_len = sizeof(report)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(ucred))]{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t ret{-1};
+  do {
+    ret = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (ret == -1 && errno == EINTR);
+  if (ret != sizeof(report)) {
+    logWan() << "container exited before reporting its namespaces";
+    return std::nullopt;
+  }
 
-    exit(0);
+  for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+      ucred credentials{};
+      std::memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+      return std::pair{credentials.pid, report};
+    }
   }
 
-  return waitpid(execPid, nullptr, 0);
+  logWan() << "namespace report without credentials";
+  return std::nullopt;
 }
 
 int Container::NonePrivilegeProc(void *self) {
+  utils::Tracer::setProcess(utils::Tracer::Init, "ll-box init");
+
   // TODO(iceyer): use option
   auto *container = static_cast<Container *>(self);
-  utils::Linux linux;
-  utils::IDMap idMap;
-
-  idMap.containerID = container->hostUid;
-  idMap.hostID = container->hostUid;
-  idMap.size = 1;
-  linux.uidMappings.push_back(idMap);
-
-  idMap.containerID = container->hostGid;
-  idMap.hostID = container->hostGid;
-  idMap.size = 1;
-  linux.gidMappings.push_back(idMap);
-
-  if (auto ret = ConfigUserNamespace(linux, 0); ret != 0) {
-    return ret;
+  if (container->idMapFds[0] != -1) {
+    if (!waitForParent(container->idMapFds, "write the ID maps")) {
+      return -1;
+    }
+  } else {
+    utils::TraceSpan span("WriteIDMaps");
+    auto uid = static_cast<uint64_t>(container->hostUid);
+    auto gid = static_cast<uint64_t>(container->hostGid);
+    if (!WriteIDMaps(0, {{uid, uid, 1}}, {{gid, gid, 1}}, true)) {
+      return -1;
+    }
   }
 
+  utils::TraceSpan mountProcSpan("mount proc");
   auto ret = mount("proc", "/proc", "proc", 0, nullptr);
   if (0 != ret) {
     logErr() << "mount proc failed" << utils::RetErrString(ret);
     return -1;
   }
+  mountProcSpan.end();
 
-  if (container->runtime.hooks.has_value()) {
-    for (auto const &preStart :
-         container->runtime.hooks->prestart.value_or(std::vector<utils::Hook>{})) {
-      HookExec(preStart);
-    }
-    for (auto const &startContainer :
-         container->runtime.hooks->startContainer.value_or(
-             std::vector<utils::Hook>{})) {
-      HookExec(startContainer);
+  if (container->reportFds[1] != -1) {
+    sendNamespaceReport(container->reportFds[1]);
+    ::close(container->reportFds[1]);
+    container->reportFds[1] = -1;
+  }
+
+  auto loop = utils::EventLoop::Create();
+  if (!loop) {
+    return -1;
+  }
+
+  // the container doesn't start if one of these fails
+  if (const auto &hooks = container->runtime.hooks; hooks.has_value()) {
+    const auto none = std::vector<utils::Hook>{};
+    if (!RunHooksAndWait(*loop, "prestart", hooks->prestart.value_or(none),
+                         true) ||
+        !RunHooksAndWait(*loop, "startContainer",
+                         hooks->startContainer.value_or(none), true)) {
+      return -1;
     }
   }
 
@@ -296,16 +237,46 @@ int Container::NonePrivilegeProc(void *self) {
     logErr() << "fork and exec failed";
     return -1;
   }
+  if (container->notifyFds[1] != -1) {
+    ::close(container->notifyFds[1]);
+    container->notifyFds[1] = -1;
+  }
 
-  return utils::WaitAllUntil(container->pidMap.begin()->first);
+  // as pid 1 of its namespace ll-box init also reaps the orphans of the
+  // container, the loop collects them along the way
+  auto processPid = container->pidMap.begin()->first;
+  if (!stopOnExit(*loop, processPid, -1) ||
+      !forwardSignals(*loop, processPid) ||
+      !loop->ForwardSignals({SIGTERM}, processPid)) {
+    return -1;
+  }
+  return loop->Run();
 }
 
-void sigtermHandler(int /*unused*/) { ::exit(EXIT_FAILURE); }
-
 int Container::EntryProc(void *self) {
+  utils::Tracer::setProcess(utils::Tracer::Entry, "ll-box entry");
+
   auto *container = static_cast<Container *>(self);
-  if (auto ret = ConfigUserNamespace(container->runtime.linux, 0); ret != 0) {
-    return ret;
+  for (auto *fd : {&container->reportFds[0], &container->notifyFds[0]}) {
+    if (*fd != -1) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
+  const auto &linux = container->runtime.linux;
+  if (container->joinFds[0] != -1 &&
+      !waitForParent(container->joinFds, "move it into its cgroup")) {
+    return -1;
+  }
+  if (container->idMapFds[0] != -1) {
+    if (!waitForParent(container->idMapFds, "write the ID maps")) {
+      return -1;
+    }
+  } else {
+    utils::TraceSpan span("WriteIDMaps");
+    if (!WriteIDMaps(0, linux.uidMappings, linux.gidMappings, true)) {
+      return -1;
+    }
   }
 
   // FIXME: change HOSTNAME will broken XAUTH
@@ -324,35 +295,72 @@ int Container::EntryProc(void *self) {
   }
 
   container->MountContainerPath();
+  container->MaskCacheDirectory();
 
-  if (container->useNewCgroupNs) {
-    auto ret = ConfigCgroupV2(container->runtime.linux.cgroupsPath,
-                              container->runtime.linux.resources, getpid());
-    if (ret != 0) {
-      logErr() << "config cgroupV2 failed";
-      return -1;
+  {
+    utils::TraceSpan span("PrepareDefaultDevices");
+    if (auto ret = container->PrepareDefaultDevices(); ret == -1) {
+      logWan() << "prepare default devices failed";
     }
   }
 
-  if (auto ret = container->PrepareDefaultDevices(); ret == -1) {
-    logWan() << "prepare default devices failed";
-  }
-
-  if (auto ret = container->PivotRoot(); ret == -1) {
-    logErr() << "pivotRoot failed";
-    return -1;
+  {
+    utils::TraceSpan span("PivotRoot");
+    if (auto ret = container->PivotRoot(); ret == -1) {
+      logErr() << "pivotRoot failed";
+      return -1;
+    }
   }
 
-  if (auto ret = PrepareLinks(); ret == -1) {
-    logWan() << "prepareLinks failed";
-    return -1;
+  {
+    utils::TraceSpan span("PrepareLinks");
+    if (auto ret = PrepareLinks(); ret == -1) {
+      logWan() << "prepareLinks failed";
+      return -1;
+    }
   }
 
   int nonePrivilegeProcFlag =
       SIGCHLD | CLONE_NEWUSER | CLONE_NEWPID | CLONE_NEWNS;
 
-  int noPrivilegePid = utils::PlatformClone(&Container::NonePrivilegeProc,
-                                           nonePrivilegeProcFlag, self);
+  // init can map no more than its own IDs itself. Whenever Start had to
+  // write the maps of the entry process, the IDs of the container are mapped
+  // onto themselves from here instead, while the entry process still has
+  // CAP_SETUID in its namespace.
+  std::vector<utils::IDMap> initUidMaps;
+  std::vector<utils::IDMap> initGidMaps;
+  auto identity = [](const std::vector<utils::IDMap> &maps,
+                     std::vector<utils::IDMap> &out) {
+    for (const auto &map : maps) {
+      out.push_back({map.containerID, map.containerID, map.size});
+    }
+  };
+  if (!SelfMappable(linux.uidMappings, container->hostUid) ||
+      !SelfMappable(linux.gidMappings, container->hostGid)) {
+    identity(linux.uidMappings, initUidMaps);
+    identity(linux.gidMappings, initGidMaps);
+    if (::pipe2(container->idMapFds.data(), O_CLOEXEC) == -1) {
+      logErr() << "pipe failed" << utils::errnoString();
+      return -1;
+    }
+  }
+
+  utils::TraceSpan cloneSpan("clone NonePrivilegeProc");
+  int noPrivilegePidfd{-1};
+  int noPrivilegePid =
+      utils::PlatformClone(&Container::NonePrivilegeProc, nonePrivilegeProcFlag,
+                           self, &noPrivilegePidfd);
+  cloneSpan.end();
+  releaseChild(container->idMapFds, [&] {
+    return noPrivilegePid > 0 &&
+           WriteIDMaps(noPrivilegePid, initUidMaps, initGidMaps, false);
+  });
+  for (auto *fd : {&container->reportFds[1], &container->notifyFds[1]}) {
+    if (*fd != -1) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
   if (noPrivilegePid < 0) {
     logErr() << "clone failed" << utils::RetErrString(noPrivilegePid);
     return -1;
@@ -367,14 +375,40 @@ int Container::EntryProc(void *self) {
 
   // FIXME(interactive bash): if need keep interactive shell
 
-  signal(SIGTERM, sigtermHandler);
-  return utils::WaitAllUntil(noPrivilegePid);
+  auto loop = utils::EventLoop::Create();
+  if (!loop || !stopOnExit(*loop, noPrivilegePid, noPrivilegePidfd) ||
+      !forwardSignals(*loop, noPrivilegePid)) {
+    return -1;
+  }
+
+  // SIGTERM goes on to the container process, which is killed along with its
+  // pid namespace if it is still there after the grace period
+  int killTimer{-1};
+  loop->WatchSignal(SIGTERM, [&](const signalfd_siginfo & /*unused*/) {
+    loop->Signal(noPrivilegePid, SIGTERM);
+    if (killTimer != -1) {
+      return;
+    }
+    killTimer = loop->AddTimer(kStopGracePeriod, [&] {
+      logWan() << "container didn't stop in time, killing it";
+      loop->Signal(noPrivilegePid, SIGKILL);
+    });
+  });
+
+  ret = loop->Run();
+  loop.reset();
+  if (noPrivilegePidfd != -1) {
+    ::close(noPrivilegePidfd);
+  }
+  return ret;
 }
 
-Container::Container(std::filesystem::path bundle, std::string id,
+Container::Container(std::filesystem::path bundle,
+                     std::filesystem::path config, std::string id,
                      utils::Runtime runtime)
     : runtime(std::move(runtime)),
       bundle(std::move(bundle)),
+      config(std::move(config)),
       id(std::move(id)),
       hostRoot([this] {  // FIXME: redesign this class
         if (this->runtime.root.path.front() != '/') {
@@ -474,81 +508,7 @@ int Container::PrepareDefaultDevices() {
   return 0;
 }
 
-void Container::waitChildAndExec() {
-  sigset_t mask;
-  sigemptyset(&mask);
-  sigaddset(&mask, SIGCHLD);
-  sigaddset(&mask, SIGTERM);
-  // FIXME: add more signals.
-
-  /* Block signals so that they aren't handled
-     according to their default dispositions. */
-
-  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
-    logWan() << "sigprocmask block";
-
-  int sfd = signalfd(-1, &mask, 0);
-  if (sfd == -1) logWan() << "signalfd";
-
-  auto epfd = epoll_create(1);
-  epoll_ctl_add(epfd, sfd);
-
-  for (;;) {
-    struct epoll_event events[10];
-    int event_cnt = epoll_wait(epfd, events, 5, -1);
-    for (int i = 0; i < event_cnt; i++) {
-      const auto &event = events[i];
-      if (event.data.fd == sfd) {
-        struct signalfd_siginfo fdsi;
-        ssize_t s = read(sfd, &fdsi, sizeof(fdsi));
-        if (s != sizeof(fdsi)) {
-          logWan() << "error read from signal fd";
-        }
-        if (fdsi.ssi_signo == SIGCHLD) {
-          logWan() << "recive SIGCHLD";
-
-          int wstatus;
-          while (int child = waitpid(-1, &wstatus, WNOHANG)) {
-            if (child > 0) {
-              std::string info;
-              auto normal = parse_wstatus(wstatus, info);
-              info = utils::format("child [%d] [%s].", child, info.c_str());
-              if (normal) {
-                logDbg() << info;
-              } else {
-                logWan() << info;
-              }
-              auto it = pidMap.find(child);
-              if (it != pidMap.end()) {
-                pidMap.erase(it);
-              }
-            } else if (child < 0) {
-              if (errno == ECHILD) {
-                logDbg() << utils::format("no child to wait");
-                return;
-              } else {
-                auto str = utils::errnoString();
-                logErr() << utils::format("waitpid failed, %s", str.c_str());
-                return;
-              }
-            }
-          }
-        } else if (fdsi.ssi_signo == SIGTERM) {
-          // FIXME: box should exit with failed return code.
-          logWan() << utils::format("Terminated\n");
-          return;
-        } else {
-          logWan() << utils::format("Read unexpected signal [%d]\n",
-                                   fdsi.ssi_signo);
-        }
-      } else {
-        logWan() << "Unknown fd";
-      }
-    }
-  }
-}
-
-bool Container::forkAndExecProcess(const utils::Process &process, bool unblock) {
+bool Container::forkAndExecProcess(const utils::Process &process) {
   // FIXME: parent may dead before this return.
   if (auto ret = prctl(PR_SET_PDEATHSIG, SIGKILL); ret == -1) {
     logErr() << "couldn't manipulate current process"
@@ -556,6 +516,7 @@ bool Container::forkAndExecProcess(const utils::Process &process, bool unblock)
     return false;
   }
 
+  utils::TraceSpan span("forkAndExecProcess");
   int pid = fork();
   if (pid < 0) {
     logErr() << "fork failed" << utils::RetErrString(pid);
@@ -563,14 +524,16 @@ bool Container::forkAndExecProcess(const utils::Process &process, bool unblock)
   }
 
   if (0 == pid) {
-    if (unblock) {
-      // FIXME: As we use signalfd, we have to block signal, but child created
-      // by fork will inherit blocked signal set, so we have to unblock it. This
-      // is just a workaround.
-      sigset_t mask;
-      sigfillset(&mask);
-      if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1)
-        logWan() << "sigprocmask unblock";
+    utils::Tracer::setProcess(utils::Tracer::Container, "container process");
+    utils::TraceSpan execSpan("exec");
+    execSpan.arg("args", process.args);
+
+    // the event loop of ll-box init blocked the signals it watches, SIGCHLD
+    // among them once hooks ran, the application starts with none blocked
+    sigset_t empty;
+    sigemptyset(&empty);
+    if (::sigprocmask(SIG_SETMASK, &empty, nullptr) == -1) {
+      logWan() << "sigprocmask failed" << utils::errnoString();
     }
     logDbg() << "process.args:" << process.args;
 
@@ -592,6 +555,21 @@ bool Container::forkAndExecProcess(const utils::Process &process, bool unblock)
     }
 
     logInf() << "start exec process";
+    // execve never returns on success, the span must be written beforehand.
+    execSpan.end();
+    int listener{-1};
+    if (LoadSeccomp(seccompProgram,
+                    notifyFds[1] != -1 ? &listener : nullptr) != 0) {
+      logErr() << "load seccomp profile failed";
+      exit(EXIT_FAILURE);
+    }
+    if (listener != -1) {
+      if (!utils::SendFd(notifyFds[1], listener)) {
+        logErr() << "pass seccomp listener failed" << utils::errnoString();
+        exit(EXIT_FAILURE);
+      }
+      ::close(listener);
+    }
     if (auto ret = utils::Exec(process.args, process.env); ret != 0) {
       logErr() << "exec failed" << utils::RetErrString(ret);
       exit(ret);
@@ -604,7 +582,10 @@ bool Container::forkAndExecProcess(const utils::Process &process, bool unblock)
 }
 
 int Container::PivotRoot() const {
-  containerMounter.finalizeMounts();
+  {
+    utils::TraceSpan span("HostMount::finalizeMounts");
+    containerMounter.finalizeMounts();
+  }
 
   int ret = -1;
   ret = chdir(hostRoot.c_str());
@@ -664,26 +645,104 @@ int Container::PivotRoot() const {
 }
 
 int Container::MountContainerPath() {
-  if (runtime.mounts.has_value()) {
-    for (auto &mount : runtime.mounts.value()) {
-      // complete source path
-      if (!mount.source.empty() && mount.source.at(0) != '/') {
-        mount.source = (bundle / mount.source).string();
-      }
-      logDbg() << "mount" << mount.source << "to" << mount.destination;
-      if (!containerMounter.MountNode(mount)) {
+  utils::TraceSpan span("MountContainerPath");
+  if (!runtime.mounts.has_value()) {
+    return 0;
+  }
+
+  auto &mounts = runtime.mounts.value();
+  for (auto &mount : mounts) {
+    // complete source path
+    if (!mount.source.empty() && mount.source.at(0) != '/') {
+      mount.source = (bundle / mount.source).string();
+    }
+  }
+
+  // every decision is taken before the first mount, so the destinations can
+  // be created in one go. The decisions of the last launch of this config
+  // are replayed while none of the sources changed.
+  auto key = MountPlan::Key(bundle, hostRoot, mounts);
+  auto planFile = MountPlan::File(cacheDir, key);
+  auto plan = MountPlan::Load(planFile, key);
+  if (plan) {
+    span.arg("plan", "cached");
+  } else {
+    span.arg("plan", "compiled");
+    plan.emplace();
+    bool complete{true};
+    for (const auto &mount : mounts) {
+      auto op = HostMount::Compile(mount);
+      if (!op) {
+        // don't cache a plan that silently drops this mount
+        complete = false;
         logWan() << "failed to Mount:" << mount.source << "to"
                  << mount.destination;
+        continue;
       }
+      plan->Add(std::move(*op));
     }
-  };
+
+    std::error_code ec;
+    if (complete && std::filesystem::is_directory(cacheDir, ec) &&
+        plan->Save(planFile, key)) {
+      utils::pruneCacheDirectory(cacheDir);
+    }
+  }
+  const auto &ops = plan->Ops();
+
+  containerMounter.PrepareDestinations(ops);
+
+  for (const auto &op : ops) {
+    utils::TraceSpan mountSpan("MountNode");
+    mountSpan.arg("source", op.mount.source)
+        .arg("destination", op.mount.destination)
+        .arg("type", op.mount.type);
+    logDbg() << "mount" << op.mount.source << "to" << op.mount.destination;
+    if (!containerMounter.Apply(op)) {
+      logWan() << "failed to Mount:" << op.mount.source << "to"
+               << op.mount.destination;
+    }
+  }
 
   return 0;
 }
 
-int Container::Start() {
+void Container::MaskCacheDirectory() const {
+  if (!runtime.mounts.has_value()) {
+    return;
+  }
+
+  // the sources were completed by MountContainerPath
+  for (const auto &mount : *runtime.mounts) {
+    if (mount.fsType != utils::Mount::Bind || mount.source.empty()) {
+      continue;
+    }
+    auto relative = cacheDir.lexically_relative(mount.source);
+    if (relative.empty() || *relative.begin() == "..") {
+      continue;
+    }
+
+    // mounts made here are locked in the namespaces of the container, which
+    // can't unmount them to get at what is underneath
+    auto destination = std::filesystem::path(mount.destination);
+    auto target =
+        (hostRoot / destination.relative_path() / relative).lexically_normal();
+    std::error_code ec;
+    if (!std::filesystem::is_directory(target, ec)) {
+      continue;
+    }
+    if (::mount("tmpfs", target.c_str(), "tmpfs",
+                MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC,
+                "size=4k,mode=0500") != 0) {
+      logWan() << "mask" << target << "failed" << utils::errnoString();
+    }
+  }
+}
+
+int Container::Start(const std::function<void(pid_t)> &started) {
   hostUid = static_cast<int>(::geteuid());
   hostGid = static_cast<int>(::getegid());
+  cacheDir = utils::cacheDirectory();
   int flags = SIGCHLD | CLONE_NEWNS;
 
   for (auto const &n : runtime.linux.namespaces) {
@@ -693,14 +752,12 @@ int Container::Start() {
       case CLONE_NEWNS:
       case CLONE_NEWPID:
       case CLONE_NEWNET:
+      case CLONE_NEWCGROUP:
         flags |= n.type;
         break;
       case CLONE_NEWUSER:
         //            dd_ptr->use_delay_new_user_ns = true;
         break;
-      case CLONE_NEWCGROUP:
-        useNewCgroupNs = true;
-        break;
       default:
         return -1;
     }
@@ -708,9 +765,158 @@ int Container::Start() {
 
   flags |= CLONE_NEWUSER;
 
-  int entryPid = utils::PlatformClone(EntryProc, flags, this);
+  // maps beyond the own IDs are written from here once the entry process
+  // exists, directly as root and through newuidmap otherwise. The entry
+  // process waits for them on idMapFds.
+  const auto &uidMaps = runtime.linux.uidMappings;
+  const auto &gidMaps = runtime.linux.gidMappings;
+  auto parentMaps =
+      !SelfMappable(uidMaps, hostUid) || !SelfMappable(gidMaps, hostGid);
+  if (parentMaps && hostUid != 0 && !HasSubordinateIDs(hostUid)) {
+    logErr() << "mapping more than the own IDs needs subordinate IDs for"
+             << hostUid << "in /etc/subuid and /etc/subgid";
+    return -1;
+  }
+
+  // compiled here, where the host's cache directory is visible, and installed
+  // by the container process right before exec
+  if (runtime.linux.seccomp.has_value() &&
+      CompileSeccomp(*runtime.linux.seccomp, seccompProgram) != 0) {
+    logErr() << "compile seccomp profile failed";
+    return -1;
+  }
+
+  // the leaf is created before the clone so the container starts in it, and
+  // removed once the container is gone
+  std::unique_ptr<CgroupManager> cgroup;
+  if (!runtime.linux.cgroupsPath.empty()) {
+    utils::TraceSpan span("cgroup");
+    cgroup = CgroupManager::Create(runtime.linux.cgroupsPath, id);
+    if (!cgroup || !cgroup->Apply(runtime.linux.resources)) {
+      logErr() << "set up cgroup of container" << id << "failed";
+      return -1;
+    }
+  }
+
+  auto loop = utils::EventLoop::Create();
+  if (!loop) {
+    logErr() << "couldn't supervise container" << id;
+    return -1;
+  }
+
+  // the state is filled in once the container is cloned, the stalls are
+  // counted there for `ll-box stats`
+  auto states = StateTable::Open();
+  ContainerState state;
+  auto recorded = false;
+
+  // the triggers are armed before the clone, the container doesn't run
+  // without the ones it asked for
+  std::optional<PressureMonitor> pressure;
+  if (const auto &triggers = runtime.linux.resources.pressureTriggers;
+      !triggers.empty()) {
+    if (!cgroup) {
+      logErr() << "pressure triggers need linux.cgroupsPath";
+      return -1;
+    }
+    pressure.emplace(*loop, *cgroup, [&](const utils::PressureTrigger &) {
+      if (!recorded) {
+        return;
+      }
+      ++state.stalls;
+      state.lastStall = static_cast<uint64_t>(::time(nullptr));
+      states->Put(state);
+    });
+    for (const auto &trigger : triggers) {
+      if (!pressure->Watch(trigger)) {
+        logErr() << "couldn't arm the pressure triggers of" << id;
+        return -1;
+      }
+    }
+  }
+
+  if (parentMaps && ::pipe2(idMapFds.data(), O_CLOEXEC) == -1) {
+    logErr() << "pipe failed" << utils::errnoString();
+    return -1;
+  }
+
+  if (runtime.linux.seccomp.has_value() &&
+      SeccompNotifies(*runtime.linux.seccomp) &&
+      ::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+                   notifyFds.data()) == -1) {
+    logErr() << "socketpair failed" << utils::errnoString();
+    releaseChild(idMapFds, [] { return false; });
+    return -1;
+  }
+
+  // ll-box init reports its namespaces through this pair, so exec can find
+  // them without walking /proc
+  if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+                   reportFds.data()) == -1) {
+    logWan() << "socketpair failed" << utils::errnoString();
+    reportFds = {-1, -1};
+  } else if (int on = 1; ::setsockopt(reportFds[0], SOL_SOCKET, SO_PASSCRED,
+                                      &on, sizeof(on)) == -1) {
+    logWan() << "setsockopt SO_PASSCRED failed" << utils::errnoString();
+    ::close(reportFds[0]);
+    ::close(reportFds[1]);
+    reportFds = {-1, -1};
+  }
+
+  utils::TraceSpan cloneSpan("clone EntryProc");
+  int entryPidfd{-1};
+  int entryPid = utils::PlatformClone(EntryProc, flags, this, &entryPidfd,
+                                      cgroup ? cgroup->Fd() : -1);
+  if (entryPid < 0 && cgroup &&
+      (errno == EINVAL || errno == ENOSYS || errno == E2BIG)) {
+    // CLONE_INTO_CGROUP needs linux 5.7, join the leaf right after the clone
+    // instead. The entry process waits on joinFds until it is inside, so
+    // nothing it starts runs outside.
+    logDbg() << "clone into cgroup failed" << utils::errnoString();
+    if (::pipe2(joinFds.data(), O_CLOEXEC) == -1) {
+      logErr() << "pipe failed" << utils::errnoString();
+    } else {
+      entryPid = utils::PlatformClone(EntryProc, flags, this, &entryPidfd);
+      auto joined = false;
+      releaseChild(joinFds, [&] {
+        joined = entryPid > 0 && cgroup->Join(entryPid);
+        return joined;
+      });
+      if (entryPid > 0 && !joined) {
+        logErr() << "move container" << id << "into" << cgroup->Path()
+                 << "failed";
+        utils::WaitProcess(entryPid, entryPidfd);
+        if (entryPidfd != -1) {
+          ::close(entryPidfd);
+          entryPidfd = -1;
+        }
+        entryPid = -1;
+      }
+    }
+  }
+  cloneSpan.end();
+  releaseChild(idMapFds, [&] {
+    if (entryPid < 0) {
+      return false;
+    }
+    utils::TraceSpan span("WriteIDMaps");
+    return hostUid == 0 ? WriteIDMaps(entryPid, uidMaps, gidMaps, false)
+                        : RunIDMapHelpers(entryPid, uidMaps, gidMaps);
+  });
+  for (auto *fd : {&reportFds[1], &notifyFds[1]}) {
+    if (*fd != -1) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
   if (entryPid < 0) {
     logErr() << "clone failed" << utils::RetErrString(entryPid);
+    for (auto *fd : {&reportFds[0], &notifyFds[0]}) {
+      if (*fd != -1) {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
     return -1;
   }
 
@@ -723,15 +929,133 @@ int Container::Start() {
   // FIXME: parent may dead before this return.
   prctl(PR_SET_PDEATHSIG, SIGKILL);
 
-  writeContainerJson(this->bundle, this->id, entryPid);
+  state = ContainerState{
+      .id = this->id,
+      .bundle = this->bundle.string(),
+      .pid = entryPid,
+      .startTime = utils::ProcessStartTime(entryPid).value_or(0),
+      .cgroup = cgroup ? cgroup->Path() : "",
+      .config = config.string(),
+      .seccomp =
+          seccompProgram.empty() ? 0 : SeccompProgramHash(seccompProgram),
+  };
+  recorded = states && states->Put(state);
+  if (!recorded) {
+    logWan() << "container" << this->id << "is not recorded";
+  }
+  if (started) {
+    started(entryPid);
+  }
 
-  // FIXME(interactive bash): if need keep interactive shell
-  auto ret = utils::WaitAllUntil(entryPid);
+  int ret{-1};
+  int listener{-1};
+  if (stopOnExit(*loop, entryPid, entryPidfd) &&
+      forwardSignals(*loop, entryPid) &&
+      loop->ForwardSignals({SIGTERM}, entryPid)) {
+    auto receiveReport = [&](uint32_t /*unused*/) {
+      auto report = receiveNamespaceReport(reportFds[0]);
+      loop->UnwatchFd(reportFds[0]);
+      ::close(reportFds[0]);
+      reportFds[0] = -1;
+      if (report && recorded) {
+        state.initPid = report->first;
+        state.userNs = report->second.userNs;
+        state.mountNs = report->second.mountNs;
+        state.pidNs = report->second.pidNs;
+        states->Put(state);
+      }
+    };
+    if (reportFds[0] != -1) {
+      loop->WatchFd(reportFds[0], EPOLLIN, receiveReport);
+    }
+
+    SeccompNotifier notifier;
+    // ll-box shares the host's UTS namespace (see EntryProc), so setting the
+    // hostname is accepted and ignored
+    for (const auto *name : {"sethostname", "setdomainname"}) {
+      notifier.On(name, [](const seccomp_notif & /*unused*/) {
+        return NotifyResponse::Return(0);
+      });
+    }
+    auto answer = [&](uint32_t events) {
+      if ((events & EPOLLIN) != 0 && notifier.Handle(listener)) {
+        return;
+      }
+      // every process using the filter is gone
+      loop->UnwatchFd(listener);
+      ::close(listener);
+      listener = -1;
+    };
+    auto receiveListener = [&](uint32_t /*unused*/) {
+      auto fd = utils::ReceiveFd(notifyFds[0]);
+      loop->UnwatchFd(notifyFds[0]);
+      ::close(notifyFds[0]);
+      notifyFds[0] = -1;
+      if (fd >= 0 && loop->WatchFd(fd, EPOLLIN, answer)) {
+        listener = fd;
+      } else if (fd >= 0) {
+        ::close(fd);
+      }
+    };
+    if (notifyFds[0] != -1) {
+      loop->WatchFd(notifyFds[0], EPOLLIN, receiveListener);
+    }
+
+    // ll-box run creates and starts the container in one go, so poststart
+    // hooks run next to it from here rather than holding it back
+    const auto &hooks = runtime.hooks;
+    HooksCancel cancelPoststart;
+    auto poststartRunning = false;
+    auto reapPoststart = false;
+    if (hooks.has_value() && hooks->poststart.has_value()) {
+      poststartRunning = true;
+      auto done = [&](bool /*ok*/) {
+        poststartRunning = false;
+        if (reapPoststart) {
+          loop->Stop(0);
+        }
+      };
+      cancelPoststart =
+          RunHooks(*loop, "poststart", *hooks->poststart, false, done);
+    }
+
+    // FIXME(interactive bash): if need keep interactive shell
+    ret = loop->Run();
+
+    // the container is gone, so instead of being forwarded to it a stop
+    // signal kills the poststop hooks
+    if (hooks.has_value() && hooks->poststop.has_value()) {
+      RunHooksAndWait(*loop, "poststop", *hooks->poststop, false,
+                      {SIGHUP, SIGINT, SIGQUIT, SIGTERM});
+    }
+
+    // poststart hooks don't outlive the container, they are killed and
+    // reaped while there is still a loop to reap them
+    if (poststartRunning) {
+      reapPoststart = true;
+      cancelPoststart();
+      loop->Run();
+    }
+  } else {
+    logErr() << "couldn't supervise container" << this->id << ", killing it";
+    ::kill(entryPid, SIGKILL);
+    utils::WaitProcess(entryPid, entryPidfd);
+  }
+  pressure.reset();
+  loop.reset();
+
+  for (auto *fd : {&reportFds[0], &notifyFds[0], &listener}) {
+    if (*fd != -1) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
+  if (entryPidfd != -1) {
+    ::close(entryPidfd);
+  }
 
-  auto dir = std::filesystem::path("/run") / "user" / std::to_string(getuid()) /
-             "linglong" / "box";
-  if (!std::filesystem::remove(dir / (this->id + ".json"))) {
-    logErr() << "remove" << dir / (this->id + ".json") << "failed";
+  if (recorded && !states->Remove(this->id, entryPid)) {
+    logWan() << "container" << this->id << "was already removed";
   }
 
   return ret;
@@ -7,6 +7,12 @@
 #ifndef LINGLONG_BOX_SRC_CONTAINER_CONTAINER_H_
 #define LINGLONG_BOX_SRC_CONTAINER_CONTAINER_H_
 
+#include <linux/filter.h>
+
+#include <array>
+#include <functional>
+#include <vector>
+
 #include "linglong/container/host_mount.h"
 #include "linglong/utils/oci_runtime.h"
 
@@ -14,33 +20,56 @@ namespace linglong::container {
 
 class Container {
  public:
-  Container(std::filesystem::path bundle, std::string id, utils::Runtime runtime);
+  // config is the file runtime was read from, recorded for exec.
+  Container(std::filesystem::path bundle, std::filesystem::path config,
+            std::string id, utils::Runtime runtime);
 
   ~Container();
 
-  int Start();
+  // started, if set, is called with the pid of the entry process once the
+  // container has been cloned.
+  int Start(const std::function<void(pid_t)> &started = nullptr);
 
  private:
   [[nodiscard]] static int DropPermissions();
   [[nodiscard]] static int PrepareLinks();
   [[nodiscard]] int PrepareDefaultDevices();
-  [[nodiscard]] bool forkAndExecProcess(const utils::Process &process,
-                                        bool unblock = false);
+  [[nodiscard]] bool forkAndExecProcess(const utils::Process &process);
   [[nodiscard]] int PivotRoot() const;
   int MountContainerPath();
-  void waitChildAndExec();
+  // Covers utils::cacheDirectory() wherever a bind mount exposes it in the
+  // container, so the container can't plant entries ll-box trusts.
+  void MaskCacheDirectory() const;
 
   static int NonePrivilegeProc(void *self);
   static int EntryProc(void *self);
 
   utils::Runtime runtime;
   std::filesystem::path bundle;
+  std::filesystem::path config;
   std::string id;
   std::filesystem::path hostRoot;
 
   int hostUid{-1};
   int hostGid{-1};
-  bool useNewCgroupNs{false};
+  // utils::cacheDirectory() of the caller, the uid in the container may
+  // differ
+  std::filesystem::path cacheDir;
+  // the socket pair ll-box init reports its namespaces through, the first
+  // end stays with Start
+  std::array<int, 2> reportFds{-1, -1};
+  // linux.seccomp compiled to BPF, empty without a profile
+  std::vector<sock_filter> seccompProgram;
+  // with SCMP_ACT_NOTIFY rules, the container process passes the listener of
+  // its filter back to Start through this pair
+  std::array<int, 2> notifyFds{-1, -1};
+  // when ID maps are written by the parent, the child waits on this pipe
+  // until they are there: the entry process for Start, init for the entry
+  // process
+  std::array<int, 2> idMapFds{-1, -1};
+  // when the entry process couldn't be cloned into its cgroup, it waits on
+  // this pipe until Start moved it there
+  std::array<int, 2> joinFds{-1, -1};
   std::map<int, std::string> pidMap;
 
   HostMount containerMounter;
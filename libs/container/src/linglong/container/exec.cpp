@@ -0,0 +1,256 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/exec.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <tuple>
+
+#include "linglong/container/seccomp_p.h"
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+#include "linglong/utils/runtime_cache.h"
+
+extern char **environ;
+
+namespace linglong::container {
+
+namespace {
+
+// a command that can't be executed, as shells report it
+constexpr int kExecFailed = 127;
+
+int exitCode(int wstatus) noexcept {
+  if (WIFEXITED(wstatus)) {
+    return WEXITSTATUS(wstatus);
+  }
+  if (WIFSIGNALED(wstatus)) {
+    return 128 + WTERMSIG(wstatus);
+  }
+  return -1;
+}
+
+int waitChild(pid_t pid) noexcept {
+  int wstatus{0};
+  while (::waitpid(pid, &wstatus, 0) == -1) {
+    if (errno != EINTR) {
+      logErr() << "waitpid failed" << utils::errnoString();
+      return -1;
+    }
+  }
+  return exitCode(wstatus);
+}
+
+// Joins the namespaces one at a time, the user namespace first since it
+// grants the capabilities needed to join the others.
+bool enterByProc(const ContainerState &state) noexcept {
+  auto proc = "/proc/" + std::to_string(state.initPid) + "/ns/";
+  for (const auto &[name, type, inode] :
+       {std::tuple{"user", CLONE_NEWUSER, state.userNs},
+        std::tuple{"mnt", CLONE_NEWNS, state.mountNs},
+        std::tuple{"pid", CLONE_NEWPID, state.pidNs}}) {
+    auto path = proc + name;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      logErr() << "open" << path << "failed" << utils::errnoString();
+      return false;
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) == -1 || st.st_ino != inode) {
+      logErr() << name << "namespace of container" << state.id << "changed";
+      ::close(fd);
+      return false;
+    }
+
+    auto ret = ::setns(fd, type);
+    ::close(fd);
+    if (ret == -1) {
+      logErr() << "setns" << name << "failed" << utils::errnoString();
+      return false;
+    }
+  }
+  return true;
+}
+
+// The filter the container was started with, compiled again from its config.
+// A config whose profile changed since is refused, exec must not run a
+// command under another filter than the container's.
+bool containerSeccomp(const ContainerState &state,
+                      std::vector<sock_filter> &program) noexcept try {
+  if (state.seccomp == 0) {
+    return true;
+  }
+
+  std::ifstream stream{state.config};
+  if (!stream.is_open()) {
+    logErr() << "failed to open config" << state.config;
+    return false;
+  }
+  std::string content((std::istreambuf_iterator<char>(stream)),
+                      std::istreambuf_iterator<char>());
+  auto runtime = utils::runtimeFromConfig(content);
+  if (!runtime.linux.seccomp.has_value() ||
+      CompileSeccomp(*runtime.linux.seccomp, program) != 0 ||
+      SeccompProgramHash(program) != state.seccomp) {
+    logErr() << "seccomp profile of container" << state.id
+             << "changed since it started";
+    return false;
+  }
+  return true;
+} catch (const std::exception &e) {
+  logErr() << "failed to read config" << state.config << e.what();
+  return false;
+}
+
+// cgroupProcs is cgroup.procs of the container's leaf, or -1 if it has none.
+[[noreturn]] void runCommand(int cgroupProcs,
+                             const std::vector<sock_filter> &seccompProgram,
+                             const ExecOptions &options) noexcept {
+  // "0" is the writer, what the command forks later is born in there
+  if (cgroupProcs != -1 && ::write(cgroupProcs, "0", 1) == -1) {
+    logErr() << "join the cgroup of the container failed"
+             << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+
+  if (::chdir(options.cwd.c_str()) == -1) {
+    logErr() << "chdir to" << options.cwd << "failed" << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+  if (options.gid && ::setgid(*options.gid) == -1) {
+    logErr() << "setgid" << *options.gid << "failed" << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+  if (options.uid && ::setuid(*options.uid) == -1) {
+    logErr() << "setuid" << *options.uid << "failed" << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+
+  std::vector<std::string> env;
+  for (auto *entry = environ; *entry != nullptr; ++entry) {  // NOLINT
+    env.emplace_back(*entry);
+  }
+  // without a listener, syscalls the profile hands to a supervisor fail with
+  // ENOSYS
+  if (LoadSeccomp(seccompProgram) != 0) {
+    logErr() << "load seccomp profile failed";
+    ::_exit(EXIT_FAILURE);
+  }
+  utils::Exec(options.args, env);
+  logErr() << "execvpe" << options.args[0] << "failed" << utils::errnoString();
+  ::_exit(kExecFailed);
+}
+
+// setns wants a single threaded caller, so this runs in a child of
+// ExecInContainer, where the async log backend may have started a thread.
+[[noreturn]] void enterAndRun(const ContainerState &state, int pidfd,
+                              int cgroupProcs,
+                              const std::vector<sock_filter> &seccompProgram,
+                              const ExecOptions &options) noexcept {
+  bool entered{false};
+  if (pidfd != -1) {
+    if (::setns(pidfd, CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWPID) == 0) {
+      entered = true;
+    } else if (errno != EINVAL) {
+      logErr() << "setns failed" << utils::errnoString();
+      ::_exit(EXIT_FAILURE);
+    }
+    // before linux 5.8 setns only takes namespace fds
+  }
+  if (!entered && !enterByProc(state)) {
+    ::_exit(EXIT_FAILURE);
+  }
+
+  // only children are born into the pid namespace
+  auto pid = ::fork();
+  if (pid == -1) {
+    logErr() << "fork failed" << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    runCommand(cgroupProcs, seccompProgram, options);
+  }
+
+  auto code = waitChild(pid);
+  ::_exit(code < 0 ? EXIT_FAILURE : code);
+}
+
+}  // namespace
+
+int ExecInContainer(const ContainerState &state,
+                    const ExecOptions &options) noexcept {
+  if (options.args.empty()) {
+    logErr() << "no command to execute";
+    return -1;
+  }
+  if (state.initPid <= 0) {
+    logErr() << "container" << state.id << "hasn't finished starting";
+    return -1;
+  }
+
+  // compiled here, where the host's cache directory is visible
+  std::vector<sock_filter> seccompProgram;
+  if (!containerSeccomp(state, seccompProgram)) {
+    return -1;
+  }
+
+  // The pidfd pins the process, checking the namespaces after opening it
+  // makes sure it refers to ll-box init and not to a process that reused its
+  // pid. Without pidfds, enterByProc checks the namespace fds it opens.
+  int pidfd = utils::PidfdOpen(state.initPid);
+  if (!state.NamespacesAlive()) {
+    logErr() << "namespaces of container" << state.id << "are gone";
+    if (pidfd != -1) {
+      ::close(pidfd);
+    }
+    return -1;
+  }
+
+  // the path is on the host, it is opened before entering the mount
+  // namespace
+  int cgroupProcs{-1};
+  if (!state.cgroup.empty()) {
+    auto procs = state.cgroup + "/cgroup.procs";
+    cgroupProcs = ::open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+    if (cgroupProcs == -1) {
+      logErr() << "open" << procs << "failed" << utils::errnoString();
+      if (pidfd != -1) {
+        ::close(pidfd);
+      }
+      return -1;
+    }
+  }
+
+  utils::flushLogs();
+  auto worker = ::fork();
+  if (worker == 0) {
+    enterAndRun(state, pidfd, cgroupProcs, seccompProgram, options);
+  }
+  if (pidfd != -1) {
+    ::close(pidfd);
+  }
+  if (cgroupProcs != -1) {
+    ::close(cgroupProcs);
+  }
+  if (worker == -1) {
+    logErr() << "fork failed" << utils::errnoString();
+    return -1;
+  }
+
+  return waitChild(worker);
+}
+
+}  // namespace linglong::container
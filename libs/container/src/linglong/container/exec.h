@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_EXEC_H_
+#define LINGLONG_BOX_SRC_CONTAINER_EXEC_H_
+
+#include <sys/types.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "linglong/container/state_table.h"
+
+namespace linglong::container {
+
+struct ExecOptions {
+  std::vector<std::string> args;
+  // the credentials of the command inside the container, the caller's are
+  // kept when unset
+  std::optional<uid_t> uid;
+  std::optional<gid_t> gid;
+  std::string cwd{"/"};
+};
+
+// Runs a command in the user, mount and pid namespaces of a running
+// container, what `nsenter -t <init> -U -m -p --preserve-credentials` did.
+// The namespaces are those recorded for ll-box init in state, they are
+// entered through one setns on a pidfd (linux 5.8) or else one by one through
+// /proc/<init>/ns, after checking their inodes. The command joins the cgroup
+// leaf recorded in state, so it is counted against the container's limits,
+// and runs under the seccomp filter of the container. Nothing serves the
+// notifications of that filter for it, syscalls the profile hands to a
+// supervisor fail with ENOSYS.
+//
+// Returns the exit code of the command, 128 + the signal if it was killed, or
+// -1 if it couldn't be started.
+int ExecInContainer(const ContainerState &state,
+                    const ExecOptions &options) noexcept;
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_EXEC_H_ */
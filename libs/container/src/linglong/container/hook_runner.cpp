@@ -0,0 +1,210 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/hook_runner.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+#include "linglong/utils/trace.h"
+
+namespace linglong::container {
+
+namespace {
+
+// Forks and execs hook, -1 if fork failed.
+pid_t spawn(const utils::Hook &hook) noexcept {
+  auto pid = ::fork();
+  if (pid != 0) {
+    return pid;
+  }
+
+  // the loop blocked the signals it watches
+  sigset_t empty;
+  sigemptyset(&empty);
+  ::sigprocmask(SIG_SETMASK, &empty, nullptr);
+
+  // args starts with argv[0], which is replaced by the path
+  utils::str_vec args{hook.path};
+  if (hook.args && hook.args->size() > 1) {
+    std::copy(hook.args->begin() + 1, hook.args->end(),
+              std::back_inserter(args));
+  }
+  utils::Exec(args, hook.env.value_or(std::vector<std::string>{}));
+  ::_exit(127);
+}
+
+// The hooks of one phase. Owned by the handlers of the hooks still running,
+// so it lives exactly as long as there is something left to wait for.
+struct hookPhase : std::enable_shared_from_this<hookPhase> {
+  hookPhase(utils::EventLoop &loop, std::string name,
+            std::vector<utils::Hook> hooks, bool failFast, HooksDone onDone)
+      : loop(loop),
+        name(std::move(name)),
+        hooks(std::move(hooks)),
+        failFast(failFast),
+        onDone(std::move(onDone)) {}
+
+  void advance() noexcept;
+  bool start(const utils::Hook &hook) noexcept;
+  void finished(pid_t pid, const std::string &path, int wstatus) noexcept;
+  void kill() noexcept;
+
+  utils::EventLoop &loop;
+  std::string name;
+  std::vector<utils::Hook> hooks;
+  bool failFast;
+  HooksDone onDone;
+  size_t next{0};
+  std::vector<pid_t> running;
+  bool ok{true};
+};
+
+// Starts hooks until one of them has to wait for those running, and reports
+// the phase done once nothing is left.
+void hookPhase::advance() noexcept {
+  while (next < hooks.size() && (ok || !failFast)) {
+    const auto &hook = hooks[next];
+    if (!running.empty() &&
+        !(hook.independent && hooks[next - 1].independent)) {
+      break;
+    }
+    ++next;
+    if (!start(hook)) {
+      ok = false;
+    }
+  }
+
+  if (!running.empty() || (next < hooks.size() && (ok || !failFast))) {
+    return;
+  }
+  auto done = std::move(onDone);
+  onDone = nullptr;
+  if (done) {
+    done(ok);
+  }
+}
+
+bool hookPhase::start(const utils::Hook &hook) noexcept {
+  logDbg() << "run" << name << "hook" << hook.path;
+  auto pid = spawn(hook);
+  if (pid == -1) {
+    logErr() << "fork failed" << utils::errnoString();
+    return false;
+  }
+
+  int pidfd = utils::PidfdOpen(pid);
+  // the timer id, -1 once it fired or if there is none
+  auto timer = std::make_shared<int>(-1);
+  auto exited = [self = shared_from_this(), pidfd, timer,
+                 path = hook.path](pid_t pid, int wstatus) {
+    if (pidfd != -1) {
+      ::close(pidfd);
+    }
+    if (*timer != -1) {
+      self->loop.CancelTimer(*timer);
+    }
+    self->finished(pid, path, wstatus);
+  };
+  if (!loop.WatchChild(pid, pidfd, exited)) {
+    ::kill(pid, SIGKILL);
+    utils::WaitProcess(pid, pidfd);
+    if (pidfd != -1) {
+      ::close(pidfd);
+    }
+    return false;
+  }
+  running.push_back(pid);
+
+  if (hook.timeout > 0) {
+    auto expired = [this, pid, timer, path = hook.path] {
+      *timer = -1;
+      logWan() << name << "hook" << path << "timed out, killing it";
+      loop.Signal(pid, SIGKILL);
+    };
+    *timer = loop.AddTimer(std::chrono::seconds(hook.timeout), expired);
+  }
+  return true;
+}
+
+void hookPhase::finished(pid_t pid, const std::string &path,
+                         int wstatus) noexcept {
+  running.erase(std::remove(running.begin(), running.end(), pid),
+                running.end());
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+    ok = false;
+    if (failFast) {
+      logErr() << name << "hook" << path << "failed, status" << wstatus;
+    } else {
+      logWan() << name << "hook" << path << "failed, status" << wstatus;
+    }
+  }
+  advance();
+}
+
+void hookPhase::kill() noexcept {
+  next = hooks.size();
+  ok = false;
+  if (running.empty()) {
+    return;
+  }
+  logWan() << "killing the" << name << "hooks still running";
+  for (auto pid : running) {
+    loop.Signal(pid, SIGKILL);
+  }
+}
+
+}  // namespace
+
+HooksCancel RunHooks(utils::EventLoop &loop, std::string phase,
+                     std::vector<utils::Hook> hooks, bool failFast,
+                     HooksDone onDone) noexcept {
+  auto hooksPhase = std::make_shared<hookPhase>(
+      loop, std::move(phase), std::move(hooks), failFast, std::move(onDone));
+  hooksPhase->advance();
+  // the phase lives as long as its hooks do, not as long as the canceller
+  return [weak = std::weak_ptr<hookPhase>(hooksPhase)] {
+    if (auto running = weak.lock()) {
+      running->kill();
+    }
+  };
+}
+
+bool RunHooksAndWait(utils::EventLoop &loop, std::string phase,
+                     std::vector<utils::Hook> hooks, bool failFast,
+                     std::initializer_list<int> stopSignals) noexcept {
+  utils::TraceSpan span("RunHooks");
+  span.arg("phase", phase);
+
+  std::optional<bool> result;
+  auto cancel = RunHooks(loop, std::move(phase), std::move(hooks), failFast,
+                         [&](bool ok) {
+                           result = ok;
+                           loop.Stop(0);
+                         });
+  if (!result) {
+    for (auto signo : stopSignals) {
+      loop.WatchSignal(signo,
+                       [cancel](const signalfd_siginfo & /*unused*/) {
+                         cancel();
+                       });
+    }
+    loop.Run();
+  }
+  return result.value_or(false);
+}
+
+}  // namespace linglong::container
@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_HOOK_RUNNER_H_
+#define LINGLONG_BOX_SRC_CONTAINER_HOOK_RUNNER_H_
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "linglong/utils/event_loop.h"
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::container {
+
+// Called once every hook of a phase finished, ok if all of them succeeded.
+using HooksDone = std::function<void(bool ok)>;
+// Kills the hooks of a phase still running and skips the ones not started
+// yet, which fails the phase. Does nothing once the phase is done.
+using HooksCancel = std::function<void()>;
+
+// Runs the hooks of phase from loop without blocking it. Consecutive hooks
+// marked independent run concurrently, any other hook waits for the hooks
+// before it and holds back the ones after it. A hook fails when it exits
+// with a non-zero status or outlives its timeout, which gets it killed.
+//
+// With failFast, as OCI wants for the phases ahead of the container process,
+// the hooks not started yet are skipped after a failure and failures are
+// errors; otherwise they are warnings. onDone may be empty, and may run
+// before RunHooks returns.
+HooksCancel RunHooks(utils::EventLoop &loop, std::string phase,
+                     std::vector<utils::Hook> hooks, bool failFast,
+                     HooksDone onDone) noexcept;
+
+// RunHooks, driving loop until the hooks are done. loop must not be running.
+// Receiving one of stopSignals meanwhile kills the hooks; loop keeps handling
+// these signals that way afterwards.
+bool RunHooksAndWait(utils::EventLoop &loop, std::string phase,
+                     std::vector<utils::Hook> hooks, bool failFast,
+                     std::initializer_list<int> stopSignals = {}) noexcept;
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_HOOK_RUNNER_H_ */
@@ -8,13 +8,63 @@
 
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/vfs.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 #include "linglong/utils/common.h"
 #include "linglong/utils/debug/debug.h"
 #include "linglong/utils/logger.h"
 #include "linglong/utils/oci_runtime.h"
+#include "linglong/utils/platform.h"
+#include "linglong/utils/trace.h"
+
+// from linux/mount.h and linux/openat2.h, which can't be included together
+// with sys/mount.h on every glibc we support
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+
+#ifndef MOVE_MOUNT_T_EMPTY_PATH
+#define MOVE_MOUNT_T_EMPTY_PATH 0x00000040
+#endif
+
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#define MOUNT_ATTR_NOSUID 0x00000002
+#define MOUNT_ATTR_NODEV 0x00000004
+#define MOUNT_ATTR_NOEXEC 0x00000008
+#define MOUNT_ATTR__ATIME 0x00000070
+#define MOUNT_ATTR_RELATIME 0x00000000
+#define MOUNT_ATTR_NOATIME 0x00000010
+#define MOUNT_ATTR_STRICTATIME 0x00000020
+#define MOUNT_ATTR_NODIRATIME 0x00000080
+#endif
+
+#ifndef RESOLVE_NO_MAGICLINKS
+#define RESOLVE_NO_MAGICLINKS 0x02
+#endif
+
+#ifndef RESOLVE_IN_ROOT
+#define RESOLVE_IN_ROOT 0x10
+#endif
 
 std::string to_string(std::filesystem::file_type type) {
   switch (type) {
@@ -88,11 +138,158 @@ bool do_mount_with_fd(const std::string &root, const std::string &source,
   return false;
 }
 
+namespace {
+
+// set once the kernel turned out not to support the new mount API, every
+// following bind goes straight to mount(2)
+bool mountApiUnsupported{false};
+
+struct mountAttr {
+  uint64_t set{0U};
+  uint64_t clr{0U};
+};
+
+// Translate the flags of a bind mount to mount_setattr attributes, or
+// std::nullopt if some of them can only be applied by remounting.
+std::optional<mountAttr> toMountAttr(uint32_t flags) noexcept {
+  const uint32_t supported =
+      MS_BIND | MS_REC | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV |
+      MS_NOEXEC | MS_NOATIME | MS_NODIRATIME | MS_RELATIME | MS_STRICTATIME;
+  if ((flags & ~supported) != 0U) {
+    return std::nullopt;
+  }
+
+  mountAttr attr;
+  if ((flags & MS_RDONLY) != 0U) {
+    attr.set |= MOUNT_ATTR_RDONLY;
+  }
+  if ((flags & MS_NOSUID) != 0U) {
+    attr.set |= MOUNT_ATTR_NOSUID;
+  }
+  if ((flags & MS_NODEV) != 0U) {
+    attr.set |= MOUNT_ATTR_NODEV;
+  }
+  if ((flags & MS_NOEXEC) != 0U) {
+    attr.set |= MOUNT_ATTR_NOEXEC;
+  }
+  if ((flags & MS_NODIRATIME) != 0U) {
+    attr.set |= MOUNT_ATTR_NODIRATIME;
+  }
+
+  // the access time mode is a single field, it has to be cleared when set
+  if ((flags & MS_NOATIME) != 0U) {
+    attr.set |= MOUNT_ATTR_NOATIME;
+    attr.clr |= MOUNT_ATTR__ATIME;
+  } else if ((flags & MS_STRICTATIME) != 0U) {
+    attr.set |= MOUNT_ATTR_STRICTATIME;
+    attr.clr |= MOUNT_ATTR__ATIME;
+  } else if ((flags & MS_RELATIME) != 0U) {
+    attr.set |= MOUNT_ATTR_RELATIME;
+    attr.clr |= MOUNT_ATTR__ATIME;
+  }
+
+  return attr;
+}
+
+// Destinations are prepared by a small pool, one thread per this many paths.
+// Configs with few mounts are prepared on the calling thread alone.
+constexpr size_t kPathsPerThread = 16;
+constexpr size_t kMaxPrepareThreads = 4;
+
+struct prepareTask {
+  std::string key;  // host destination, as Apply computes it
+  std::string path;
+  bool directory{true};
+  bool done{false};
+  bool created{false};
+  int error{0};
+  int64_t cost{0};
+};
+
+// mkdir -p which tolerates other threads creating the same parents
+bool makeDirectory(const std::string &path, bool &created) noexcept {
+  if (::mkdir(path.c_str(), 0755) == 0) {
+    created = true;
+    return true;
+  }
+  if (errno == EEXIST) {
+    return true;
+  }
+  if (errno != ENOENT) {
+    return false;
+  }
+
+  auto slash = path.rfind('/');
+  if (slash == 0 || slash == std::string::npos) {
+    return false;
+  }
+  bool parentCreated{false};
+  if (!makeDirectory(path.substr(0, slash), parentCreated)) {
+    return false;
+  }
+
+  if (::mkdir(path.c_str(), 0755) == 0) {
+    created = true;
+    return true;
+  }
+  return errno == EEXIST;
+}
+
+void runPrepareTask(prepareTask &task) noexcept {
+  auto begin = linglong::utils::Tracer::enabled()
+                   ? linglong::utils::Tracer::now()
+                   : int64_t{0};
+
+  if (task.directory) {
+    task.done = makeDirectory(task.path, task.created);
+    // same as HostMount::ensureDirectoryExist, new directories are 0755
+    // regardless of umask
+    if (task.done && task.created && ::chmod(task.path.c_str(), 0755) == -1) {
+      task.done = false;
+    }
+  } else {
+    auto open = [&task] {
+      return ::open(task.path.c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY | O_CLOEXEC, 0666);
+    };
+    int fd = open();
+    if (fd == -1 && errno == ENOENT) {
+      auto slash = task.path.rfind('/');
+      bool parentCreated{false};
+      if (slash != 0 && slash != std::string::npos &&
+          makeDirectory(task.path.substr(0, slash), parentCreated)) {
+        fd = open();
+      }
+    }
+
+    if (fd != -1) {
+      ::close(fd);
+      task.created = true;
+    }
+    task.done = fd != -1 || errno == EEXIST;
+  }
+
+  if (!task.done) {
+    task.error = errno;
+  }
+  if (begin != 0) {
+    task.cost = linglong::utils::Tracer::now() - begin;
+  }
+}
+
+}  // namespace
+
 namespace linglong::container {
 
 HostMount::HostMount(std::filesystem::path containerRoot)
     : containerRoot(std::move(containerRoot)) {}
 
+HostMount::~HostMount() {
+  if (containerRootFd != -1) {
+    ::close(containerRootFd);
+  }
+}
+
 std::filesystem::path HostMount::toHostDestination(
     const std::filesystem::path &containerDestination) noexcept {
   if (containerDestination.is_relative()) {
@@ -163,6 +360,13 @@ bool HostMount::ensureFileExist(
 
 void HostMount::finalizeMounts() const {
   for (const auto &node : remountList) {
+    if (node.attrSet != 0U &&
+        utils::MountSetattr(node.targetFd, "", AT_EMPTY_PATH, node.attrSet, 0,
+                            0) == 0) {
+      ::close(node.targetFd);
+      continue;
+    }
+
     auto targetPath =
         std::filesystem::path("/proc/self/fd") / std::to_string(node.targetFd);
     if (!remount(targetPath, node.flags, node.data)) {
@@ -248,8 +452,220 @@ bool HostMount::remount(const std::filesystem::path &target, uint32_t flags,
   return false;
 }
 
+// PrepareDestinations creates the missing destinations of all ops up front
+// and in parallel, instead of one by one right before each mount. A
+// destination that lies below the destination of an earlier op is left to
+// Apply, as it only exists once that earlier mount is in place.
+void HostMount::PrepareDestinations(const std::vector<MountOp> &ops) {
+  utils::TraceSpan span("PrepareDestinations");
+  auto begin = utils::Tracer::enabled() ? utils::Tracer::now() : int64_t{0};
+
+  std::vector<prepareTask> tasks;
+  std::vector<std::string> mounted;
+  tasks.reserve(ops.size());
+  mounted.reserve(ops.size());
+  for (const auto &op : ops) {
+    auto destination = toHostDestination(op.mount.destination);
+    auto normal = destination.lexically_normal().string();
+    if (normal.back() != '/') {
+      normal.push_back('/');
+    }
+
+    auto covered =
+        std::any_of(mounted.cbegin(), mounted.cend(),
+                    [&normal](const std::string &prefix) {
+                      return normal.compare(0, prefix.size(), prefix) == 0;
+                    });
+    mounted.push_back(std::move(normal));
+    if (covered) {
+      continue;
+    }
+
+    auto path = op.prepare == MountOp::ParentDirectory
+                    ? destination.parent_path()
+                    : destination;
+    tasks.push_back(prepareTask{
+        .key = destination.string(),
+        .path = path.lexically_normal().string(),
+        .directory = op.prepare != MountOp::File,
+    });
+  }
+
+  auto threads = std::min(
+      kMaxPrepareThreads, (tasks.size() + kPathsPerThread - 1) / kPathsPerThread);
+  std::atomic_size_t next{0};
+  auto worker = [&tasks, &next] {
+    for (auto i = next.fetch_add(1); i < tasks.size(); i = next.fetch_add(1)) {
+      runPrepareTask(tasks[i]);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < threads; ++i) {
+    try {
+      pool.emplace_back(worker);
+    } catch (const std::system_error &e) {
+      logWan() << "failed to start preparation thread:" << e.what();
+      break;
+    }
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  int created{0};
+  int64_t serial{0};
+  for (const auto &task : tasks) {
+    serial += task.cost;
+    if (!task.done) {
+      // Apply tries again and reports the failure
+      logDbg() << "failed to prepare" << task.path << ":"
+               << std::strerror(task.error);
+      continue;
+    }
+
+    created += task.created ? 1 : 0;
+    preparedDestinations.insert(task.key);
+  }
+
+  span.arg("paths", tasks.size())
+      .arg("skipped", ops.size() - tasks.size())
+      .arg("created", created)
+      .arg("threads", pool.size() + 1);
+  if (utils::Tracer::enabled()) {
+    // the serial estimate is the sum of what every path took on its own
+    auto wall = utils::Tracer::now() - begin;
+    auto saved = pool.empty() ? int64_t{0} : serial - wall;
+    span.arg("serialUs", serial / 1000).arg("savedUs", saved / 1000);
+  }
+}
+
+// bindDetached sets up a bind mount with the new mount API: the source tree
+// is cloned detached, configured with a single mount_setattr and attached
+// with move_mount, the destination is resolved inside the container root by
+// openat2 so no /proc/self/fd round trip is needed. It returns std::nullopt
+// if the mount has to be done by mount(2) instead.
+std::optional<bool> HostMount::bindDetached(
+    const MountOp &op, const std::filesystem::path &destination) {
+  const auto &m = op.mount;
+  if (mountApiUnsupported || op.openSource || !m.data.empty() ||
+      (m.flags & LINGLONG_MS_NOSYMFOLLOW) != 0U) {
+    return std::nullopt;
+  }
+
+  auto attr = toMountAttr(m.flags);
+  if (!attr) {
+    return std::nullopt;
+  }
+
+  if (containerRootFd == -1) {
+    containerRootFd =
+        ::open(containerRoot.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (containerRootFd == -1) {
+      logWan() << "failed to open container root" << containerRoot.string()
+               << utils::errnoString();
+      return std::nullopt;
+    }
+  }
+
+  auto fallback = [](const char *what, const std::string &path) {
+    if (errno == ENOSYS) {
+      logDbg() << what << "is not supported, fall back to mount(2)";
+      mountApiUnsupported = true;
+    } else {
+      logDbg() << what << path << "failed:" << utils::errnoString()
+               << "fall back to mount(2)";
+    }
+    return std::nullopt;
+  };
+
+  unsigned int recursive = (m.flags & MS_REC) != 0U ? AT_RECURSIVE : 0;
+  int tree = utils::OpenTree(AT_FDCWD, op.source.c_str(),
+                             OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | recursive);
+  if (tree == -1) {
+    return fallback("open_tree", op.source);
+  }
+
+  bool keepTree{false};
+  utils::defer closeTree([&tree, &keepTree] {
+    if (!keepTree) {
+      ::close(tree);
+    }
+  });
+
+  // read-only is deferred to finalizeMounts like the remount below, so later
+  // mounts can still create their destinations in here
+  auto attrSet = attr->set & ~static_cast<uint64_t>(MOUNT_ATTR_RDONLY);
+  if ((attrSet | attr->clr) != 0U &&
+      utils::MountSetattr(tree, "", AT_EMPTY_PATH, attrSet, attr->clr, 0) ==
+          -1) {
+    return fallback("mount_setattr", op.source);
+  }
+
+  auto relative =
+      std::filesystem::path{m.destination}.lexically_normal().relative_path();
+  if (relative.empty()) {
+    relative = ".";
+  }
+  int target = utils::OpenAt2(containerRootFd, relative.c_str(),
+                              O_PATH | O_CLOEXEC,
+                              RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS);
+  if (target == -1) {
+    return fallback("openat2", destination.string());
+  }
+  utils::defer closeTarget([target] { ::close(target); });
+
+  if (utils::MoveMount(tree, "", target, "",
+                       MOVE_MOUNT_F_EMPTY_PATH | MOVE_MOUNT_T_EMPTY_PATH) ==
+      -1) {
+    return fallback("move_mount", destination.string());
+  }
+
+  if (op.source == "/sys") {
+    sysfs_is_binded = true;
+  }
+
+  const uint32_t all_propagations =
+      (MS_SHARED | MS_PRIVATE | MS_SLAVE | MS_UNBINDABLE);
+  if (auto propagation = m.propagationFlags & all_propagations;
+      propagation != 0U) {
+    unsigned int propagationRecursive =
+        (m.propagationFlags & MS_REC) != 0U ? AT_RECURSIVE : 0;
+    if (utils::MountSetattr(tree, "", AT_EMPTY_PATH | propagationRecursive, 0,
+                            0, propagation) == -1) {
+      logErr() << "failed to set propagation for" << destination.string()
+               << utils::errnoString();
+      return false;
+    }
+  }
+
+  if ((attr->set & MOUNT_ATTR_RDONLY) != 0U) {
+    keepTree = true;
+    remountList.emplace_back(remountNode{
+        .flags = m.flags | MS_BIND | MS_REMOUNT,
+        .extensionFlags = m.extensionFlags,
+        .targetFd = tree,
+        .data = "",
+        .attrSet = MOUNT_ATTR_RDONLY,
+    });
+  }
+
+  return true;
+}
+
 bool HostMount::MountNode(const utils::Mount &m) {
+  auto op = Compile(m);
+  if (!op) {
+    return false;
+  }
+
+  return Apply(*op);
+}
+
+std::optional<MountOp> HostMount::Compile(const utils::Mount &m) noexcept {
   std::error_code ec;
+  MountOp op{.mount = m, .source = m.source};
 
   auto source = std::filesystem::path{m.source};
   auto sourceStatus =
@@ -257,19 +673,10 @@ bool HostMount::MountNode(const utils::Mount &m) {
   if (ec) {
     if (ec.value() != static_cast<int>(std::errc::no_such_file_or_directory)) {
       logErr() << "check source status failed:" << ec.message();
-      return false;
+      return std::nullopt;
     }
   }
 
-  auto destination = toHostDestination(m.destination);
-  int sourceFd{-1};  // FIXME: use local variable store fd temporarily, we
-                     // should refactoring the whole MountNode in the future
-  utils::defer closeFd([&sourceFd] {
-    if (sourceFd != -1) {
-      ::close(sourceFd);
-    }
-  });
-
   switch (sourceStatus.type()) {
     case std::filesystem::file_type::regular:
     case std::filesystem::file_type::block:
@@ -277,26 +684,13 @@ bool HostMount::MountNode(const utils::Mount &m) {
     case std::filesystem::file_type::character:
       [[fallthrough]];
     case std::filesystem::file_type::socket: {
-      if (!ensureFileExist(destination)) {
-        logErr() << "failed to ensure host destination exist.";
-        return false;
-      }
+      op.prepare = MountOp::File;
     } break;
     case std::filesystem::file_type::symlink: {
-      if (!ensureDirectoryExist(destination.parent_path())) {
-        logErr() << "failed to ensure the parent directory of host destination "
-                    "exist.";
-        return false;
-      }
-
       if ((m.extensionFlags & utils::Extension::COPY_SYMLINK) != 0U) {
-        std::filesystem::copy_symlink(source, destination, ec);
-        if (ec) {
-          logErr() << "couldn't copy symlink from " << source.string() << " to "
-                   << destination.string() << " error:" << ec.message();
-        }
-
-        return !ec;
+        op.prepare = MountOp::ParentDirectory;
+        op.action = MountOp::CopySymlink;
+        break;
       }
 
       auto nosymfollow = ((m.flags & LINGLONG_MS_NOSYMFOLLOW) != 0U);
@@ -304,65 +698,46 @@ bool HostMount::MountNode(const utils::Mount &m) {
       if (ec && !nosymfollow) {
         logErr() << "get the real path of symlink" << source.string()
                  << "error:" << ec.message();
-        return false;
+        return std::nullopt;
       }
 
       if (auto type = originalStatus.type();
           type == std::filesystem::file_type::directory && !nosymfollow) {
-        if (!ensureDirectoryExist(destination)) {
-          logErr() << "failed to ensure host directory exist.";
-          return false;
-        }
+        op.prepare = MountOp::Directory;
       } else {
-        if (!ensureFileExist(destination)) {
-          logErr() << "failed to ensure host file exist.";
-          return false;
-        }
+        op.prepare = MountOp::File;
       }
 
       if (nosymfollow) {
-        sourceFd = ::open(source.c_str(), O_PATH | O_NOFOLLOW | O_CLOEXEC);
-        if (sourceFd < 0) {
-          logErr() << utils::format("fail to open source(%s):", source.c_str())
-                   << utils::errnoString();
-          return false;
-        }
-
-        source =
-            std::filesystem::path{"/proc/self/fd"} / std::to_string(sourceFd);
+        op.openSource = true;
         break;
       }
 
-      source = std::filesystem::read_symlink(source, ec);
+      auto target = std::filesystem::read_symlink(source, ec);
       if (ec) {
         logErr() << "couldn't read symlink from " << source.string()
                  << " error:" << ec.message();
-        return false;
+        return std::nullopt;
       }
+      op.source = target.string();
     } break;
     case std::filesystem::file_type::directory: {
-      if (!ensureDirectoryExist(destination)) {
-        logErr() << "failed to ensure the directory of host destination exist.";
-        return false;
-      }
+      op.prepare = MountOp::Directory;
     } break;
     case std::filesystem::file_type::unknown: {
       logErr() << "source file type is unknown:" << source.string();
-      return false;
+      return std::nullopt;
     } break;
     case std::filesystem::file_type::not_found: {
       auto dummy = isDummy(m.type);
       if (dummy && !dummy.value()) {
         logErr() << "try to mount a not existing source" << source.string()
                  << "with filesystem" << m.type;
-        return false;
+        return std::nullopt;
       }
 
-      if (!ensureDirectoryExist(destination)) {
-        logErr() << "failed to ensure the directory of host destination exist.";
-        return false;
-      }
-      source = m.type;
+      op.prepare = MountOp::Directory;
+      op.source = m.type;
     } break;
     case std::filesystem::file_type::none: {
       logFal() << "file type never be none";
@@ -370,6 +745,68 @@ bool HostMount::MountNode(const utils::Mount &m) {
     }
   }
 
+  return op;
+}
+
+bool HostMount::Apply(const MountOp &op) {
+  const auto &m = op.mount;
+  std::error_code ec;
+
+  auto destination = toHostDestination(m.destination);
+  if (preparedDestinations.erase(destination.string()) == 0) {
+    switch (op.prepare) {
+      case MountOp::File: {
+        if (!ensureFileExist(destination)) {
+          logErr() << "failed to ensure host file exist.";
+          return false;
+        }
+      } break;
+      case MountOp::Directory: {
+        if (!ensureDirectoryExist(destination)) {
+          logErr()
+              << "failed to ensure the directory of host destination exist.";
+          return false;
+        }
+      } break;
+      case MountOp::ParentDirectory: {
+        if (!ensureDirectoryExist(destination.parent_path())) {
+          logErr() << "failed to ensure the parent directory of host "
+                      "destination exist.";
+          return false;
+        }
+      } break;
+    }
+  }
+
+  if (op.action == MountOp::CopySymlink) {
+    std::filesystem::copy_symlink(m.source, destination, ec);
+    if (ec) {
+      logErr() << "couldn't copy symlink from " << m.source << " to "
+               << destination.string() << " error:" << ec.message();
+    }
+
+    return !ec;
+  }
+
+  auto source = std::filesystem::path{op.source};
+  int sourceFd{-1};
+  utils::defer closeFd([&sourceFd] {
+    if (sourceFd != -1) {
+      ::close(sourceFd);
+    }
+  });
+
+  if (op.openSource) {
+    sourceFd = ::open(source.c_str(), O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    if (sourceFd < 0) {
+      logErr() << utils::format("fail to open source(%s):", source.c_str())
+               << utils::errnoString();
+      return false;
+    }
+
+    source = std::filesystem::path{"/proc/self/fd"} / std::to_string(sourceFd);
+  }
+
   auto data = utils::str_vec_join(m.data, ',');
   auto real_data = data;
   auto real_flags = m.flags;
@@ -378,6 +815,13 @@ bool HostMount::MountNode(const utils::Mount &m) {
 
   switch (m.fsType) {
     case utils::Mount::Bind: {
+      if (auto attached = bindDetached(op, destination); attached) {
+        if (attached.value()) {
+          return true;
+        }
+        break;
+      }
+
       // make sure m.flags always have MS_BIND
       real_flags |= MS_BIND;
 
@@ -496,6 +940,7 @@ bool HostMount::MountNode(const utils::Mount &m) {
   }
 
   if (auto str = source.string(); !str.empty() && str.at(0) == '/') {
+    auto sourceStatus = std::filesystem::symlink_status(m.source, ec);
     logErr() << "source file type is: " << to_string(sourceStatus.type())
              << ", permission:" << std::oct
              << static_cast<int>(sourceStatus.permissions());
@@ -8,6 +8,8 @@
 #define LINGLONG_BOX_SRC_CONTAINER_MOUNT_HOST_MOUNT_H_
 
 #include <filesystem>
+#include <optional>
+#include <unordered_set>
 
 #include "linglong/utils/oci_runtime.h"
 
@@ -18,30 +20,69 @@ struct remountNode {
   uint32_t extensionFlags{0U};
   int targetFd{-1};
   std::string data;
+  // mount attributes applied with mount_setattr, remounting is the fallback
+  uint64_t attrSet{0U};
+};
+
+// MountOp is a mount with every decision that depends on the host already
+// taken: what has to be created at the destination and what is finally handed
+// to mount(2). Applying it does not look at the source again.
+struct MountOp {
+  enum Prepare {
+    File,
+    Directory,
+    ParentDirectory,
+  };
+
+  enum Action {
+    Mount,
+    CopySymlink,
+  };
+
+  utils::Mount mount;
+  std::string source;
+  Prepare prepare{Directory};
+  Action action{Mount};
+  // LINGLONG_MS_NOSYMFOLLOW: the source is opened with O_NOFOLLOW right
+  // before mounting instead of being resolved.
+  bool openSource{false};
 };
 
 class HostMount {
  public:
   explicit HostMount(std::filesystem::path containerRoot);
-  ~HostMount() = default;
+  HostMount(const HostMount &) = delete;
+  HostMount &operator=(const HostMount &) = delete;
+  ~HostMount();
 
   [[nodiscard]] bool MountNode(const utils::Mount &m);
+  [[nodiscard]] static std::optional<MountOp> Compile(
+      const utils::Mount &m) noexcept;
+  [[nodiscard]] bool Apply(const MountOp &op);
+  // Create the destinations of ops before any of them is applied, Apply
+  // skips its own preparation for those.
+  void PrepareDestinations(const std::vector<MountOp> &ops);
   static bool remount(const std::filesystem::path &target, uint32_t flags,
                       const std::string &data);
   void finalizeMounts() const;
+  // true if /proc/filesystems lists filesystemType, std::nullopt otherwise.
+  static std::optional<bool> isDummy(
+      const std::string &filesystemType) noexcept;
 
  private:
   std::filesystem::path containerRoot;
+  int containerRootFd{-1};
   bool sysfs_is_binded{false};
+  std::optional<bool> bindDetached(const MountOp &op,
+                                   const std::filesystem::path &destination);
   std::filesystem::path toHostDestination(
       const std::filesystem::path &containerDestination) noexcept;
   static bool ensureDirectoryExist(
       const std::filesystem::path &destination) noexcept;
   static bool ensureFileExist(
       const std::filesystem::path &destination) noexcept;
-  static std::optional<bool> isDummy(
-      const std::string &filesystemType) noexcept;
   std::vector<remountNode> remountList;
+  std::unordered_set<std::string> preparedDestinations;
 };
 
 }  // namespace linglong::container
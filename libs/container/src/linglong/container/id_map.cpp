@@ -0,0 +1,196 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/id_map.h"
+
+#include <fcntl.h>
+#include <pwd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "linglong/utils/logger.h"
+
+extern char **environ;  // NOLINT
+
+namespace linglong::container {
+
+namespace {
+
+// the kernel takes at most 340 lines per map since linux 4.15
+constexpr size_t kMaxIDMapLines = 340;
+// three 64 bit numbers, two spaces and the newline
+constexpr size_t kIDMapLineSize = 3 * 20 + 3;
+
+bool writeFile(int dir, const char *file, const char *data,
+               size_t size) noexcept {
+  int fd = ::openat(dir, file, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    logErr() << "open" << file << "failed" << utils::errnoString();
+    return false;
+  }
+
+  auto written = ::write(fd, data, size);
+  auto error = errno;
+  ::close(fd);
+  if (written != static_cast<ssize_t>(size)) {
+    errno = error;
+    logErr() << "write" << file << "failed" << utils::errnoString();
+    return false;
+  }
+  return true;
+}
+
+bool writeMap(int dir, const char *file,
+              const std::vector<utils::IDMap> &maps) noexcept {
+  if (maps.empty()) {
+    return true;
+  }
+  if (maps.size() > kMaxIDMapLines) {
+    logErr() << file << "has more than" << kMaxIDMapLines << "lines";
+    return false;
+  }
+
+  std::array<char, kMaxIDMapLines * kIDMapLineSize + 1> buffer;
+  size_t used = 0;
+  for (const auto &map : maps) {
+    used += static_cast<size_t>(std::snprintf(
+        buffer.data() + used, buffer.size() - used,
+        "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", map.containerID, map.hostID,
+        map.size));
+  }
+  return writeFile(dir, file, buffer.data(), used);
+}
+
+bool runHelper(const char *helper, pid_t pid,
+               const std::vector<utils::IDMap> &maps) noexcept try {
+  if (maps.empty()) {
+    return true;
+  }
+
+  std::vector<std::string> args{helper, std::to_string(pid)};
+  for (const auto &map : maps) {
+    args.push_back(std::to_string(map.containerID));
+    args.push_back(std::to_string(map.hostID));
+    args.push_back(std::to_string(map.size));
+  }
+  std::vector<char *> argv;
+  for (auto &arg : args) {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  pid_t child{-1};
+  if (auto ret = ::posix_spawnp(&child, helper, nullptr, nullptr,
+                                argv.data(), environ);
+      ret != 0) {
+    errno = ret;
+    logErr() << "spawn" << helper << "failed" << utils::errnoString();
+    return false;
+  }
+
+  int wstatus{0};
+  while (::waitpid(child, &wstatus, 0) == -1) {
+    if (errno != EINTR) {
+      logErr() << "waitpid failed" << utils::errnoString();
+      return false;
+    }
+  }
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+    logErr() << helper << "failed with status" << wstatus;
+    return false;
+  }
+  return true;
+} catch (const std::exception &e) {
+  logErr() << "run" << helper << "failed:" << e.what();
+  return false;
+}
+
+// Whether file has a "user:start:count" line for name or uid with a count.
+bool listsUser(const char *file, const std::string &name, uid_t uid) {
+  auto id = std::to_string(uid);
+  std::ifstream in{file};
+  std::string line;
+  while (std::getline(in, line)) {
+    auto first = line.find(':');
+    auto second = line.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+      continue;
+    }
+    auto user = line.substr(0, first);
+    if ((user == name || user == id) &&
+        std::strtoull(line.c_str() + second + 1, nullptr, 10) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool SelfMappable(const std::vector<utils::IDMap> &maps,
+                  uint64_t id) noexcept {
+  return maps.empty() ||
+         (maps.size() == 1 && maps[0].size == 1 && maps[0].hostID == id);
+}
+
+bool WriteIDMaps(pid_t pid, const std::vector<utils::IDMap> &uidMaps,
+                 const std::vector<utils::IDMap> &gidMaps,
+                 bool denySetgroups) noexcept {
+  std::array<char, 32> path{};
+  if (pid > 0) {
+    std::snprintf(path.data(), path.size(), "/proc/%d", pid);
+  } else {
+    std::snprintf(path.data(), path.size(), "/proc/self");
+  }
+
+  int dir = ::open(path.data(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (dir == -1) {
+    logErr() << "open" << path.data() << "failed" << utils::errnoString();
+    return false;
+  }
+
+  auto ok = writeMap(dir, "uid_map", uidMaps);
+  if (ok && denySetgroups && !gidMaps.empty()) {
+    ok = writeFile(dir, "setgroups", "deny", 4);
+  }
+  ok = ok && writeMap(dir, "gid_map", gidMaps);
+  ::close(dir);
+  return ok;
+}
+
+bool RunIDMapHelpers(pid_t pid, const std::vector<utils::IDMap> &uidMaps,
+                     const std::vector<utils::IDMap> &gidMaps) noexcept {
+  return runHelper("newuidmap", pid, uidMaps) &&
+         runHelper("newgidmap", pid, gidMaps);
+}
+
+bool HasSubordinateIDs(uid_t uid) noexcept try {
+  std::string name;
+  std::array<char, 4096> buffer{};
+  passwd pwd{};
+  passwd *result{nullptr};
+  if (::getpwuid_r(uid, &pwd, buffer.data(), buffer.size(), &result) == 0 &&
+      result != nullptr) {
+    name = result->pw_name;
+  }
+
+  return listsUser("/etc/subuid", name, uid) &&
+         listsUser("/etc/subgid", name, uid);
+} catch (const std::exception &e) {
+  logErr() << "read subordinate IDs failed:" << e.what();
+  return false;
+}
+
+}  // namespace linglong::container
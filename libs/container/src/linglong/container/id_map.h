@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_ID_MAP_H_
+#define LINGLONG_BOX_SRC_CONTAINER_ID_MAP_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::container {
+
+// Whether a process whose effective ID in the parent namespace is id may
+// write maps into its new user namespace itself: without CAP_SETUID in the
+// parent the kernel only accepts a single ID mapped onto id.
+bool SelfMappable(const std::vector<utils::IDMap> &maps, uint64_t id) noexcept;
+
+// Writes uid_map, setgroups and gid_map of the user namespace of pid, 0 for
+// the calling process. Each map is rendered into one stack buffer and written
+// with a single write(), the kernel rejects maps that arrive in pieces.
+// setgroups is set to "deny" first if denySetgroups, which unprivileged gid
+// maps require. Empty maps are left unwritten.
+bool WriteIDMaps(pid_t pid, const std::vector<utils::IDMap> &uidMaps,
+                 const std::vector<utils::IDMap> &gidMaps,
+                 bool denySetgroups) noexcept;
+
+// Maps the user namespace of pid through newuidmap and newgidmap, which
+// check the ranges against /etc/subuid and /etc/subgid. Must be called from
+// the parent namespace of pid.
+bool RunIDMapHelpers(pid_t pid, const std::vector<utils::IDMap> &uidMaps,
+                     const std::vector<utils::IDMap> &gidMaps) noexcept;
+
+// Whether both /etc/subuid and /etc/subgid grant subordinate IDs to the user
+// uid.
+bool HasSubordinateIDs(uid_t uid) noexcept;
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_ID_MAP_H_ */
@@ -0,0 +1,378 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/launcher.h"
+
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+
+#include <nlohmann/json.hpp>
+
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+
+namespace {
+
+constexpr auto kMaxRequestSize = 64 * 1024;
+constexpr auto kStdioCount = 3;
+
+// read bytes until '\n', collecting any file descriptors passed along the way
+ssize_t recvLine(int fd, std::string &line, std::vector<int> &fds) noexcept {
+  std::array<char, 4096> buf{};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * kStdioCount)>
+      control{};
+
+  while (line.find('\n') == std::string::npos) {
+    if (line.size() > kMaxRequestSize) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+    iovec iov{.iov_base = buf.data(), .iov_len = buf.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    auto len = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (len <= 0) {
+      return len;
+    }
+
+    for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+
+      auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (decltype(count) i = 0; i < count; ++i) {
+        int received{-1};
+        ::memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        fds.push_back(received);
+      }
+    }
+
+    line.append(buf.data(), len);
+  }
+
+  return static_cast<ssize_t>(line.size());
+}
+
+void reply(int conn, const nlohmann::json &message) noexcept {
+  auto line = message.dump() + "\n";
+  if (::send(conn, line.c_str(), line.size(), MSG_NOSIGNAL) == -1) {
+    logWan() << "failed to reply to launch request"
+             << linglong::utils::errnoString();
+  }
+}
+
+}  // namespace
+
+namespace linglong::container {
+
+Launcher::Launcher(std::filesystem::path socketPath, unsigned int poolSize,
+                   Handler handler)
+    : socketPath(std::move(socketPath)),
+      poolSize(poolSize),
+      handler(std::move(handler)) {}
+
+Launcher::~Launcher() {
+  for (const auto &worker : idle) {
+    ::close(worker.channel);
+  }
+
+  if (signalFd != -1) {
+    ::close(signalFd);
+  }
+
+  if (listenFd != -1) {
+    ::close(listenFd);
+    std::error_code ec;
+    std::filesystem::remove(socketPath, ec);
+  }
+}
+
+bool Launcher::Listen() {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socketPath.string().size() >= sizeof(addr.sun_path)) {
+    logErr() << "socket path is too long:" << socketPath;
+    return false;
+  }
+  ::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+  std::error_code ec;
+  std::filesystem::create_directories(socketPath.parent_path(), ec);
+  if (ec) {
+    logErr() << "failed to create" << socketPath.parent_path() << ec.message();
+    return false;
+  }
+  std::filesystem::remove(socketPath, ec);
+
+  listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd == -1) {
+    logErr() << "socket failed" << utils::errnoString();
+    return false;
+  }
+
+  // only the owner may ask us to start containers
+  auto oldMask = ::umask(0077);
+  auto ret = ::bind(listenFd, reinterpret_cast<sockaddr *>(&addr),  // NOLINT
+                    sizeof(addr));
+  ::umask(oldMask);
+  if (ret == -1) {
+    logErr() << "bind" << socketPath << "failed" << utils::errnoString();
+    return false;
+  }
+
+  if (::listen(listenFd, SOMAXCONN) == -1) {
+    logErr() << "listen failed" << utils::errnoString();
+    return false;
+  }
+
+  return true;
+}
+
+bool Launcher::SpawnWorker() {
+  std::array<int, 2> channel{-1, -1};
+  if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+                   channel.data()) == -1) {
+    logErr() << "socketpair failed" << utils::errnoString();
+    return false;
+  }
+
+  auto pid = ::fork();
+  if (pid < 0) {
+    logErr() << "fork failed" << utils::RetErrString(pid);
+    ::close(channel[0]);
+    ::close(channel[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    ::close(channel[0]);
+    WorkerMain(channel[1]);
+  }
+
+  ::close(channel[1]);
+  idle.push_back(Worker{.pid = pid, .channel = channel[0]});
+  return true;
+}
+
+void Launcher::WorkerMain(int channel) {
+  // drop everything belonging to the server, otherwise idle workers would
+  // keep each other's channel alive after the server is gone
+  for (const auto &worker : idle) {
+    ::close(worker.channel);
+  }
+  idle.clear();
+  ::close(listenFd);
+  ::close(signalFd);
+
+  sigset_t mask;
+  sigfillset(&mask);
+  if (sigprocmask(SIG_UNBLOCK, &mask, nullptr) == -1) {
+    logWan() << "sigprocmask unblock" << utils::errnoString();
+  }
+
+  auto conn = utils::ReceiveFd(channel);
+  if (conn < 0 && errno == ECONNRESET) {
+    // server is gone before handing us any work
+    ::_exit(EXIT_SUCCESS);
+  }
+
+  if (conn < 0) {
+    logErr() << "worker failed to receive connection" << utils::errnoString();
+    ::_exit(EXIT_FAILURE);
+  }
+  ::close(channel);
+
+  ::exit(HandleConnection(conn));
+}
+
+int Launcher::HandleConnection(int conn) {
+  std::string line;
+  std::vector<int> stdio;
+  if (recvLine(conn, line, stdio) <= 0) {
+    logErr() << "failed to read launch request" << utils::errnoString();
+    return EXIT_FAILURE;
+  }
+
+  if (stdio.size() == kStdioCount) {
+    for (int i = 0; i < kStdioCount; ++i) {
+      if (::dup2(stdio[i], i) == -1) {
+        logWan() << "dup2 failed" << utils::errnoString();
+      }
+    }
+  }
+  for (auto fd : stdio) {
+    ::close(fd);
+  }
+
+  LaunchRequest request;
+  try {
+    auto json = nlohmann::json::parse(line.substr(0, line.find('\n')));
+    request.id = json.at("id").get<std::string>();
+    request.bundle = json.at("bundle").get<std::string>();
+    request.config = json.value("config", request.config);
+    request.trace = json.value("trace", request.trace);
+  } catch (const std::exception &e) {
+    logErr() << "invalid launch request:" << e.what();
+    reply(conn, {{"exitCode", -1}, {"error", e.what()}});
+    return EXIT_FAILURE;
+  }
+
+  logInf() << "launch container" << request.id << "from" << request.bundle;
+  auto exitCode = handler(request, [conn](pid_t pid) {
+    reply(conn, {{"pid", pid}});
+  });
+  reply(conn, {{"exitCode", exitCode}});
+
+  return exitCode == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool Launcher::Dispatch(int conn) {
+  for (bool spawned = false;; spawned = true) {
+    while (!idle.empty()) {
+      auto worker = idle.front();
+      idle.pop_front();
+
+      auto sent = utils::SendFd(worker.channel, conn);
+      ::close(worker.channel);
+      if (sent) {
+        logDbg() << "connection dispatched to worker" << worker.pid;
+        return true;
+      }
+
+      logWan() << "worker" << worker.pid << "is gone" << utils::errnoString();
+    }
+
+    // the pool is drained, fall back to a cold fork, once
+    if (spawned || !SpawnWorker()) {
+      return false;
+    }
+  }
+}
+
+void Launcher::ReapWorkers() {
+  int wstatus{-1};
+  while (true) {
+    auto pid = ::waitpid(-1, &wstatus, WNOHANG);
+    if (pid <= 0) {
+      break;
+    }
+
+    auto it = std::find_if(idle.begin(), idle.end(), [pid](const Worker &w) {
+      return w.pid == pid;
+    });
+    if (it != idle.end()) {
+      logWan() << "idle worker" << pid << "exited unexpectedly";
+      ::close(it->channel);
+      idle.erase(it);
+      continue;
+    }
+
+    logDbg() << "worker" << pid << "finished";
+  }
+}
+
+int Launcher::Serve() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (sigprocmask(SIG_BLOCK, &mask, nullptr) == -1) {
+    logErr() << "sigprocmask block" << utils::errnoString();
+    return -1;
+  }
+
+  signalFd = ::signalfd(-1, &mask, SFD_CLOEXEC);
+  if (signalFd == -1) {
+    logErr() << "signalfd failed" << utils::errnoString();
+    return -1;
+  }
+
+  if (!Listen()) {
+    return -1;
+  }
+
+  while (idle.size() < poolSize) {
+    if (!SpawnWorker()) {
+      return -1;
+    }
+  }
+
+  logInf() << "listening on" << socketPath << "with" << poolSize
+           << "pre-forked workers";
+
+  std::array<pollfd, 2> fds{
+      pollfd{.fd = listenFd, .events = POLLIN, .revents = 0},
+      pollfd{.fd = signalFd, .events = POLLIN, .revents = 0},
+  };
+
+  while (true) {
+    if (::poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logErr() << "poll failed" << utils::errnoString();
+      return -1;
+    }
+
+    if ((fds[1].revents & POLLIN) != 0) {
+      signalfd_siginfo info{};
+      if (::read(signalFd, &info, sizeof(info)) != sizeof(info)) {
+        logWan() << "error read from signal fd";
+        continue;
+      }
+
+      if (info.ssi_signo != SIGCHLD) {
+        logInf() << "received signal" << info.ssi_signo << ", stop serving";
+        return 0;
+      }
+
+      ReapWorkers();
+    }
+
+    if ((fds[0].revents & POLLIN) != 0) {
+      auto conn = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (conn == -1) {
+        logWan() << "accept failed" << utils::errnoString();
+        continue;
+      }
+
+      if (!Dispatch(conn)) {
+        reply(conn, {{"exitCode", -1}, {"error", "no worker available"}});
+      }
+      ::close(conn);
+    }
+
+    // refill after the request is on its way, not before
+    while (idle.size() < poolSize) {
+      if (!SpawnWorker()) {
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace linglong::container
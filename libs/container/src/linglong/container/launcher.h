@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_CONTAINER_LAUNCHER_H_
+#define LINGLONG_BOX_CONTAINER_LAUNCHER_H_
+
+#include <sys/types.h>
+
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace linglong::container {
+
+/*
+    Requests are a single line of JSON sent over the unix socket, optionally
+    carrying the caller's stdin, stdout and stderr as SCM_RIGHTS:
+
+        {"id": "app", "bundle": "/path/to/bundle", "config": "config.json"}
+
+    The launcher answers with one line once the container is started and
+    another one when it exits:
+
+        {"pid": 4242}
+        {"exitCode": 0}
+ */
+struct LaunchRequest {
+  std::string id;
+  std::string bundle;
+  std::string config{"config.json"};
+  std::string trace;
+};
+
+// Launcher keeps a pool of ll-box processes forked after static
+// initialization. Every accepted connection is handed to an idle worker, which
+// runs exactly one container and exits, so no state leaks between launches.
+class Launcher {
+ public:
+  using StartedCallback = std::function<void(pid_t)>;
+  using Handler = std::function<int(const LaunchRequest &request,
+                                    const StartedCallback &started)>;
+
+  Launcher(std::filesystem::path socketPath, unsigned int poolSize,
+           Handler handler);
+  Launcher(const Launcher &) = delete;
+  Launcher &operator=(const Launcher &) = delete;
+  ~Launcher();
+
+  int Serve();
+
+ private:
+  struct Worker {
+    pid_t pid{-1};
+    int channel{-1};
+  };
+
+  bool Listen();
+  bool SpawnWorker();
+  bool Dispatch(int conn);
+  void ReapWorkers();
+  [[noreturn]] void WorkerMain(int channel);
+  int HandleConnection(int conn);
+
+  std::filesystem::path socketPath;
+  unsigned int poolSize;
+  Handler handler;
+
+  int listenFd{-1};
+  int signalFd{-1};
+  std::deque<Worker> idle;
+};
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_CONTAINER_LAUNCHER_H_ */
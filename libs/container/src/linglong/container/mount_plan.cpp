@@ -0,0 +1,266 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/mount_plan.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "linglong/utils/binary_codec.h"
+#include "linglong/utils/common.h"
+#include "linglong/utils/hash.h"
+#include "linglong/utils/logger.h"
+
+namespace linglong::container {
+
+namespace {
+
+// bump whenever the file layout, MountOp or the way HostMount::Compile
+// decides changes
+constexpr uint32_t kMountPlanVersion = 2;
+constexpr char kMountPlanMagic[8] = {'L', 'L', 'B', 'O', 'X', 'M', 'P', 0};
+// a plan bigger than this is not one we wrote
+constexpr uint64_t kMountPlanMaxSize = 16 << 20;
+
+// An entry is the header, the key it was compiled from and the plan.
+struct planHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t hash;
+  uint64_t keySize;
+  uint64_t size;
+};
+
+void encode(utils::BinaryWriter &w, const utils::Mount &m) {
+  w.str(m.destination);
+  w.str(m.type);
+  w.str(m.source);
+  w.pod(static_cast<uint32_t>(m.data.size()));
+  for (const auto &option : m.data) {
+    w.str(option);
+  }
+  w.pod(static_cast<uint32_t>(m.fsType));
+  w.pod(m.flags);
+  w.pod(m.propagationFlags);
+  w.pod(m.extensionFlags);
+}
+
+void decode(utils::BinaryReader &r, utils::Mount &m) {
+  m.destination = r.str();
+  m.type = r.str();
+  m.source = r.str();
+  m.data.resize(r.count());
+  for (auto &option : m.data) {
+    option = r.str();
+  }
+  m.fsType = static_cast<utils::Mount::Type>(r.pod<uint32_t>());
+  m.flags = r.pod<uint32_t>();
+  m.propagationFlags = r.pod<uint32_t>();
+  m.extensionFlags = r.pod<uint32_t>();
+}
+
+void encode(utils::BinaryWriter &w, const MountOp &op) {
+  encode(w, op.mount);
+  w.str(op.source);
+  w.pod(static_cast<uint32_t>(op.prepare));
+  w.pod(static_cast<uint32_t>(op.action));
+  w.pod<uint8_t>(op.openSource ? 1 : 0);
+}
+
+void decode(utils::BinaryReader &r, MountOp &op) {
+  decode(r, op.mount);
+  op.source = r.str();
+  op.prepare = static_cast<MountOp::Prepare>(r.pod<uint32_t>());
+  op.action = static_cast<MountOp::Action>(r.pod<uint32_t>());
+  op.openSource = r.pod<uint8_t>() != 0;
+}
+
+void encode(utils::BinaryWriter &w, const SourceStamp &stamp) {
+  w.str(stamp.path);
+  w.pod<uint8_t>(stamp.follow ? 1 : 0);
+  w.pod<uint8_t>(stamp.exists ? 1 : 0);
+  w.pod(stamp.dev);
+  w.pod(stamp.ino);
+  w.pod(stamp.mode);
+  w.pod(stamp.mtime);
+}
+
+void decode(utils::BinaryReader &r, SourceStamp &stamp) {
+  stamp.path = r.str();
+  stamp.follow = r.pod<uint8_t>() != 0;
+  stamp.exists = r.pod<uint8_t>() != 0;
+  stamp.dev = r.pod<uint64_t>();
+  stamp.ino = r.pod<uint64_t>();
+  stamp.mode = r.pod<uint32_t>();
+  stamp.mtime = r.pod<int64_t>();
+}
+
+}  // namespace
+
+SourceStamp SourceStamp::Take(const std::string &path, bool follow) noexcept {
+  SourceStamp stamp{.path = path, .follow = follow};
+
+  struct stat st {};
+  auto ret = follow ? ::stat(path.c_str(), &st) : ::lstat(path.c_str(), &st);
+  if (ret == -1) {
+    return stamp;
+  }
+
+  stamp.exists = true;
+  stamp.dev = st.st_dev;
+  stamp.ino = st.st_ino;
+  stamp.mode = st.st_mode;
+  stamp.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                st.st_mtim.tv_nsec;
+  return stamp;
+}
+
+bool SourceStamp::operator==(const SourceStamp &other) const noexcept {
+  return path == other.path && follow == other.follow &&
+         exists == other.exists && dev == other.dev && ino == other.ino &&
+         mode == other.mode && mtime == other.mtime;
+}
+
+std::string MountPlan::Key(const std::filesystem::path &bundle,
+                           const std::filesystem::path &root,
+                           const std::vector<utils::Mount> &mounts) {
+  utils::BinaryWriter w;
+  w.pod(kMountPlanVersion);
+  w.str(bundle.string());
+  w.str(root.string());
+  w.pod(static_cast<uint32_t>(mounts.size()));
+  for (const auto &mount : mounts) {
+    encode(w, mount);
+  }
+  return std::move(w.buffer);
+}
+
+std::filesystem::path MountPlan::File(const std::filesystem::path &dir,
+                                      std::string_view key) {
+  auto hash = utils::Hasher{}.update(key).digest();
+  return dir / utils::format("mountplan-%016llx",
+                             static_cast<unsigned long long>(hash));
+}
+
+void MountPlan::Add(MountOp op) {
+  auto stamp = SourceStamp::Take(op.mount.source, false);
+  // the compiler follows symlinks to decide between a file and a directory
+  if (stamp.exists && S_ISLNK(stamp.mode)) {
+    stamps.push_back(SourceStamp::Take(op.mount.source, true));
+  }
+  stamps.push_back(std::move(stamp));
+  ops.push_back(std::move(op));
+}
+
+// The hash only names the file. An entry is used only if the key stored in
+// it is the one asked for, byte for byte, and no source changed since.
+std::optional<MountPlan> MountPlan::Load(const std::filesystem::path &file,
+                                         std::string_view key) noexcept try {
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return std::nullopt;
+  }
+  utils::defer closeFd{[fd] { ::close(fd); }};
+
+  planHeader header{};
+  if (::read(fd, &header, sizeof(header)) != sizeof(header) ||
+      std::memcmp(header.magic, kMountPlanMagic, sizeof(header.magic)) != 0 ||
+      header.version != kMountPlanVersion ||
+      header.hash != utils::Hasher{}.update(key).digest() ||
+      header.keySize != key.size() || header.size > kMountPlanMaxSize) {
+    logDbg() << "ignore mount plan" << file.string();
+    return std::nullopt;
+  }
+
+  std::string data(header.keySize + header.size, '\0');
+  if (::read(fd, data.data(), data.size()) !=
+      static_cast<ssize_t>(data.size())) {
+    logWan() << "truncated mount plan" << file.string();
+    return std::nullopt;
+  }
+  if (std::string_view{data}.substr(0, key.size()) != key) {
+    logDbg() << "mount plan" << file.string() << "is another config";
+    return std::nullopt;
+  }
+
+  MountPlan plan;
+  utils::BinaryReader r{data.data() + key.size(), header.size};
+  plan.stamps.resize(r.count());
+  for (auto &stamp : plan.stamps) {
+    decode(r, stamp);
+  }
+  plan.ops.resize(r.count());
+  for (auto &op : plan.ops) {
+    decode(r, op);
+  }
+  if (!r.done()) {
+    logWan() << "malformed mount plan" << file.string();
+    return std::nullopt;
+  }
+
+  for (const auto &stamp : plan.stamps) {
+    if (!(SourceStamp::Take(stamp.path, stamp.follow) == stamp)) {
+      logDbg() << "mount plan is stale," << stamp.path << "changed";
+      return std::nullopt;
+    }
+  }
+
+  return plan;
+} catch (const std::exception &e) {
+  logWan() << "failed to read mount plan" << file.string() << e.what();
+  return std::nullopt;
+}
+
+bool MountPlan::Save(const std::filesystem::path &file,
+                     std::string_view key) const noexcept try {
+  utils::BinaryWriter w;
+  w.buffer.resize(sizeof(planHeader));
+  w.buffer.append(key);
+  w.pod(static_cast<uint32_t>(stamps.size()));
+  for (const auto &stamp : stamps) {
+    encode(w, stamp);
+  }
+  w.pod(static_cast<uint32_t>(ops.size()));
+  for (const auto &op : ops) {
+    encode(w, op);
+  }
+
+  planHeader header{};
+  std::memcpy(header.magic, kMountPlanMagic, sizeof(header.magic));
+  header.version = kMountPlanVersion;
+  header.hash = utils::Hasher{}.update(key).digest();
+  header.keySize = key.size();
+  header.size = w.buffer.size() - sizeof(header) - key.size();
+  std::memcpy(w.buffer.data(), &header, sizeof(header));
+
+  // concurrent launches of the same config may race here
+  auto tmp = file.string() + "." + std::to_string(::getpid());
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    logWan() << "failed to create" << tmp << utils::errnoString();
+    return false;
+  }
+
+  auto written = ::write(fd, w.buffer.data(), w.buffer.size());
+  ::close(fd);
+  if (written != static_cast<ssize_t>(w.buffer.size()) ||
+      ::rename(tmp.c_str(), file.c_str()) == -1) {
+    logWan() << "failed to write mount plan" << file.string()
+             << utils::errnoString();
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+} catch (const std::exception &e) {
+  logWan() << "failed to save mount plan" << file.string() << e.what();
+  return false;
+}
+
+}  // namespace linglong::container
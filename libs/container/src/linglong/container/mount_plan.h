@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_MOUNT_PLAN_H_
+#define LINGLONG_BOX_SRC_CONTAINER_MOUNT_PLAN_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "linglong/container/host_mount.h"
+
+namespace linglong::container {
+
+// SourceStamp records what a mount source looked like when the plan was
+// compiled. A plan is only replayed if every stamp still matches.
+struct SourceStamp {
+  std::string path;
+  bool follow{false};
+  bool exists{false};
+  uint64_t dev{0};
+  uint64_t ino{0};
+  uint32_t mode{0};
+  int64_t mtime{0};
+
+  static SourceStamp Take(const std::string &path, bool follow) noexcept;
+  bool operator==(const SourceStamp &other) const noexcept;
+};
+
+// MountPlan is the compiled form of Runtime::mounts, kept in a binary file in
+// utils::cacheDirectory(). The key is everything the compiler reads besides
+// the filesystem and is stored in the entry, the filesystem part is covered
+// by the source stamps.
+class MountPlan {
+ public:
+  static std::string Key(const std::filesystem::path &bundle,
+                         const std::filesystem::path &root,
+                         const std::vector<utils::Mount> &mounts);
+
+  // The entry of key in dir, named after a hash of key.
+  static std::filesystem::path File(const std::filesystem::path &dir,
+                                    std::string_view key);
+
+  // Returns std::nullopt if file holds no plan for key or the plan is stale.
+  static std::optional<MountPlan> Load(const std::filesystem::path &file,
+                                       std::string_view key) noexcept;
+  bool Save(const std::filesystem::path &file,
+            std::string_view key) const noexcept;
+
+  void Add(MountOp op);
+  [[nodiscard]] const std::vector<MountOp> &Ops() const noexcept {
+    return ops;
+  }
+
+ private:
+  std::vector<MountOp> ops;
+  std::vector<SourceStamp> stamps;
+};
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_MOUNT_PLAN_H_ */
@@ -0,0 +1,123 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/pressure_monitor.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "linglong/container/hook_runner.h"
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+
+namespace linglong::container {
+
+PressureMonitor::PressureMonitor(utils::EventLoop &loop, CgroupManager &cgroup,
+                                 StallHandler onStall) noexcept
+    : loop(loop), cgroup(cgroup), onStall(std::move(onStall)) {}
+
+PressureMonitor::~PressureMonitor() {
+  if (thawTimer != -1) {
+    loop.CancelTimer(thawTimer);
+  }
+  for (auto fd : fds) {
+    loop.UnwatchFd(fd);
+    ::close(fd);
+  }
+}
+
+bool PressureMonitor::Watch(const utils::PressureTrigger &trigger) noexcept {
+  const auto &resource = trigger.resource;
+  const auto &action = trigger.action;
+  if ((resource != "cpu" && resource != "memory" && resource != "io") ||
+      (trigger.type != "some" && trigger.type != "full") ||
+      (action != "log" && action != "hook" && action != "throttle" &&
+       action != "freeze")) {
+    logErr() << "invalid pressure trigger" << resource << trigger.type
+             << action;
+    return false;
+  }
+  if ((action == "hook" && !trigger.hook) ||
+      (action == "throttle" && trigger.memoryHigh <= 0)) {
+    logErr() << "pressure action" << action
+             << "needs a hook or memoryHigh respectively";
+    return false;
+  }
+
+  auto file = resource + ".pressure";
+  int fd = ::openat(cgroup.Fd(), file.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    logErr() << "open" << file << "failed" << utils::errnoString();
+    return false;
+  }
+
+  // the kernel expects the terminating NUL
+  auto spec = trigger.type + " " + std::to_string(trigger.threshold) + " " +
+              std::to_string(trigger.window);
+  if (::write(fd, spec.c_str(), spec.size() + 1) == -1) {
+    logErr() << "arm" << file << "trigger" << spec << "failed"
+             << utils::errnoString();
+    ::close(fd);
+    return false;
+  }
+
+  auto fire = [this, fd, trigger](uint32_t events) {
+    if ((events & EPOLLERR) != 0) {
+      // the cgroup is gone
+      loop.UnwatchFd(fd);
+      ::close(fd);
+      fds.erase(std::remove(fds.begin(), fds.end(), fd), fds.end());
+      return;
+    }
+    act(trigger);
+  };
+  if (!loop.WatchFd(fd, EPOLLPRI, fire)) {
+    ::close(fd);
+    return false;
+  }
+
+  fds.push_back(fd);
+  logDbg() << "armed" << file << "trigger" << spec;
+  return true;
+}
+
+void PressureMonitor::act(const utils::PressureTrigger &trigger) noexcept {
+  logWan() << trigger.resource << "pressure of" << cgroup.Path()
+           << "exceeded" << trigger.type << trigger.threshold << "us per"
+           << trigger.window << "us, action:" << trigger.action;
+
+  if (trigger.action == "hook") {
+    // not waited for, the kernel reports the next stall regardless
+    RunHooks(loop, "pressure", {*trigger.hook}, false, nullptr);
+  } else if (trigger.action == "throttle") {
+    cgroup.Write("memory.high", std::to_string(trigger.memoryHigh));
+  } else if (trigger.action == "freeze") {
+    cgroup.Write("cgroup.freeze", "1");
+    // a later freeze extends the one in effect
+    if (thawTimer != -1) {
+      loop.CancelTimer(thawTimer);
+      thawTimer = -1;
+    }
+    if (trigger.thawAfter > 0) {
+      thawTimer = loop.AddTimer(std::chrono::seconds(trigger.thawAfter),
+                                [this] {
+                                  thawTimer = -1;
+                                  logWan() << "thawing" << cgroup.Path();
+                                  cgroup.Write("cgroup.freeze", "0");
+                                });
+    }
+  }
+
+  if (onStall) {
+    onStall(trigger);
+  }
+}
+
+}  // namespace linglong::container
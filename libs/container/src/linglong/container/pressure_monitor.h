@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_PRESSURE_MONITOR_H_
+#define LINGLONG_BOX_SRC_CONTAINER_PRESSURE_MONITOR_H_
+
+#include <functional>
+#include <vector>
+
+#include "linglong/container/cgroup_manager.h"
+#include "linglong/utils/event_loop.h"
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::container {
+
+// PressureMonitor arms the PSI triggers of linux.resources.pressureTriggers
+// on the cgroup of a container and runs their actions from the event loop of
+// the supervising ll-box. The kernel reports each trigger at most once per
+// window, so actions need no rate limiting of their own. A freeze is lifted
+// after the thawAfter of its trigger, if that isn't 0.
+class PressureMonitor {
+ public:
+  // Called after the action of trigger ran.
+  using StallHandler = std::function<void(const utils::PressureTrigger &)>;
+
+  // loop and cgroup must outlive the monitor.
+  PressureMonitor(utils::EventLoop &loop, CgroupManager &cgroup,
+                  StallHandler onStall) noexcept;
+  PressureMonitor(const PressureMonitor &) = delete;
+  PressureMonitor &operator=(const PressureMonitor &) = delete;
+  // Disarms the triggers. A pending thaw is dropped, the container stays as
+  // it is.
+  ~PressureMonitor();
+
+  // Arms trigger, false if it is invalid or the kernel refused it, e.g.
+  // without CONFIG_PSI or with a window unprivileged users can't use.
+  bool Watch(const utils::PressureTrigger &trigger) noexcept;
+
+ private:
+  void act(const utils::PressureTrigger &trigger) noexcept;
+
+  utils::EventLoop &loop;
+  CgroupManager &cgroup;
+  StallHandler onStall;
+  std::vector<int> fds;
+  // the timer lifting the last freeze, -1 if none is pending
+  int thawTimer{-1};
+};
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_PRESSURE_MONITOR_H_ */
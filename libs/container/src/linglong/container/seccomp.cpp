@@ -4,116 +4,427 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include "linglong/container/seccomp_p.h"
+
+#include <fcntl.h>
+#include <linux/seccomp.h>
 #include <seccomp.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-#include "linglong/container/seccomp_p.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "linglong/utils/common.h"
+#include "linglong/utils/hash.h"
 #include "linglong/utils/logger.h"
-#include "linglong/utils/macro.h"
+#include "linglong/utils/runtime_cache.h"
+#include "linglong/utils/static_map.h"
+#include "linglong/utils/trace.h"
 
 namespace {
 
-#define SYSCALL_PAIR(SYSCALL) \
-  { LL_TOSTRING(SYSCALL), SCMP_SYS(SYSCALL) }
+constexpr auto seccompActionMap = linglong::utils::makeStaticMap<uint32_t>({
+    {"SCMP_ACT_KILL", SCMP_ACT_KILL},
+#ifdef SCMP_ACT_KILL_PROCESS
+    {"SCMP_ACT_KILL_PROCESS", SCMP_ACT_KILL_PROCESS},
+    {"SCMP_ACT_KILL_THREAD", SCMP_ACT_KILL_THREAD},
+#endif
+#ifdef SCMP_ACT_LOG
+    {"SCMP_ACT_LOG", SCMP_ACT_LOG},
+#endif
+#ifdef SCMP_ACT_NOTIFY
+    {"SCMP_ACT_NOTIFY", SCMP_ACT_NOTIFY},
+#endif
+    {"SCMP_ACT_TRAP", SCMP_ACT_TRAP},
+    {"SCMP_ACT_ERRNO", SCMP_ACT_ERRNO(EPERM)},
+    {"SCMP_ACT_TRACE", SCMP_ACT_TRACE(EPERM)},
+    {"SCMP_ACT_ALLOW", SCMP_ACT_ALLOW},
+});
 
-std::vector<struct scmp_arg_cmp> toScmpArgCmpArray(
-    const std::vector<linglong::utils::SyscallArg> &args) {
-  static const std::map<std::string, scmp_compare> seccompArgOpMap = {
-      {"_SCMP_CMP_MIN", _SCMP_CMP_MIN},
-      {"SCMP_CMP_NE", SCMP_CMP_NE},
-      {"SCMP_CMP_LT", SCMP_CMP_LT},
-      {"SCMP_CMP_LE", SCMP_CMP_LE},
-      {"SCMP_CMP_EQ", SCMP_CMP_EQ},
-      {"SCMP_CMP_GE", SCMP_CMP_GE},
-      {"SCMP_CMP_GT", SCMP_CMP_GT},
-      {"SCMP_CMP_MASKED_EQ", SCMP_CMP_MASKED_EQ},
-      {"_SCMP_CMP_MAX", _SCMP_CMP_MAX},
+constexpr auto seccompArchMap = linglong::utils::makeStaticMap<uint32_t>({
+    {"SCMP_ARCH_X86", SCMP_ARCH_X86},
+    {"SCMP_ARCH_X86_64", SCMP_ARCH_X86_64},
+    {"SCMP_ARCH_X32", SCMP_ARCH_X32},
+
+    {"SCMP_ARCH_ARM", SCMP_ARCH_ARM},
+    {"SCMP_ARCH_AARCH64", SCMP_ARCH_AARCH64},
+
+    {"SCMP_ARCH_MIPS", SCMP_ARCH_MIPS},
+    {"SCMP_ARCH_MIPS64", SCMP_ARCH_MIPS64},
+    {"SCMP_ARCH_MIPS64N32", SCMP_ARCH_MIPS64N32},
+    {"SCMP_ARCH_MIPSEL", SCMP_ARCH_MIPSEL},
+    {"SCMP_ARCH_MIPSEL64", SCMP_ARCH_MIPSEL64},
+    {"SCMP_ARCH_MIPSEL64N32", SCMP_ARCH_MIPSEL64N32},
+
+    {"SCMP_ARCH_PPC64LE", SCMP_ARCH_PPC64LE},
+    {"SCMP_ARCH_S390X", SCMP_ARCH_S390X},
+#ifdef SCMP_ARCH_RISCV64
+    {"SCMP_ARCH_RISCV64", SCMP_ARCH_RISCV64},
+#endif
+#ifdef SCMP_ARCH_LOONGARCH64
+    {"SCMP_ARCH_LOONGARCH64", SCMP_ARCH_LOONGARCH64},
+#endif
+});
+
+constexpr auto seccompArgOpMap = linglong::utils::makeStaticMap<scmp_compare>({
+    {"_SCMP_CMP_MIN", _SCMP_CMP_MIN},
+    {"SCMP_CMP_NE", SCMP_CMP_NE},
+    {"SCMP_CMP_LT", SCMP_CMP_LT},
+    {"SCMP_CMP_LE", SCMP_CMP_LE},
+    {"SCMP_CMP_EQ", SCMP_CMP_EQ},
+    {"SCMP_CMP_GE", SCMP_CMP_GE},
+    {"SCMP_CMP_GT", SCMP_CMP_GT},
+    {"SCMP_CMP_MASKED_EQ", SCMP_CMP_MASKED_EQ},
+    {"_SCMP_CMP_MAX", _SCMP_CMP_MAX},
+});
+
+bool sameConditions(const std::vector<scmp_arg_cmp> &lhs,
+                    const std::vector<scmp_arg_cmp> &rhs) noexcept {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                    [](const scmp_arg_cmp &a, const scmp_arg_cmp &b) {
+                      return a.arg == b.arg && a.op == b.op &&
+                             a.datum_a == b.datum_a && a.datum_b == b.datum_b;
+                    });
+}
+
+#ifdef SCMP_ACT_NOTIFY
+// Called by the container's process between loading the filter and exec, to
+// hand the listener to ll-box. Notifying them would wait for an answer from
+// a supervisor that has no listener yet, so like runc such profiles are
+// refused.
+constexpr std::array<std::string_view, 4> kUnnotifiable{
+    "close", "sendmsg", "socketcall", "write"};
+#endif
+
+struct seccompRule {
+  std::string name;
+  int syscall;
+  uint32_t action;
+  // one rule per entry, an empty entry matches every call
+  std::vector<std::vector<scmp_arg_cmp>> conditions;
+};
+
+// The rules of a profile as libseccomp should get them. Every syscall gets
+// one rule per action, holding the distinct argument conditions of all the
+// entries naming it, or none if one of them is unconditional since that one
+// matches whatever the others do. Rules with the default action are dropped.
+//
+// Names are resolved by libseccomp, which knows the syscalls of every
+// architecture and translates the number for each architecture of the
+// filter. Profiles list syscalls of many kernels, like runc the names it
+// doesn't know at all are skipped.
+std::vector<seccompRule> mergeRules(const linglong::utils::Seccomp &seccomp,
+                                    uint32_t defaultAction) {
+  std::vector<seccompRule> rules;
+  std::unordered_map<uint64_t, size_t> indexes;
+
+  for (auto const &syscall : seccomp.syscalls) {
+    auto action = seccompActionMap.at(syscall.action, "seccomp action");
+    if (action == defaultAction) {
+      continue;
+    }
+    auto args = linglong::container::toScmpArgCmpArray(syscall.args);
+
+    for (auto const &name : syscall.names) {
+      auto number = seccomp_syscall_resolve_name(name.c_str());
+      if (number == __NR_SCMP_ERROR) {
+        logDbg() << "skip unknown syscall" << name;
+        continue;
+      }
+#ifdef SCMP_ACT_NOTIFY
+      if (action == SCMP_ACT_NOTIFY &&
+          std::find(kUnnotifiable.begin(), kUnnotifiable.end(), name) !=
+              kUnnotifiable.end()) {
+        throw std::runtime_error("SCMP_ACT_NOTIFY can't be used for " + name);
+      }
+#endif
+
+      auto key = (static_cast<uint64_t>(static_cast<uint32_t>(number)) << 32) |
+                 action;
+      auto [it, inserted] = indexes.try_emplace(key, rules.size());
+      if (inserted) {
+        rules.push_back({name, number, action, {args}});
+        continue;
+      }
+
+      auto &conditions = rules[it->second].conditions;
+      if (conditions.front().empty()) {
+        continue;
+      }
+      if (args.empty()) {
+        conditions.assign(1, {});
+        continue;
+      }
+      auto same = [&args](const std::vector<scmp_arg_cmp> &other) {
+        return sameConditions(args, other);
+      };
+      if (std::none_of(conditions.begin(), conditions.end(), same)) {
+        conditions.push_back(args);
+      }
+    }
+  }
+
+  return rules;
+}
+
+// bump whenever the file layout or the way profiles are compiled changes
+constexpr uint32_t kSeccompCacheVersion = 4;
+constexpr char kSeccompCacheMagic[8] = {'L', 'L', 'B', 'O', 'X', 'B', 'F', 0};
+
+// An entry is the header, the key it was compiled from and the program.
+struct bpfCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t hash;
+  uint64_t keySize;
+  uint64_t size;
+};
+
+// Everything that decides the compiled program, the profile included. Strings
+// are length prefixed, so no two profiles serialize alike.
+std::string seccompCacheKey(const linglong::utils::Seccomp &seccomp) {
+  std::string key;
+  auto put = [&key](auto value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  auto putString = [&key, &put](std::string_view value) {
+    put(value.size());
+    key.append(value);
   };
 
+  put(kSeccompCacheVersion);
+  put(seccomp_arch_native());
+  if (const auto *version = seccomp_version(); version != nullptr) {
+    put(version->major);
+    put(version->minor);
+    put(version->micro);
+  }
+
+  putString(seccomp.defaultAction);
+  put(seccomp.architectures.size());
+  for (const auto &architecture : seccomp.architectures) {
+    putString(architecture);
+  }
+  put(seccomp.syscalls.size());
+  for (const auto &syscall : seccomp.syscalls) {
+    putString(syscall.action);
+    put(syscall.names.size());
+    for (const auto &name : syscall.names) {
+      putString(name);
+    }
+    put(syscall.args.size());
+    for (const auto &arg : syscall.args) {
+      put(arg.index);
+      put(arg.value);
+      put(arg.valueTwo);
+      putString(arg.op);
+    }
+  }
+  return key;
+}
+
+// The hash only names the file. An entry is used only if the key stored in
+// it is the profile being compiled, byte for byte.
+std::optional<std::vector<sock_filter>> loadBpfCache(
+    const std::filesystem::path &file, uint64_t hash,
+    std::string_view key) noexcept try {
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return std::nullopt;
+  }
+  linglong::utils::defer closeFd{[fd] { ::close(fd); }};
+
+  bpfCacheHeader header{};
+  if (::read(fd, &header, sizeof(header)) != sizeof(header) ||
+      std::memcmp(header.magic, kSeccompCacheMagic, sizeof(header.magic)) !=
+          0 ||
+      header.version != kSeccompCacheVersion || header.hash != hash ||
+      header.keySize != key.size() || header.size == 0 ||
+      header.size > BPF_MAXINSNS) {
+    logDbg() << "ignore seccomp cache" << file.string();
+    return std::nullopt;
+  }
+
+  std::string stored(key.size(), '\0');
+  std::vector<sock_filter> program(header.size);
+  std::array<iovec, 2> parts{{
+      {stored.data(), stored.size()},
+      {program.data(), program.size() * sizeof(sock_filter)},
+  }};
+  if (::readv(fd, parts.data(), parts.size()) !=
+      static_cast<ssize_t>(parts[0].iov_len + parts[1].iov_len)) {
+    logWan() << "truncated seccomp cache" << file.string();
+    return std::nullopt;
+  }
+  if (stored != key) {
+    logDbg() << "seccomp cache" << file.string() << "is another profile";
+    return std::nullopt;
+  }
+  return program;
+} catch (const std::exception &e) {
+  logWan() << "failed to read seccomp cache" << file.string() << e.what();
+  return std::nullopt;
+}
+
+bool saveBpfCache(const std::filesystem::path &file, uint64_t hash,
+                  std::string_view key,
+                  const std::vector<sock_filter> &program) noexcept {
+  bpfCacheHeader header{};
+  std::memcpy(header.magic, kSeccompCacheMagic, sizeof(header.magic));
+  header.version = kSeccompCacheVersion;
+  header.hash = hash;
+  header.keySize = key.size();
+  header.size = program.size();
+
+  // concurrent launches of the same profile may race here
+  auto tmp = file.string() + "." + std::to_string(::getpid());
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    logWan() << "failed to create" << tmp << linglong::utils::errnoString();
+    return false;
+  }
+
+  std::array<iovec, 3> parts{{
+      {&header, sizeof(header)},
+      {const_cast<char *>(key.data()), key.size()},  // NOLINT
+      {const_cast<sock_filter *>(program.data()),    // NOLINT
+       program.size() * sizeof(sock_filter)},
+  }};
+  auto written = ::writev(fd, parts.data(), parts.size());
+  ::close(fd);
+  if (written != static_cast<ssize_t>(parts[0].iov_len + parts[1].iov_len +
+                                      parts[2].iov_len) ||
+      ::rename(tmp.c_str(), file.c_str()) == -1) {
+    logWan() << "failed to write seccomp cache" << file.string()
+             << linglong::utils::errnoString();
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+// The program seccomp_load would install, as seccomp_export_bpf writes it.
+std::vector<sock_filter> exportBpf(scmp_filter_ctx ctx) {
+  int fd = ::memfd_create("seccomp-bpf", MFD_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error("memfd_create: " +
+                             linglong::utils::errnoString());
+  }
+  linglong::utils::defer closeFd{[fd] { ::close(fd); }};
+
+  if (auto ret = seccomp_export_bpf(ctx, fd); ret != 0) {
+    throw std::runtime_error("seccomp_export_bpf: " +
+                             std::string(std::strerror(-ret)));
+  }
+
+  auto size = ::lseek(fd, 0, SEEK_CUR);
+  if (size <= 0 || size % sizeof(sock_filter) != 0) {
+    throw std::runtime_error("unexpected BPF program size " +
+                             std::to_string(size));
+  }
+
+  std::vector<sock_filter> program(size / sizeof(sock_filter));
+  if (::pread(fd, program.data(), size, 0) != size) {
+    throw std::runtime_error("read BPF program: " +
+                             linglong::utils::errnoString());
+  }
+  return program;
+}
+
+}  // namespace
+
+namespace linglong::container {
+
+std::vector<struct scmp_arg_cmp> toScmpArgCmpArray(
+    const std::vector<utils::SyscallArg> &args) {
   std::vector<struct scmp_arg_cmp> scmpArgs;
 
-  unsigned int index = 0;
   for (auto const &arg : args) {
     scmpArgs.push_back({
-        .arg = index,
-        .op = seccompArgOpMap.at(arg.op),
+        .arg = arg.index,
+        .op = seccompArgOpMap.at(arg.op, "seccomp operator"),
         .datum_a = arg.value,
         .datum_b = arg.valueTwo,
     });
-    ++index;
   }
 
   return scmpArgs;
 }
 
-int toSyscallNumber(const std::string &name) {
-  // unistd.h for example: __NR_read
-
-  //  FIXME: need full support
-  static const std::map<std::string, int> syscallNameMap = {
-      SYSCALL_PAIR(read),          SYSCALL_PAIR(write),
-      SYSCALL_PAIR(open),          SYSCALL_PAIR(stat),
-      SYSCALL_PAIR(getcwd),        SYSCALL_PAIR(chmod),
-      SYSCALL_PAIR(syslog),        SYSCALL_PAIR(uselib),
-      SYSCALL_PAIR(acct),          SYSCALL_PAIR(modify_ldt),
-      SYSCALL_PAIR(quotactl),      SYSCALL_PAIR(add_key),
-      SYSCALL_PAIR(keyctl),        SYSCALL_PAIR(request_key),
-      SYSCALL_PAIR(move_pages),    SYSCALL_PAIR(mbind),
-      SYSCALL_PAIR(get_mempolicy), SYSCALL_PAIR(set_mempolicy),
-      SYSCALL_PAIR(migrate_pages), SYSCALL_PAIR(unshare),
-      SYSCALL_PAIR(mount),         SYSCALL_PAIR(pivot_root),
-      SYSCALL_PAIR(clone),         SYSCALL_PAIR(ioctl),
-  };
-
-  return syscallNameMap.at(name);
+int CompileSeccomp(const utils::Seccomp &seccomp,
+                   std::vector<sock_filter> &program) noexcept {
+  return CompileSeccomp(seccomp, program, utils::cacheDirectory());
 }
 
-}  // namespace
-
-namespace linglong {
-
-int ConfigSeccomp(const std::optional<linglong::utils::Seccomp> &seccomp) {
-  if (!seccomp.has_value()) {
+int CompileSeccomp(const utils::Seccomp &seccomp,
+                   std::vector<sock_filter> &program,
+                   const std::filesystem::path &cacheDir) noexcept {
+  utils::TraceSpan span("CompileSeccomp");
+  std::string key;
+  try {
+    key = seccompCacheKey(seccomp);
+  } catch (const std::exception &e) {
+    logErr() << "config seccomp failed:" << e.what();
+    return -1;
+  }
+  auto hash = utils::Hasher{}.update(key).digest();
+  auto file = cacheDir / utils::format("seccomp-%016llx",
+                                       static_cast<unsigned long long>(hash));
+  if (auto cached = loadBpfCache(file, hash, key); cached) {
+    span.arg("cache", "hit");
+    program = std::move(*cached);
     return 0;
   }
+  span.arg("cache", "miss");
 
-  static const std::map<std::string, int> seccompActionMap = {
-      {"SCMP_ACT_KILL", SCMP_ACT_KILL},
-      {"SCMP_ACT_TRAP", SCMP_ACT_TRAP},
-      {"SCMP_ACT_ERRNO", SCMP_ACT_ERRNO(EPERM)},
-      {"SCMP_ACT_TRACE", SCMP_ACT_TRACE(EPERM)},
-      {"SCMP_ACT_ALLOW", SCMP_ACT_ALLOW},
-  };
+  if (auto ret = CompileSeccompUncached(seccomp, program); ret != 0) {
+    return ret;
+  }
 
-  // FIXME: need full support
-  static const std::map<std::string, int> seccompArchMap = {
-      {"SCMP_ARCH_X86", SCMP_ARCH_X86},
-      {"SCMP_ARCH_X86_64", SCMP_ARCH_X86_64},
-      {"SCMP_ARCH_X32", SCMP_ARCH_X32},
-
-      {"SCMP_ARCH_ARM", SCMP_ARCH_ARM},
-      {"SCMP_ARCH_AARCH64", SCMP_ARCH_AARCH64},
-
-      {"SCMP_ARCH_MIPS", SCMP_ARCH_MIPS},
-      {"SCMP_ARCH_MIPS64", SCMP_ARCH_MIPS64},
-      {"SCMP_ARCH_MIPS64N32", SCMP_ARCH_MIPS64N32},
-      {"SCMP_ARCH_MIPSEL", SCMP_ARCH_MIPSEL},
-      {"SCMP_ARCH_MIPSEL64", SCMP_ARCH_MIPSEL64},
-      {"SCMP_ARCH_MIPSEL64N32", SCMP_ARCH_MIPSEL64N32},
-  };
+  std::error_code ec;
+  std::filesystem::create_directories(cacheDir, ec);
+  if (ec) {
+    logWan() << "failed to create" << cacheDir.string() << ec.message();
+  } else if (saveBpfCache(file, hash, key, program)) {
+    utils::pruneCacheDirectory(cacheDir);
+  }
+  return 0;
+}
 
+int CompileSeccompUncached(const utils::Seccomp &seccomp,
+                           std::vector<sock_filter> &program) noexcept {
   int ret;
   scmp_filter_ctx ctx = nullptr;
 
   try {
-    auto defaultAction = seccompActionMap.at(seccomp->defaultAction);
+    auto defaultAction =
+        seccompActionMap.at(seccomp.defaultAction, "seccomp action");
+
+#ifdef SCMP_ACT_NOTIFY
+    if (defaultAction == SCMP_ACT_NOTIFY) {
+      throw std::runtime_error("SCMP_ACT_NOTIFY can't be the default action");
+    }
+#endif
 
     ctx = seccomp_init(defaultAction);
     if (ctx == nullptr) {
       throw std::runtime_error(utils::errnoString() +
-                               " seccomp_init=" + seccomp->defaultAction);
+                               " seccomp_init=" + seccomp.defaultAction);
     }
-    for (auto const &architecture : seccomp->architectures) {
-      auto scmpArch = seccompArchMap.at(architecture);
+    for (auto const &architecture : seccomp.architectures) {
+      auto scmpArch = seccompArchMap.at(architecture, "architecture");
       if (seccomp_arch_exist(ctx, scmpArch) == -EEXIST) {
         ret = seccomp_arch_add(ctx, scmpArch);
         if (ret != 0) {
@@ -123,22 +434,27 @@ int ConfigSeccomp(const std::optional<linglong::utils::Seccomp> &seccomp) {
       }
     }
 
-    for (auto const &syscall : seccomp->syscalls) {
-      auto action = seccompActionMap.at(syscall.action);
-      auto argc = syscall.args.size();
-      auto args = toScmpArgCmpArray(syscall.args);
-
-      for (auto const &name : syscall.names) {
-        auto sysNumber = toSyscallNumber(name);
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)
+    // look syscalls up in a binary tree rather than comparing them one by
+    // one, large allow lists otherwise cost a linear scan on every call
+    if (ret = seccomp_attr_set(ctx, SCMP_FLTATR_CTL_OPTIMIZE, 2); ret != 0) {
+      logDbg() << "binary tree filter unavailable:" << std::strerror(-ret);
+    }
+#endif
 
-        ret = seccomp_rule_add_array(ctx, action, sysNumber, argc, args.data());
+    for (auto const &rule : mergeRules(seccomp, defaultAction)) {
+      for (auto const &args : rule.conditions) {
+        ret = seccomp_rule_add_array(ctx, rule.action, rule.syscall,
+                                     args.size(), args.data());
         if (ret != 0) {
-          throw std::runtime_error(utils::errnoString() +
-                                   " syscall.name=" + name);
+          throw std::runtime_error(std::string(std::strerror(-ret)) +
+                                   " syscall.name=" + rule.name);
         }
       }
     }
-    ret = seccomp_load(ctx);
+
+    program = exportBpf(ctx);
+    ret = 0;
   } catch (const std::exception &e) {
     logErr() << "config seccomp failed:" << e.what();
     ret = -1;
@@ -147,10 +463,55 @@ int ConfigSeccomp(const std::optional<linglong::utils::Seccomp> &seccomp) {
     ret = -1;
   }
 
-  if (!ctx) {
+  if (ctx) {
     seccomp_release(ctx);
   }
   return ret;
 }
 
-}  // namespace linglong
+bool SeccompNotifies(const utils::Seccomp &seccomp) noexcept {
+  return std::any_of(seccomp.syscalls.begin(), seccomp.syscalls.end(),
+                     [](const utils::Syscall &syscall) {
+                       return syscall.action == "SCMP_ACT_NOTIFY";
+                     });
+}
+
+uint64_t SeccompProgramHash(const std::vector<sock_filter> &program) noexcept {
+  return utils::Hasher{}
+      .update(std::string_view{reinterpret_cast<const char *>(program.data()),
+                               program.size() * sizeof(sock_filter)})
+      .digest();
+}
+
+int LoadSeccomp(const std::vector<sock_filter> &program,
+                int *listener) noexcept {
+  if (listener != nullptr) {
+    *listener = -1;
+  }
+  if (program.empty()) {
+    return 0;
+  }
+
+  // seccomp_load does the same with libseccomp's default attributes
+  if (::prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+    logErr() << "set no_new_privs failed" << utils::errnoString();
+    return -1;
+  }
+
+  sock_fprog prog{
+      .len = static_cast<unsigned short>(program.size()),
+      .filter = const_cast<sock_filter *>(program.data()),  // NOLINT
+  };
+  auto flags = listener != nullptr ? SECCOMP_FILTER_FLAG_NEW_LISTENER : 0;
+  auto ret = ::syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+  if (ret == -1) {
+    logErr() << "install seccomp filter failed" << utils::errnoString();
+    return -1;
+  }
+  if (listener != nullptr) {
+    *listener = static_cast<int>(ret);
+  }
+  return 0;
+}
+
+}  // namespace linglong::container
@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/seccomp_notify.h"
+
+#include <seccomp.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "linglong/utils/logger.h"
+
+namespace linglong::container {
+
+namespace {
+
+// Guesses whether the running kernel accepts SECCOMP_USER_NOTIF_FLAG_CONTINUE
+// from the release uname() reports, the flag came with 5.5. It is a version
+// heuristic, not a probe: a backport to an older release is missed, and a
+// kernel built without it is caught by Handle when the answer fails.
+bool kernelCanContinue() noexcept {
+  utsname name{};
+  int major = 0;
+  int minor = 0;
+  if (::uname(&name) == -1 ||
+      std::sscanf(name.release, "%d.%d", &major, &minor) != 2) {
+    return false;
+  }
+  return major > 5 || (major == 5 && minor >= 5);
+}
+
+}  // namespace
+
+SeccompNotifier::SeccompNotifier() : canContinue(kernelCanContinue()) {
+  if (!canContinue) {
+    logWan() << "seccomp notifications can't continue syscalls on this "
+                "kernel release, failing them instead";
+  }
+
+  seccomp_notif_sizes sizes{};
+  if (::syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == -1) {
+    sizes.seccomp_notif = sizeof(seccomp_notif);
+    sizes.seccomp_notif_resp = sizeof(seccomp_notif_resp);
+  }
+  request.resize(std::max<size_t>(sizes.seccomp_notif, sizeof(seccomp_notif)));
+  response.resize(
+      std::max<size_t>(sizes.seccomp_notif_resp, sizeof(seccomp_notif_resp)));
+}
+
+void SeccompNotifier::On(const std::string &name, Handler handler) {
+  handlers[name] = std::move(handler);
+  resolved.clear();
+}
+
+const SeccompNotifier::Handler *SeccompNotifier::find(
+    const seccomp_data &data) noexcept {
+  auto key = (static_cast<uint64_t>(data.arch) << 32) |
+             static_cast<uint32_t>(data.nr);
+  if (auto it = resolved.find(key); it != resolved.end()) {
+    return it->second;
+  }
+
+  const Handler *handler{nullptr};
+  if (auto *name = seccomp_syscall_resolve_num_arch(data.arch, data.nr);
+      name != nullptr) {
+    if (auto it = handlers.find(name); it != handlers.end()) {
+      handler = &it->second;
+    }
+    ::free(name);  // NOLINT
+  }
+  resolved.emplace(key, handler);
+  return handler;
+}
+
+bool SeccompNotifier::Handle(int listener) noexcept {
+  std::fill(request.begin(), request.end(), 0);
+  auto *req = reinterpret_cast<seccomp_notif *>(request.data());  // NOLINT
+  if (::ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req) == -1) {
+    // ENOENT: the caller was interrupted before we got to it
+    if (errno == EINTR || errno == ENOENT) {
+      return true;
+    }
+    logWan() << "receive seccomp notification failed" << utils::errnoString();
+    return false;
+  }
+
+  auto answer = NotifyResponse::Continue();
+  if (const auto *handler = find(req->data); handler != nullptr) {
+    answer = (*handler)(*req);
+  }
+
+  std::fill(response.begin(), response.end(), 0);
+  auto *resp =
+      reinterpret_cast<seccomp_notif_resp *>(response.data());  // NOLINT
+  resp->id = req->id;
+  if (answer.continueCall && !canContinue) {
+    answer = NotifyResponse::Fail(ENOSYS);
+  }
+  if (answer.continueCall) {
+    resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  } else {
+    resp->val = answer.value;
+    resp->error = -answer.error;
+  }
+
+  auto ret = ::ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+  // older kernels reject any flag with EINVAL, the caller stays blocked until
+  // it gets another answer
+  if (ret == -1 && errno == EINVAL && answer.continueCall) {
+    canContinue = false;
+    resp->flags = 0;
+    resp->error = -ENOSYS;
+    ret = ::ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+  }
+  if (ret == -1 && errno != ENOENT) {
+    logWan() << "answer seccomp notification of" << req->pid << "failed"
+             << utils::errnoString();
+  }
+  return true;
+}
+
+}  // namespace linglong::container
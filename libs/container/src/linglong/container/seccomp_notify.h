@@ -0,0 +1,73 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_SECCOMP_NOTIFY_H_
+#define LINGLONG_BOX_SRC_CONTAINER_SECCOMP_NOTIFY_H_
+
+#include <linux/seccomp.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace linglong::container {
+
+// The answer to an intercepted syscall.
+struct NotifyResponse {
+  // Lets the syscall run as if it hadn't been intercepted. The kernel
+  // re-reads its arguments afterwards, so handlers must not base security
+  // decisions on what they looked at.
+  static NotifyResponse Continue() noexcept { return {}; }
+  // Returns value to the caller without running the syscall.
+  static NotifyResponse Return(int64_t value) noexcept {
+    return {value, 0, false};
+  }
+  // Fails the syscall with error.
+  static NotifyResponse Fail(int error) noexcept { return {0, error, false}; }
+
+  int64_t value{0};
+  int error{0};
+  bool continueCall{true};
+};
+
+// Answers the notifications of a seccomp filter with SCMP_ACT_NOTIFY rules,
+// driven by the event loop of the supervising ll-box. The calling thread
+// stays blocked until it is answered, so handlers must not block. Syscalls
+// without a handler continue, which costs them one round trip through the
+// supervisor. Kernels before 5.5 can't let a syscall continue, on those both
+// these syscalls and Continue() answers fail with ENOSYS instead.
+class SeccompNotifier {
+ public:
+  using Handler = std::function<NotifyResponse(const seccomp_notif &request)>;
+
+  SeccompNotifier();
+
+  // Handles the syscall name on every architecture of the filter.
+  void On(const std::string &name, Handler handler);
+
+  // Answers one notification pending on listener, false once listener is
+  // unusable.
+  bool Handle(int listener) noexcept;
+
+ private:
+  const Handler *find(const seccomp_data &data) noexcept;
+
+  std::unordered_map<std::string, Handler> handlers;
+  // by architecture and number, nullptr for syscalls without handler
+  std::unordered_map<uint64_t, const Handler *> resolved;
+  // the kernel's structures may be larger than the ones of our headers
+  std::vector<char> request;
+  std::vector<char> response;
+  // SECCOMP_USER_NOTIF_FLAG_CONTINUE, linux 5.5, guessed from the release
+  // and cleared when the kernel rejects it
+  bool canContinue;
+};
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_SECCOMP_NOTIFY_H_ */
@@ -7,10 +7,51 @@
 #ifndef LINGLONG_BOX_SRC_CONTAINER_SECCOMP_H_
 #define LINGLONG_BOX_SRC_CONTAINER_SECCOMP_H_
 
+#include <linux/filter.h>
+#include <seccomp.h>
+
+#include <filesystem>
+#include <vector>
+
 #include "linglong/utils/oci_runtime.h"
 
 namespace linglong::container {
-int ConfigSeccomp(const std::optional<linglong::utils::Seccomp> &seccomp);
-}
+
+// Compiles seccomp into a BPF program. Programs are cached in
+// utils::cacheDirectory() under a hash of the profile, the native
+// architecture and the libseccomp version, so containers sharing a profile
+// skip libseccomp after the first launch. An entry stores the profile it was
+// compiled from and is only used if that matches seccomp exactly. Profiles
+// notifying the syscalls used to pass the listener on are refused.
+int CompileSeccomp(const utils::Seccomp &seccomp,
+                   std::vector<sock_filter> &program) noexcept;
+// CompileSeccomp with its cache in cacheDir.
+int CompileSeccomp(const utils::Seccomp &seccomp,
+                   std::vector<sock_filter> &program,
+                   const std::filesystem::path &cacheDir) noexcept;
+// What CompileSeccomp runs on a cache miss, libseccomp building the program.
+int CompileSeccompUncached(const utils::Seccomp &seccomp,
+                           std::vector<sock_filter> &program) noexcept;
+
+// The argument conditions of a syscall rule as libseccomp takes them. Throws
+// std::invalid_argument on an unknown operator.
+std::vector<struct scmp_arg_cmp> toScmpArgCmpArray(
+    const std::vector<utils::SyscallArg> &args);
+
+// Whether seccomp has SCMP_ACT_NOTIFY rules, which need a supervisor
+// listening for their notifications.
+bool SeccompNotifies(const utils::Seccomp &seccomp) noexcept;
+
+// Identifies a compiled program, so exec can check it installs the filter the
+// container was started with.
+uint64_t SeccompProgramHash(const std::vector<sock_filter> &program) noexcept;
+
+// Installs program for the calling process, setting no_new_privs first like
+// seccomp_load does. Does nothing for an empty program. If listener isn't
+// null it receives the notification fd of the filter (linux 5.0).
+int LoadSeccomp(const std::vector<sock_filter> &program,
+                int *listener = nullptr) noexcept;
+
+}  // namespace linglong::container
 
 #endif /* LINGLONG_BOX_SRC_CONTAINER_SECCOMP_H_ */
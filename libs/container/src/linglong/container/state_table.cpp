@@ -0,0 +1,611 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/container/state_table.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "linglong/utils/hash.h"
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+#include "ocppi/types/Generators.hpp"
+
+namespace linglong::container {
+
+namespace detail {
+
+constexpr uint64_t kStateTableMagic = 0x3654534f58424c4cULL;  // "LLBOXST6"
+constexpr size_t kStateTableSlots = 1024;
+constexpr size_t kStateIdSize = 256;
+constexpr size_t kStateStatusSize = 32;
+constexpr size_t kStateBundleSize = 2048;
+constexpr size_t kStateCgroupSize = 1024;
+
+// Every field starts out as zero bytes in a fresh file, which is a free slot.
+struct stateSlot {
+  // the slotState in the low 32 bits, the pid of its last writer above
+  std::atomic<uint64_t> owner;
+  // odd while the fields below are being written
+  std::atomic<uint32_t> sequence;
+  int32_t pid;
+  int32_t initPid;
+  uint64_t startTime;
+  uint64_t namespaces[3];
+  uint64_t stalls;
+  uint64_t lastStall;
+  uint64_t seccomp;
+  // lets lookups skip other IDs without copying the slot
+  std::atomic<uint64_t> idHash;
+  char id[kStateIdSize];
+  char status[kStateStatusSize];
+  char bundle[kStateBundleSize];
+  char cgroup[kStateCgroupSize];
+  char config[kStateBundleSize];
+};
+
+struct stateTableLayout {
+  std::atomic<uint64_t> magic;
+  stateSlot slots[kStateTableSlots];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "the state table is shared between processes");
+static_assert(std::is_standard_layout_v<stateTableLayout>);
+
+}  // namespace detail
+
+namespace {
+
+using detail::kStateTableSlots;
+using detail::stateSlot;
+
+enum slotState : uint32_t {
+  Free = 0,
+  Writing = 1,
+  Live = 2,
+  Deleted = 3,
+};
+
+constexpr int kReadAttempts = 64;
+constexpr int kWriteAttempts = 8;
+
+constexpr uint64_t makeOwner(slotState state, pid_t pid) noexcept {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(pid)) << 32) | state;
+}
+
+constexpr slotState stateOf(uint64_t owner) noexcept {
+  return static_cast<slotState>(owner & 0xffffffffU);
+}
+
+constexpr pid_t pidOf(uint64_t owner) noexcept {
+  return static_cast<pid_t>(owner >> 32);
+}
+
+uint64_t hashId(std::string_view id) noexcept {
+  return utils::Hasher{}.update(id).digest();
+}
+
+void copyField(char *field, size_t size, const std::string &value) noexcept {
+  std::memset(field, 0, size);
+  std::memcpy(field, value.data(), value.size());
+}
+
+std::string readField(const char *field, size_t size) {
+  return {field, ::strnlen(field, size)};
+}
+
+}  // namespace
+
+bool ContainerState::Alive() const noexcept {
+  if (pid <= 0) {
+    return false;
+  }
+  if (startTime == 0) {
+    return ::kill(pid, 0) == 0 || errno != ESRCH;
+  }
+  return utils::ProcessStartTime(pid) == startTime;
+}
+
+bool ContainerState::NamespacesAlive() const noexcept try {
+  if (initPid <= 0) {
+    return false;
+  }
+
+  auto proc = "/proc/" + std::to_string(initPid) + "/ns/";
+  for (const auto &[name, inode] : {std::pair{"user", userNs},
+                                    std::pair{"mnt", mountNs},
+                                    std::pair{"pid", pidNs}}) {
+    struct stat st {};
+    if (::stat((proc + name).c_str(), &st) == -1 || st.st_ino != inode) {
+      return false;
+    }
+  }
+  return true;
+} catch (const std::exception &e) {
+  logErr() << "failed to check namespaces of" << initPid << e.what();
+  return false;
+}
+
+std::filesystem::path StateTable::DefaultPath() noexcept {
+  return std::filesystem::path("/run") / "user" / std::to_string(getuid()) /
+         "linglong" / "box" / "state-v6.table";
+}
+
+std::optional<StateTable> StateTable::Open(
+    const std::filesystem::path &file) noexcept {
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  if (ec) {
+    logErr() << "failed to create" << file.parent_path().string()
+             << ec.message();
+    return std::nullopt;
+  }
+
+  int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    logErr() << "failed to open" << file.string() << utils::errnoString();
+    return std::nullopt;
+  }
+
+  constexpr auto size = sizeof(detail::stateTableLayout);
+  struct stat st {};
+  if (::fstat(fd, &st) == -1) {
+    logErr() << "failed to stat" << file.string() << utils::errnoString();
+    ::close(fd);
+    return std::nullopt;
+  }
+  // a fresh file is an empty table, and so is one that never got its size
+  if (static_cast<size_t>(st.st_size) != size &&
+      ::ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    logErr() << "failed to resize" << file.string() << utils::errnoString();
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  auto *addr =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    logErr() << "failed to map" << file.string() << utils::errnoString();
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  auto *layout = static_cast<detail::stateTableLayout *>(addr);
+  uint64_t magic = 0;
+  if (!layout->magic.compare_exchange_strong(magic,
+                                             detail::kStateTableMagic) &&
+      magic != detail::kStateTableMagic) {
+    logErr() << file.string() << "is not a state table";
+    ::munmap(addr, size);
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  return StateTable(fd, layout);
+}
+
+StateTable::StateTable(int fd, detail::stateTableLayout *layout) noexcept
+    : fd(fd), layout(layout) {}
+
+StateTable::StateTable(StateTable &&other) noexcept
+    : fd(std::exchange(other.fd, -1)),
+      layout(std::exchange(other.layout, nullptr)) {}
+
+StateTable &StateTable::operator=(StateTable &&other) noexcept {
+  if (this != &other) {
+    this->~StateTable();
+    fd = std::exchange(other.fd, -1);
+    layout = std::exchange(other.layout, nullptr);
+  }
+  return *this;
+}
+
+StateTable::~StateTable() {
+  if (layout != nullptr) {
+    ::munmap(layout, sizeof(detail::stateTableLayout));
+    layout = nullptr;
+  }
+  if (fd != -1) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// A seqlock read: copy the slot, then check that no writer started in the
+// meantime.
+bool StateTable::read(size_t index, ContainerState &state) const {
+  const auto &slot = layout->slots[index];
+  char id[detail::kStateIdSize];
+  char status[detail::kStateStatusSize];
+  char bundle[detail::kStateBundleSize];
+  char cgroup[detail::kStateCgroupSize];
+  char config[detail::kStateBundleSize];
+
+  for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+    auto before = slot.sequence.load(std::memory_order_acquire);
+    if ((before & 1U) != 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (stateOf(slot.owner.load(std::memory_order_acquire)) != Live) {
+      return false;
+    }
+
+    auto pid = slot.pid;
+    auto initPid = slot.initPid;
+    auto startTime = slot.startTime;
+    uint64_t namespaces[3];
+    std::memcpy(namespaces, slot.namespaces, sizeof(namespaces));
+    auto stalls = slot.stalls;
+    auto lastStall = slot.lastStall;
+    auto seccomp = slot.seccomp;
+    std::memcpy(id, slot.id, sizeof(id));
+    std::memcpy(status, slot.status, sizeof(status));
+    std::memcpy(bundle, slot.bundle, sizeof(bundle));
+    std::memcpy(cgroup, slot.cgroup, sizeof(cgroup));
+    std::memcpy(config, slot.config, sizeof(config));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) {
+      continue;
+    }
+
+    state.id = readField(id, sizeof(id));
+    state.status = readField(status, sizeof(status));
+    state.bundle = readField(bundle, sizeof(bundle));
+    state.cgroup = readField(cgroup, sizeof(cgroup));
+    state.config = readField(config, sizeof(config));
+    state.pid = pid;
+    state.startTime = startTime;
+    state.initPid = initPid;
+    state.userNs = namespaces[0];
+    state.mountNs = namespaces[1];
+    state.pidNs = namespaces[2];
+    state.stalls = stalls;
+    state.lastStall = lastStall;
+    state.seccomp = seccomp;
+    return true;
+  }
+
+  return false;
+}
+
+// Frees a slot whose writer died before it was done.
+bool StateTable::reclaim(size_t index) noexcept {
+  auto &slot = layout->slots[index];
+  auto owner = slot.owner.load(std::memory_order_acquire);
+  if (stateOf(owner) != Writing || pidOf(owner) == ::getpid()) {
+    return false;
+  }
+  if (::kill(pidOf(owner), 0) == 0 || errno != ESRCH) {
+    return false;
+  }
+  if (!slot.owner.compare_exchange_strong(owner,
+                                          makeOwner(Writing, ::getpid()))) {
+    return false;
+  }
+
+  logWan() << "reclaiming state slot" << index << "of dead writer"
+           << pidOf(owner);
+  auto sequence = slot.sequence.load(std::memory_order_relaxed);
+  if ((sequence & 1U) != 0) {
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+  }
+  slot.owner.store(makeOwner(Deleted, 0), std::memory_order_release);
+  collapse(index);
+  return true;
+}
+
+// A tombstone right before a free slot is on no probe sequence that still
+// leads to a live entry, so it is freed, and so are the tombstones before
+// it. Without this lookups would end up scanning the whole table. A Put that
+// claimed the free slot meanwhile notices, see retireDuplicates.
+void StateTable::collapse(size_t index) noexcept {
+  for (size_t count = 0; count < kStateTableSlots; ++count) {
+    auto next = (index + 1) % kStateTableSlots;
+    if (stateOf(layout->slots[next].owner.load(std::memory_order_acquire)) !=
+        Free) {
+      return;
+    }
+    auto expected = makeOwner(Deleted, 0);
+    if (!layout->slots[index].owner.compare_exchange_strong(
+            expected, makeOwner(Free, 0))) {
+      return;
+    }
+    index = (index + kStateTableSlots - 1) % kStateTableSlots;
+  }
+}
+
+// Two Puts of a new id may each claim a different vacant slot. The slot
+// first along the probe sequence is the one kept: later duplicates of index
+// are retired, and if an earlier one exists index itself is, which is then
+// reported by returning true. So is index if collapse freed a slot ahead of
+// it, lookups would stop there.
+bool StateTable::retireDuplicates(size_t index, uint64_t hash,
+                                  std::string_view id) {
+  auto position = (index + kStateTableSlots - hash % kStateTableSlots) %
+                  kStateTableSlots;
+  auto retireMine = [this, index] {
+    auto mine = makeOwner(Live, ::getpid());
+    if (layout->slots[index].owner.compare_exchange_strong(
+            mine, makeOwner(Deleted, 0))) {
+      collapse(index);
+    }
+    return true;
+  };
+  for (size_t probe = 0; probe < kStateTableSlots; ++probe) {
+    auto other = (hash + probe) % kStateTableSlots;
+    auto &slot = layout->slots[other];
+    auto owner = slot.owner.load(std::memory_order_acquire);
+    auto current = stateOf(owner);
+    if (current == Free) {
+      if (probe < position) {
+        return retireMine();
+      }
+      break;
+    }
+    if (other == index || current != Live ||
+        slot.idHash.load(std::memory_order_relaxed) != hash) {
+      continue;
+    }
+
+    ContainerState existing;
+    if (!read(other, existing) || existing.id != id) {
+      continue;
+    }
+    if (probe < position) {
+      return retireMine();
+    }
+    if (slot.owner.compare_exchange_strong(owner, makeOwner(Deleted, 0))) {
+      collapse(other);
+    }
+  }
+  return false;
+}
+
+bool StateTable::Put(const ContainerState &state) noexcept try {
+  if (state.id.empty() || state.id.size() >= detail::kStateIdSize ||
+      state.status.size() >= detail::kStateStatusSize ||
+      state.bundle.size() >= detail::kStateBundleSize ||
+      state.cgroup.size() >= detail::kStateCgroupSize ||
+      state.config.size() >= detail::kStateBundleSize) {
+    logErr() << "container" << state.id << "doesn't fit in the state table";
+    return false;
+  }
+
+  auto hash = hashId(state.id);
+  auto self = ::getpid();
+
+  for (int attempt = 0; attempt < kWriteAttempts; ++attempt) {
+    std::optional<size_t> target;
+    uint64_t expected = 0;
+    std::optional<size_t> vacant;
+    uint64_t vacantOwner = 0;
+
+    for (size_t probe = 0; probe < kStateTableSlots; ++probe) {
+      auto index = (hash + probe) % kStateTableSlots;
+      auto &slot = layout->slots[index];
+      auto owner = slot.owner.load(std::memory_order_acquire);
+      if (stateOf(owner) == Writing && reclaim(index)) {
+        owner = slot.owner.load(std::memory_order_acquire);
+      }
+
+      auto current = stateOf(owner);
+      if (current == Live &&
+          slot.idHash.load(std::memory_order_relaxed) == hash) {
+        ContainerState existing;
+        if (read(index, existing) && existing.id == state.id) {
+          target = index;
+          expected = owner;
+          break;
+        }
+      }
+      if ((current == Free || current == Deleted) && !vacant) {
+        vacant = index;
+        vacantOwner = owner;
+      }
+      if (current == Free) {
+        break;
+      }
+    }
+
+    // a full table gives up the entry of a container that is gone
+    if (!target && !vacant) {
+      for (size_t probe = 0; probe < kStateTableSlots; ++probe) {
+        auto index = (hash + probe) % kStateTableSlots;
+        auto owner =
+            layout->slots[index].owner.load(std::memory_order_acquire);
+        ContainerState existing;
+        if (stateOf(owner) == Live && read(index, existing) &&
+            !existing.Alive()) {
+          logWan() << "the state table is full, dropping" << existing.id
+                   << "which is no longer running";
+          vacant = index;
+          vacantOwner = owner;
+          break;
+        }
+      }
+    }
+
+    if (!target) {
+      if (!vacant) {
+        logErr() << "the state table is full," << state.id
+                 << "is not recorded";
+        return false;
+      }
+      target = vacant;
+      expected = vacantOwner;
+    }
+
+    auto &slot = layout->slots[*target];
+    if (!slot.owner.compare_exchange_strong(expected,
+                                            makeOwner(Writing, self))) {
+      continue;
+    }
+
+    auto sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.pid = state.pid;
+    slot.startTime = state.startTime;
+    slot.initPid = state.initPid;
+    slot.namespaces[0] = state.userNs;
+    slot.namespaces[1] = state.mountNs;
+    slot.namespaces[2] = state.pidNs;
+    slot.stalls = state.stalls;
+    slot.lastStall = state.lastStall;
+    slot.seccomp = state.seccomp;
+    slot.idHash.store(hash, std::memory_order_relaxed);
+    copyField(slot.id, sizeof(slot.id), state.id);
+    copyField(slot.status, sizeof(slot.status), state.status);
+    copyField(slot.bundle, sizeof(slot.bundle), state.bundle);
+    copyField(slot.cgroup, sizeof(slot.cgroup), state.cgroup);
+    copyField(slot.config, sizeof(slot.config), state.config);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    slot.owner.store(makeOwner(Live, self), std::memory_order_release);
+    if (!retireDuplicates(*target, hash, state.id)) {
+      return true;
+    }
+    // another Put of this id got an earlier slot, write there instead
+  }
+
+  logErr() << "couldn't claim a state slot for" << state.id;
+  return false;
+} catch (const std::exception &e) {
+  logErr() << "failed to update the state table" << e.what();
+  return false;
+}
+
+std::optional<ContainerState> StateTable::Get(
+    std::string_view id) const noexcept try {
+  auto hash = hashId(id);
+  for (size_t probe = 0; probe < kStateTableSlots; ++probe) {
+    auto index = (hash + probe) % kStateTableSlots;
+    const auto &slot = layout->slots[index];
+    auto current = stateOf(slot.owner.load(std::memory_order_acquire));
+    if (current == Free) {
+      break;
+    }
+    if (current != Live ||
+        slot.idHash.load(std::memory_order_relaxed) != hash) {
+      continue;
+    }
+
+    ContainerState state;
+    if (read(index, state) && state.id == id) {
+      return state;
+    }
+  }
+
+  return std::nullopt;
+} catch (const std::exception &e) {
+  logErr() << "failed to read the state table" << e.what();
+  return std::nullopt;
+}
+
+bool StateTable::Remove(std::string_view id, pid_t pid) noexcept try {
+  auto hash = hashId(id);
+  for (size_t probe = 0; probe < kStateTableSlots; ++probe) {
+    auto index = (hash + probe) % kStateTableSlots;
+    auto &slot = layout->slots[index];
+    auto owner = slot.owner.load(std::memory_order_acquire);
+    auto current = stateOf(owner);
+    if (current == Free) {
+      break;
+    }
+    if (current != Live ||
+        slot.idHash.load(std::memory_order_relaxed) != hash) {
+      continue;
+    }
+
+    ContainerState state;
+    if (!read(index, state) || state.id != id) {
+      continue;
+    }
+    if (pid != -1 && state.pid != pid) {
+      return false;
+    }
+
+    // readers that saw the slot live keep a consistent copy, no need to bump
+    // the sequence for a removal
+    if (!slot.owner.compare_exchange_strong(owner, makeOwner(Deleted, 0))) {
+      return false;
+    }
+    collapse(index);
+    return true;
+  }
+
+  return false;
+} catch (const std::exception &e) {
+  logErr() << "failed to update the state table" << e.what();
+  return false;
+}
+
+std::vector<ContainerState> StateTable::List() const {
+  std::vector<ContainerState> states;
+  for (size_t index = 0; index < kStateTableSlots; ++index) {
+    if (stateOf(layout->slots[index].owner.load(std::memory_order_acquire)) !=
+        Live) {
+      continue;
+    }
+
+    ContainerState state;
+    if (read(index, state)) {
+      states.push_back(std::move(state));
+    }
+  }
+
+  return states;
+}
+
+std::vector<ContainerState> StateTable::RemoveDead() {
+  std::vector<ContainerState> removed;
+  for (size_t index = 0; index < kStateTableSlots; ++index) {
+    auto current =
+        stateOf(layout->slots[index].owner.load(std::memory_order_acquire));
+    if (current == Writing) {
+      reclaim(index);
+      continue;
+    }
+    if (current != Live) {
+      continue;
+    }
+
+    ContainerState state;
+    if (read(index, state) && !state.Alive() &&
+        Remove(state.id, state.pid)) {
+      removed.push_back(std::move(state));
+    }
+  }
+
+  return removed;
+}
+
+nlohmann::json toJson(const std::vector<ContainerState> &states) {
+  auto result = nlohmann::json::array();
+  for (const auto &state : states) {
+    ocppi::types::ContainerListItem item = {
+        .bundle = state.bundle,
+        .id = state.id,
+        .pid = state.pid,
+        .status = state.status,
+    };
+    result.push_back(item);
+  }
+  return result;
+}
+
+}  // namespace linglong::container
@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_CONTAINER_STATE_TABLE_H_
+#define LINGLONG_BOX_SRC_CONTAINER_STATE_TABLE_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace linglong::container {
+
+struct ContainerState {
+  std::string id;
+  std::string bundle;
+  pid_t pid{-1};
+  // see utils::ProcessStartTime, 0 if unknown
+  uint64_t startTime{0};
+  std::string status{"running"};
+
+  // The ll-box init process inside the container, as seen from the host, and
+  // the inodes of the namespaces exec has to join. -1 and 0 until the
+  // container reported them.
+  pid_t initPid{-1};
+  uint64_t userNs{0};
+  uint64_t mountNs{0};
+  uint64_t pidNs{0};
+  // the cgroup of the container on the host, empty if it has none
+  std::string cgroup;
+  // the config it was started from and SeccompProgramHash of its filter, 0
+  // without one, exec installs the same filter
+  std::string config;
+  uint64_t seccomp{0};
+  // how often its PSI triggers fired, and when the last one did in seconds
+  // since the epoch
+  uint64_t stalls{0};
+  uint64_t lastStall{0};
+
+  // Whether pid is still the process that was recorded.
+  [[nodiscard]] bool Alive() const noexcept;
+  // Whether initPid still holds the recorded namespaces.
+  [[nodiscard]] bool NamespacesAlive() const noexcept;
+};
+
+namespace detail {
+struct stateTableLayout;
+}
+
+// The containers of the current user, in one file mapped by every ll-box
+// process. The slots form an open addressing hash table keyed by container
+// ID: lookups probe a few slots instead of reading a file per container.
+// Entries stay until their container exits or `ll-box gc` finds them dead,
+// commands check the liveness of the entries they use.
+//
+// Writers claim a slot with a compare-and-swap that records their pid, so a
+// slot left behind by a writer that died is taken back by the next one.
+// Readers never block, they retry a slot that changed while they copied it.
+class StateTable {
+ public:
+  // /run/user/$UID/linglong/box/state-v6.table
+  static std::filesystem::path DefaultPath() noexcept;
+
+  static std::optional<StateTable> Open(
+      const std::filesystem::path &file = DefaultPath()) noexcept;
+
+  StateTable(StateTable &&other) noexcept;
+  StateTable &operator=(StateTable &&other) noexcept;
+  StateTable(const StateTable &) = delete;
+  StateTable &operator=(const StateTable &) = delete;
+  ~StateTable();
+
+  // Adds the container or replaces the entry with the same ID. A full table
+  // makes room by dropping an entry whose container is no longer running.
+  // Fails when there is none or a field doesn't fit its slot.
+  bool Put(const ContainerState &state) noexcept;
+  [[nodiscard]] std::optional<ContainerState> Get(
+      std::string_view id) const noexcept;
+  // Removes the entry of id if it still belongs to pid, -1 matches any pid.
+  bool Remove(std::string_view id, pid_t pid = -1) noexcept;
+  [[nodiscard]] std::vector<ContainerState> List() const;
+  // Removes the entries of containers that are no longer running and
+  // returns them.
+  std::vector<ContainerState> RemoveDead();
+
+ private:
+  StateTable(int fd, detail::stateTableLayout *layout) noexcept;
+
+  bool read(size_t index, ContainerState &state) const;
+  bool reclaim(size_t index) noexcept;
+  void collapse(size_t index) noexcept;
+  bool retireDuplicates(size_t index, uint64_t hash, std::string_view id);
+
+  int fd{-1};
+  detail::stateTableLayout *layout{nullptr};
+};
+
+// The format of `ll-box list --format json`.
+nlohmann::json toJson(const std::vector<ContainerState> &states);
+
+}  // namespace linglong::container
+
+#endif /* LINGLONG_BOX_SRC_CONTAINER_STATE_TABLE_H_ */
@@ -0,0 +1,86 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_BINARY_CODEC_H_
+#define LINGLONG_BOX_SRC_UTIL_BINARY_CODEC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace linglong::utils {
+
+// The encoding of the on-disk caches in cacheDirectory(). Values are stored
+// in host byte order, the caches never leave the machine. Strings and
+// vectors are prefixed with their length.
+class BinaryWriter {
+ public:
+  template <class T>
+  void pod(T value) {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void str(std::string_view value) {
+    pod(static_cast<uint32_t>(value.size()));
+    buffer.append(value);
+  }
+
+  std::string buffer;
+};
+
+// Reads what BinaryWriter wrote, throws std::out_of_range instead of reading
+// past the end.
+class BinaryReader {
+ public:
+  BinaryReader(const char *data, size_t size) : cur(data), end(data + size) {}
+
+  template <class T>
+  T pod() {
+    T value;
+    take(&value, sizeof(value));
+    return value;
+  }
+
+  std::string str() {
+    auto size = pod<uint32_t>();
+    if (static_cast<size_t>(end - cur) < size) {
+      throw std::out_of_range("truncated cache entry");
+    }
+    std::string value{cur, size};
+    cur += size;
+    return value;
+  }
+
+  // vector lengths are checked against the remaining bytes before anything
+  // is reserved, each element takes at least one byte
+  uint32_t count() {
+    auto size = pod<uint32_t>();
+    if (static_cast<size_t>(end - cur) < size) {
+      throw std::out_of_range("truncated cache entry");
+    }
+    return size;
+  }
+
+  [[nodiscard]] bool done() const noexcept { return cur == end; }
+
+ private:
+  void take(void *out, size_t size) {
+    if (static_cast<size_t>(end - cur) < size) {
+      throw std::out_of_range("truncated cache entry");
+    }
+    std::memcpy(out, cur, size);
+    cur += size;
+  }
+
+  const char *cur;
+  const char *end;
+};
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_BINARY_CODEC_H_ */
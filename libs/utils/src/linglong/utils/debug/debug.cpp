@@ -16,8 +16,7 @@
 
 namespace linglong::utils::debug {
 
-#define DUMP_DBG(func, line) /*NOLINT*/ \
-  (linglong::utils::Logger(linglong::utils::Logger::Debug, func, line))
+#define DUMP_DBG(func, line) /*NOLINT*/ LINGLONG_LOG(Debug, func, line)
 
 void DumpFileInfo(const std::string &path) {
   DumpFileInfo1(path, __FUNCTION__, __LINE__);
@@ -0,0 +1,338 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/utils/event_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+
+#include "linglong/utils/logger.h"
+#include "linglong/utils/platform.h"
+
+namespace linglong::utils {
+
+namespace {
+
+// events and signals taken per read, more are picked up by the next round
+constexpr int kMaxEvents = 32;
+constexpr int kMaxSignals = 16;
+
+}  // namespace
+
+std::unique_ptr<EventLoop> EventLoop::Create() noexcept {
+  sigset_t original;
+  if (::sigprocmask(SIG_BLOCK, nullptr, &original) == -1) {
+    logErr() << "sigprocmask failed" << errnoString();
+    return nullptr;
+  }
+
+  int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd == -1) {
+    logErr() << "epoll_create1 failed" << errnoString();
+    return nullptr;
+  }
+
+  sigset_t empty;
+  sigemptyset(&empty);
+  int signalFd = ::signalfd(-1, &empty, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (signalFd == -1) {
+    logErr() << "signalfd failed" << errnoString();
+    ::close(epollFd);
+    return nullptr;
+  }
+
+  std::unique_ptr<EventLoop> loop{
+      new EventLoop(epollFd, signalFd, original)};
+  if (!loop->add(signalFd, EPOLLIN,
+                 [raw = loop.get()](uint32_t) { raw->readSignals(); })) {
+    return nullptr;
+  }
+  return loop;
+}
+
+EventLoop::EventLoop(int epollFd, int signalFd,
+                     const sigset_t &originalMask) noexcept
+    : epollFd(epollFd), signalFd(signalFd), originalMask(originalMask) {
+  sigemptyset(&mask);
+}
+
+EventLoop::~EventLoop() {
+  for (const auto &[id, handler] : timers) {
+    ::close(id);
+  }
+  ::close(signalFd);
+  ::close(epollFd);
+
+  // signals still pending get their usual dispositions from here on
+  if (::sigprocmask(SIG_SETMASK, &originalMask, nullptr) == -1) {
+    logWan() << "sigprocmask failed" << errnoString();
+  }
+}
+
+bool EventLoop::add(int fd, uint32_t events, FdHandler handler) noexcept {
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = fd;
+  if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    logErr() << "epoll_ctl add" << fd << "failed" << errnoString();
+    return false;
+  }
+  sources[fd] = std::make_shared<FdHandler>(std::move(handler));
+  return true;
+}
+
+bool EventLoop::block(int signo) noexcept {
+  if (sigismember(&mask, signo) == 1) {
+    return true;
+  }
+
+  sigset_t single;
+  sigemptyset(&single);
+  sigaddset(&single, signo);
+  if (::sigprocmask(SIG_BLOCK, &single, nullptr) == -1) {
+    logErr() << "sigprocmask failed" << errnoString();
+    return false;
+  }
+
+  sigaddset(&mask, signo);
+  if (::signalfd(signalFd, &mask, 0) == -1) {
+    logErr() << "signalfd failed" << errnoString();
+    sigdelset(&mask, signo);
+    return false;
+  }
+  return true;
+}
+
+bool EventLoop::WatchSignal(int signo, SignalHandler handler) noexcept {
+  signalHandlers[signo] = std::move(handler);
+  return block(signo);
+}
+
+bool EventLoop::ForwardSignals(std::initializer_list<int> signals,
+                               pid_t pid) noexcept {
+  for (auto signo : signals) {
+    auto forward = [this, pid](const signalfd_siginfo &info) {
+      logDbg() << "forward signal" << info.ssi_signo << "to" << pid;
+      Signal(pid, static_cast<int>(info.ssi_signo));
+    };
+    if (!WatchSignal(signo, forward)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool EventLoop::WatchChild(pid_t pid, int pidfd,
+                           ChildHandler handler) noexcept {
+  if (!block(SIGCHLD)) {
+    return false;
+  }
+
+  children[pid] = child{.pidfd = pidfd, .handler = std::move(handler)};
+  if (pidfd != -1 &&
+      !add(pidfd, EPOLLIN, [this](uint32_t) { reapPending = true; })) {
+    children[pid].pidfd = -1;
+  }
+
+  // the child may have exited before SIGCHLD was blocked
+  reapPending = true;
+  return true;
+}
+
+int EventLoop::AddTimer(std::chrono::milliseconds timeout,
+                        TimerHandler handler) noexcept {
+  int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (fd == -1) {
+    logErr() << "timerfd_create failed" << errnoString();
+    return -1;
+  }
+
+  itimerspec spec{};
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  spec.it_value.tv_sec = seconds.count();
+  spec.it_value.tv_nsec =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - seconds)
+          .count();
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    // a zero it_value disarms the timer
+    spec.it_value.tv_nsec = 1;
+  }
+
+  auto fire = [this, fd](uint32_t) {
+    uint64_t expirations{0};
+    if (::read(fd, &expirations, sizeof(expirations)) == -1) {
+      // cancelled, and the fd reused, after the wakeup was reported
+      return;
+    }
+
+    auto it = timers.find(fd);
+    if (it == timers.end()) {
+      return;
+    }
+    auto handler = std::move(it->second);
+    CancelTimer(fd);
+    handler();
+  };
+
+  if (::timerfd_settime(fd, 0, &spec, nullptr) == -1) {
+    logErr() << "timerfd_settime failed" << errnoString();
+    ::close(fd);
+    return -1;
+  }
+  if (!add(fd, EPOLLIN, fire)) {
+    ::close(fd);
+    return -1;
+  }
+  timers[fd] = std::move(handler);
+  return fd;
+}
+
+void EventLoop::CancelTimer(int id) noexcept {
+  if (timers.erase(id) == 0) {
+    return;
+  }
+  UnwatchFd(id);
+  ::close(id);
+}
+
+bool EventLoop::WatchFd(int fd, uint32_t events, FdHandler handler) noexcept {
+  return add(fd, events, std::move(handler));
+}
+
+void EventLoop::UnwatchFd(int fd) noexcept {
+  if (sources.erase(fd) == 0) {
+    return;
+  }
+  if (::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    logWan() << "epoll_ctl del" << fd << "failed" << errnoString();
+  }
+}
+
+bool EventLoop::Signal(pid_t pid, int signo) noexcept {
+  auto it = children.find(pid);
+  if (it == children.end()) {
+    return false;
+  }
+
+  auto ret = it->second.pidfd != -1
+                 ? PidfdSendSignal(it->second.pidfd, signo)
+                 : ::kill(pid, signo);
+  if (ret == -1) {
+    logWan() << "send signal" << signo << "to" << pid << "failed"
+             << errnoString();
+    return false;
+  }
+  return true;
+}
+
+void EventLoop::readSignals() noexcept {
+  std::array<signalfd_siginfo, kMaxSignals> infos{};
+  while (true) {
+    auto size = ::read(signalFd, infos.data(), sizeof(infos));
+    if (size == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        logErr() << "read signalfd failed" << errnoString();
+      }
+      return;
+    }
+
+    auto count = static_cast<size_t>(size) / sizeof(signalfd_siginfo);
+    for (size_t i = 0; i < count && !stopped; ++i) {
+      const auto &info = infos[i];
+      if (info.ssi_signo == SIGCHLD) {
+        reapPending = true;
+      }
+
+      auto it = signalHandlers.find(static_cast<int>(info.ssi_signo));
+      if (it != signalHandlers.end()) {
+        auto handler = it->second;
+        handler(info);
+      }
+    }
+    if (count < infos.size()) {
+      return;
+    }
+  }
+}
+
+void EventLoop::reap() noexcept {
+  reapPending = false;
+  int wstatus{0};
+  while (true) {
+    auto pid = ::waitpid(-1, &wstatus, WNOHANG);
+    if (pid == 0) {
+      return;
+    }
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != ECHILD) {
+        logErr() << "waitpid failed" << errnoString();
+      }
+      return;
+    }
+
+    auto it = children.find(pid);
+    if (it == children.end()) {
+      logDbg() << "reaped" << pid;
+      continue;
+    }
+
+    auto watched = std::move(it->second);
+    children.erase(it);
+    if (watched.pidfd != -1) {
+      UnwatchFd(watched.pidfd);
+    }
+    watched.handler(pid, wstatus);
+  }
+}
+
+int EventLoop::Run() noexcept {
+  stopped = false;
+  std::array<epoll_event, kMaxEvents> events{};
+  while (!stopped) {
+    if (reapPending) {
+      reap();
+      continue;
+    }
+
+    auto count = ::epoll_wait(epollFd, events.data(), kMaxEvents, -1);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logErr() << "epoll_wait failed" << errnoString();
+      return -1;
+    }
+
+    for (int i = 0; i < count && !stopped; ++i) {
+      auto it = sources.find(events[i].data.fd);
+      if (it == sources.end()) {
+        // removed by a handler earlier in this batch
+        continue;
+      }
+      auto handler = it->second;
+      (*handler)(events[i].events);
+    }
+  }
+  return exitCode;
+}
+
+void EventLoop::Stop(int code) noexcept {
+  exitCode = code;
+  stopped = true;
+}
+
+}  // namespace linglong::utils
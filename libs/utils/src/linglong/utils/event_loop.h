@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_EVENT_LOOP_H_
+#define LINGLONG_BOX_SRC_UTIL_EVENT_LOOP_H_
+
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <unordered_map>
+
+namespace linglong::utils {
+
+// EventLoop drives the supervising ll-box processes. It waits in a single
+// epoll_wait for signals (through a signalfd), exiting children (pidfds, or
+// SIGCHLD when there are none), timers (timerfds) and any other fd, and runs
+// the handlers one at a time in the order the events were read.
+//
+// Children are reaped in batches: after each wakeup every exited child is
+// collected with waitpid(WNOHANG), however many exits the wakeup stands for.
+// Signals are forwarded before the batch is reaped, so a pid is never
+// signalled after it has been released for reuse.
+class EventLoop {
+ public:
+  using SignalHandler = std::function<void(const signalfd_siginfo &info)>;
+  using ChildHandler = std::function<void(pid_t pid, int wstatus)>;
+  using TimerHandler = std::function<void()>;
+  using FdHandler = std::function<void(uint32_t events)>;
+
+  // nullptr if the epoll or signalfd instance couldn't be created.
+  static std::unique_ptr<EventLoop> Create() noexcept;
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+  // Closes the fds of the loop and restores the signal mask it changed.
+  ~EventLoop();
+
+  // Blocks signo and runs handler when it arrives instead of its disposition.
+  // Processes forked afterwards inherit the blocked mask.
+  bool WatchSignal(int signo, SignalHandler handler) noexcept;
+  // Forwards the signals to the watched child pid until it is reaped.
+  bool ForwardSignals(std::initializer_list<int> signals, pid_t pid) noexcept;
+  // Runs handler with the wait status once pid is reaped. pidfd, if not -1,
+  // stays owned by the caller and must outlive the watch.
+  bool WatchChild(pid_t pid, int pidfd, ChildHandler handler) noexcept;
+  // Runs handler once after timeout, returns an id for CancelTimer or -1.
+  int AddTimer(std::chrono::milliseconds timeout,
+               TimerHandler handler) noexcept;
+  void CancelTimer(int id) noexcept;
+  // fd stays owned by the caller, UnwatchFd it before closing it.
+  bool WatchFd(int fd, uint32_t events, FdHandler handler) noexcept;
+  void UnwatchFd(int fd) noexcept;
+
+  // Sends signo to the watched child pid, through its pidfd if it has one.
+  // Does nothing once the child has been reaped.
+  bool Signal(pid_t pid, int signo) noexcept;
+
+  // Runs the handlers until one of them calls Stop, returns the code given
+  // to Stop or -1 if waiting failed.
+  int Run() noexcept;
+  void Stop(int code) noexcept;
+
+ private:
+  struct child {
+    int pidfd{-1};
+    ChildHandler handler;
+  };
+
+  EventLoop(int epollFd, int signalFd, const sigset_t &originalMask) noexcept;
+
+  bool add(int fd, uint32_t events, FdHandler handler) noexcept;
+  bool block(int signo) noexcept;
+  void readSignals() noexcept;
+  void reap() noexcept;
+
+  int epollFd{-1};
+  int signalFd{-1};
+  sigset_t mask{};
+  sigset_t originalMask{};
+  bool reapPending{false};
+  bool stopped{false};
+  int exitCode{0};
+  std::unordered_map<int, std::shared_ptr<FdHandler>> sources;
+  std::unordered_map<int, SignalHandler> signalHandlers;
+  std::unordered_map<pid_t, child> children;
+  std::unordered_map<int, TimerHandler> timers;
+};
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_EVENT_LOOP_H_ */
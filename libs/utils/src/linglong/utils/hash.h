@@ -0,0 +1,54 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_HASH_H_
+#define LINGLONG_BOX_SRC_UTIL_HASH_H_
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace linglong::utils {
+
+// 64-bit FNV-1a, used to key on-disk caches. It is not meant to resist
+// deliberate collisions, cached data must still be validated on load.
+class Hasher {
+ public:
+  constexpr Hasher &update(std::string_view data) noexcept {
+    for (auto c : data) {
+      value ^= static_cast<uint8_t>(c);
+      value *= kPrime;
+    }
+    // terminate every string, so ("ab", "c") and ("a", "bc") differ
+    value ^= 0xffU;
+    value *= kPrime;
+    return *this;
+  }
+
+  template <class T,
+            std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>,
+                             bool> = true>
+  constexpr Hasher &update(T data) noexcept {
+    auto bits = static_cast<uint64_t>(data);
+    for (unsigned int i = 0; i < sizeof(T); ++i) {
+      value ^= (bits >> (i * 8)) & 0xffU;
+      value *= kPrime;
+    }
+    return *this;
+  }
+
+  [[nodiscard]] constexpr uint64_t digest() const noexcept { return value; }
+
+ private:
+  static constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ULL;
+  static constexpr uint64_t kPrime = 0x100000001b3ULL;
+
+  uint64_t value{kOffsetBasis};
+};
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_HASH_H_ */
@@ -0,0 +1,610 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/utils/json_backend.h"
+
+#ifdef LINGLONG_BOX_ENABLE_SIMDJSON
+#include <simdjson.h>
+
+#include <iterator>
+#endif
+
+namespace linglong::utils {
+
+#ifdef LINGLONG_BOX_ENABLE_SIMDJSON
+
+namespace {
+
+namespace od = ::simdjson::ondemand;
+
+// The decoders walk every object once in document order and dispatch on the
+// key, like nlohmann::json the last one of duplicated keys wins. Required
+// fields are tracked and reported after the loop, the same ones from_json
+// reads with at().
+
+void decode(od::object &obj, Root &o);
+void decode(od::object &obj, Process &o);
+void decode(od::object &obj, Mount &o);
+void decode(od::object &obj, Namespace &o);
+void decode(od::object &obj, IDMap &o);
+void decode(od::object &obj, SyscallArg &o);
+void decode(od::object &obj, Syscall &o);
+void decode(od::object &obj, Seccomp &o);
+void decode(od::object &obj, ResourcePids &o);
+void decode(od::object &obj, WeightDevice &o);
+void decode(od::object &obj, ThrottleDevice &o);
+void decode(od::object &obj, PressureTrigger &o);
+void decode(od::object &obj, Resources &o);
+void decode(od::object &obj, Linux &o);
+void decode(od::object &obj, Hook &o);
+void decode(od::object &obj, Hooks &o);
+void decode(od::object &obj, Runtime &o);
+
+[[noreturn]] void missing(const char *type, const char *field) {
+  throw std::out_of_range(std::string{"missing field "} + field + " in " +
+                          type);
+}
+
+std::string toString(od::value value) {
+  return std::string{std::string_view{value.get_string()}};
+}
+
+str_vec toStrings(od::value value) {
+  str_vec result;
+  for (auto item : value.get_array()) {
+    result.emplace_back(std::string_view{item.get_string()});
+  }
+  return result;
+}
+
+template <class T>
+std::vector<T> toVector(od::value value) {
+  std::vector<T> result;
+  for (auto item : value.get_array()) {
+    od::object obj = item.get_object();
+    decode(obj, result.emplace_back());
+  }
+  return result;
+}
+
+// utils::optional() treats both null and {} as absent
+template <class T>
+std::optional<T> toOptionalObject(od::value value) {
+  if (value.is_null()) {
+    return std::nullopt;
+  }
+
+  od::object obj = value.get_object();
+  if (obj.is_empty()) {
+    return std::nullopt;
+  }
+
+  T result;
+  decode(obj, result);
+  return result;
+}
+
+template <class F>
+auto toOptional(od::value value, F convert)
+    -> std::optional<decltype(convert(value))> {
+  if (value.is_null()) {
+    return std::nullopt;
+  }
+
+  if (value.type() == od::json_type::object) {
+    od::object obj = value.get_object();
+    if (obj.is_empty()) {
+      return std::nullopt;
+    }
+    throw ::simdjson::simdjson_error(::simdjson::INCORRECT_TYPE);
+  }
+
+  return convert(value);
+}
+
+void decode(od::object &obj, Root &o) {
+  bool path{false};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "path") {
+      o.path = toString(field.value());
+      path = true;
+    } else if (key == "readonly") {
+      o.readonly = toOptional(field.value(),
+                              [](od::value v) { return bool{v.get_bool()}; });
+    }
+  }
+
+  if (!path) {
+    missing("root", "path");
+  }
+}
+
+void decode(od::object &obj, Process &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "args") {
+      o.args = toStrings(field.value());
+      found |= 1U;
+    } else if (key == "env") {
+      o.env = toStrings(field.value());
+      found |= 2U;
+    } else if (key == "cwd") {
+      o.cwd = toString(field.value());
+      found |= 4U;
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("process", "args");
+  }
+  if ((found & 2U) == 0) {
+    missing("process", "env");
+  }
+  if ((found & 4U) == 0) {
+    missing("process", "cwd");
+  }
+}
+
+void decode(od::object &obj, Mount &o) {
+  unsigned int found{0};
+  str_vec options;
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "destination") {
+      o.destination = toString(field.value());
+      found |= 1U;
+    } else if (key == "type") {
+      o.type = toString(field.value());
+      found |= 2U;
+    } else if (key == "source") {
+      o.source = toString(field.value());
+      found |= 4U;
+    } else if (key == "options") {
+      options = toStrings(field.value());
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("mount", "destination");
+  }
+  if ((found & 2U) == 0) {
+    missing("mount", "type");
+  }
+  if ((found & 4U) == 0) {
+    missing("mount", "source");
+  }
+
+  o.fsType = toMountType(o.type);
+  if (o.fsType == Mount::Bind) {
+    o.flags = MS_BIND;
+  }
+  o.data = {};
+  for (const auto &opt : options) {
+    applyMountOption(o, opt);
+  }
+}
+
+void decode(od::object &obj, Namespace &o) {
+  std::optional<std::string> type;
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "type") {
+      type = toString(field.value());
+    }
+  }
+
+  if (!type) {
+    missing("namespace", "type");
+  }
+  o.type = toNamespaceType(*type);
+}
+
+void decode(od::object &obj, IDMap &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "hostID") {
+      o.hostID = field.value().get_uint64();
+    } else if (key == "containerID") {
+      o.containerID = field.value().get_uint64();
+    } else if (key == "size") {
+      o.size = field.value().get_uint64();
+    }
+  }
+}
+
+void decode(od::object &obj, SyscallArg &o) {
+  unsigned int found{0};
+  o.valueTwo = 0;
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "index") {
+      o.index = static_cast<u_int>(uint64_t{field.value().get_uint64()});
+      found |= 1U;
+    } else if (key == "value") {
+      o.value = field.value().get_uint64();
+      found |= 2U;
+    } else if (key == "valueTwo") {
+      o.valueTwo = field.value().get_uint64();
+    } else if (key == "op") {
+      o.op = toString(field.value());
+      found |= 4U;
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("syscall argument", "index");
+  }
+  if ((found & 2U) == 0) {
+    missing("syscall argument", "value");
+  }
+  if ((found & 4U) == 0) {
+    missing("syscall argument", "op");
+  }
+}
+
+void decode(od::object &obj, Syscall &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "names") {
+      o.names = toStrings(field.value());
+      found |= 1U;
+    } else if (key == "action") {
+      o.action = toString(field.value());
+      found |= 2U;
+    } else if (key == "args") {
+      o.args = toVector<SyscallArg>(field.value());
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("syscall", "names");
+  }
+  if ((found & 2U) == 0) {
+    missing("syscall", "action");
+  }
+}
+
+void decode(od::object &obj, Seccomp &o) {
+  bool defaultAction{false};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "defaultAction") {
+      o.defaultAction = toString(field.value());
+      defaultAction = true;
+    } else if (key == "architectures") {
+      o.architectures = toStrings(field.value());
+    } else if (key == "syscalls") {
+      o.syscalls = toVector<Syscall>(field.value());
+    }
+  }
+
+  if (!defaultAction) {
+    missing("seccomp", "defaultAction");
+  }
+}
+
+void decode(od::object &obj, ResourceMemory &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "limit") {
+      o.limit = field.value().get_int64();
+    } else if (key == "reservation") {
+      o.reservation = field.value().get_int64();
+    } else if (key == "swap") {
+      o.swap = field.value().get_int64();
+    }
+  }
+}
+
+void decode(od::object &obj, ResourceCPU &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "shares") {
+      o.shares = field.value().get_uint64();
+    } else if (key == "quota") {
+      o.quota = field.value().get_int64();
+    } else if (key == "period") {
+      o.period = field.value().get_uint64();
+    } else if (key == "cpus") {
+      o.cpus = toString(field.value());
+    } else if (key == "mems") {
+      o.mems = toString(field.value());
+    }
+  }
+}
+
+void decode(od::object &obj, ResourcePids &o) {
+  bool limit{false};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "limit") {
+      o.limit = field.value().get_int64();
+      limit = true;
+    }
+  }
+
+  if (!limit) {
+    missing("pids", "limit");
+  }
+}
+
+void decode(od::object &obj, WeightDevice &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "major") {
+      o.major = field.value().get_int64();
+      found |= 1U;
+    } else if (key == "minor") {
+      o.minor = field.value().get_int64();
+      found |= 2U;
+    } else if (key == "weight") {
+      o.weight = static_cast<uint16_t>(uint64_t{field.value().get_uint64()});
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("weight device", "major");
+  }
+  if ((found & 2U) == 0) {
+    missing("weight device", "minor");
+  }
+}
+
+void decode(od::object &obj, ThrottleDevice &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "major") {
+      o.major = field.value().get_int64();
+      found |= 1U;
+    } else if (key == "minor") {
+      o.minor = field.value().get_int64();
+      found |= 2U;
+    } else if (key == "rate") {
+      o.rate = field.value().get_uint64();
+      found |= 4U;
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("throttle device", "major");
+  }
+  if ((found & 2U) == 0) {
+    missing("throttle device", "minor");
+  }
+  if ((found & 4U) == 0) {
+    missing("throttle device", "rate");
+  }
+}
+
+void decode(od::object &obj, ResourceBlockIO &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "weight") {
+      o.weight = static_cast<uint16_t>(uint64_t{field.value().get_uint64()});
+    } else if (key == "weightDevice") {
+      o.weightDevice = toVector<WeightDevice>(field.value());
+    } else if (key == "throttleReadBpsDevice") {
+      o.throttleReadBpsDevice = toVector<ThrottleDevice>(field.value());
+    } else if (key == "throttleWriteBpsDevice") {
+      o.throttleWriteBpsDevice = toVector<ThrottleDevice>(field.value());
+    } else if (key == "throttleReadIOPSDevice") {
+      o.throttleReadIOPSDevice = toVector<ThrottleDevice>(field.value());
+    } else if (key == "throttleWriteIOPSDevice") {
+      o.throttleWriteIOPSDevice = toVector<ThrottleDevice>(field.value());
+    }
+  }
+}
+
+void decode(od::object &obj, PressureTrigger &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "resource") {
+      o.resource = toString(field.value());
+      found |= 1U;
+    } else if (key == "type") {
+      o.type = toString(field.value());
+    } else if (key == "threshold") {
+      o.threshold = field.value().get_uint64();
+      found |= 2U;
+    } else if (key == "window") {
+      o.window = field.value().get_uint64();
+    } else if (key == "action") {
+      o.action = toString(field.value());
+    } else if (key == "hook") {
+      o.hook = toOptionalObject<Hook>(field.value());
+    } else if (key == "memoryHigh") {
+      o.memoryHigh = field.value().get_int64();
+    } else if (key == "thawAfter") {
+      o.thawAfter = field.value().get_uint64();
+    }
+  }
+
+  if ((found & 1U) == 0) {
+    missing("pressure trigger", "resource");
+  }
+  if ((found & 2U) == 0) {
+    missing("pressure trigger", "threshold");
+  }
+}
+
+void decode(od::object &obj, Resources &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "cpu") {
+      od::object cpu = field.value().get_object();
+      o.cpu = ResourceCPU();
+      decode(cpu, o.cpu);
+    } else if (key == "memory") {
+      od::object memory = field.value().get_object();
+      o.memory = ResourceMemory();
+      decode(memory, o.memory);
+    } else if (key == "pids") {
+      o.pids = toOptionalObject<ResourcePids>(field.value());
+    } else if (key == "blockIO") {
+      od::object blockIO = field.value().get_object();
+      o.blockIO = ResourceBlockIO();
+      decode(blockIO, o.blockIO);
+    } else if (key == "unified") {
+      o.unified.clear();
+      for (auto file : field.value().get_object()) {
+        std::string name{std::string_view{file.unescaped_key()}};
+        o.unified[name] = toString(file.value());
+      }
+    } else if (key == "pressureTriggers") {
+      o.pressureTriggers = toVector<PressureTrigger>(field.value());
+    }
+  }
+}
+
+void decode(od::object &obj, Linux &o) {
+  bool namespaces{false};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "namespaces") {
+      o.namespaces = toVector<Namespace>(field.value());
+      namespaces = true;
+    } else if (key == "uidMappings") {
+      o.uidMappings = toVector<IDMap>(field.value());
+    } else if (key == "gidMappings") {
+      o.gidMappings = toVector<IDMap>(field.value());
+    } else if (key == "seccomp") {
+      o.seccomp = toOptionalObject<Seccomp>(field.value());
+    } else if (key == "cgroupsPath") {
+      o.cgroupsPath = toString(field.value());
+    } else if (key == "resources") {
+      od::object resources = field.value().get_object();
+      o.resources = Resources();
+      decode(resources, o.resources);
+    }
+  }
+
+  if (!namespaces) {
+    missing("linux", "namespaces");
+  }
+}
+
+void decode(od::object &obj, Hook &o) {
+  bool path{false};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "path") {
+      o.path = toString(field.value());
+      path = true;
+    } else if (key == "args") {
+      o.args = toOptional(field.value(), toStrings);
+    } else if (key == "env") {
+      o.env = toOptional(field.value(), toStrings);
+    } else if (key == "timeout") {
+      o.timeout = field.value().get_int64();
+    } else if (key == "independent") {
+      o.independent = field.value().get_bool();
+    }
+  }
+
+  if (!path) {
+    missing("hook", "path");
+  }
+}
+
+void decode(od::object &obj, Hooks &o) {
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    auto hooks = [&field] {
+      return toOptional(field.value(), toVector<Hook>);
+    };
+    if (key == "prestart") {
+      o.prestart = hooks();
+    } else if (key == "poststart") {
+      o.poststart = hooks();
+    } else if (key == "poststop") {
+      o.poststop = hooks();
+    } else if (key == "startContainer") {
+      o.startContainer = hooks();
+    }
+  }
+}
+
+void decode(od::object &obj, Runtime &o) {
+  unsigned int found{0};
+  for (auto field : obj) {
+    std::string_view key = field.unescaped_key();
+    if (key == "ociVersion") {
+      o.version = toString(field.value());
+      found |= 1U;
+    } else if (key == "hostname") {
+      o.hostname = toString(field.value());
+      found |= 2U;
+    } else if (key == "process") {
+      od::object process = field.value().get_object();
+      decode(process, o.process);
+      found |= 4U;
+    } else if (key == "mounts") {
+      o.mounts = toOptional(field.value(), toVector<Mount>);
+    } else if (key == "linux") {
+      od::object linux = field.value().get_object();
+      decode(linux, o.linux);
+      found |= 8U;
+    } else if (key == "root") {
+      od::object root = field.value().get_object();
+      decode(root, o.root);
+      found |= 16U;
+    } else if (key == "hooks") {
+      o.hooks = toOptionalObject<Hooks>(field.value());
+    }
+  }
+
+  const char *required[] = {"ociVersion", "hostname", "process", "linux",
+                            "root"};
+  for (unsigned int i = 0; i < std::size(required); ++i) {
+    if ((found & (1U << i)) == 0) {
+      missing("config", required[i]);
+    }
+  }
+}
+
+od::parser &parser() {
+  static od::parser instance;
+  return instance;
+}
+
+void ensureAtEnd(od::document &doc) {
+  if (!doc.at_end()) {
+    throw ::simdjson::simdjson_error(::simdjson::TRAILING_CONTENT);
+  }
+}
+
+}  // namespace
+
+Runtime parseRuntimeSimdjson(const std::string &content) {
+  ::simdjson::padded_string json{content};
+  od::document doc = parser().iterate(json);
+  od::object obj = doc.get_object();
+
+  Runtime runtime;
+  decode(obj, runtime);
+  ensureAtEnd(doc);
+  return runtime;
+}
+
+Runtime parseRuntime(const std::string &content) {
+  return parseRuntimeSimdjson(content);
+}
+
+#else
+
+Runtime parseRuntime(const std::string &content) {
+  return nlohmann::json::parse(content).get<Runtime>();
+}
+
+#endif
+
+}  // namespace linglong::utils
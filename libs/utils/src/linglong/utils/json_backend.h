@@ -0,0 +1,28 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_JSON_BACKEND_H_
+#define LINGLONG_BOX_SRC_UTIL_JSON_BACKEND_H_
+
+#include <string>
+
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::utils {
+
+// Parsers for the OCI config. Built with ENABLE_SIMDJSON they use simdjson's
+// on-demand API, otherwise nlohmann::json. Both backends accept the same
+// documents, ignore unknown fields and throw a std::exception on missing
+// fields or mismatched types.
+Runtime parseRuntime(const std::string &content);
+
+#ifdef LINGLONG_BOX_ENABLE_SIMDJSON
+Runtime parseRuntimeSimdjson(const std::string &content);
+#endif
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_JSON_BACKEND_H_ */
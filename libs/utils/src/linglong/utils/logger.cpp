@@ -6,12 +6,496 @@
 
 #include "linglong/utils/logger.h"
 
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <sys/syslog.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "linglong/utils/common.h"
 
 namespace linglong::utils {
 
+namespace {
+
+constexpr size_t kLogRingSlots = 256;
+constexpr size_t kLogRecordSize = 1024;
+constexpr size_t kLogBatchSize = 64;
+constexpr int kLogDrainIntervalMs = 100;
+
+// The readlink behind GetPidnsPid is the most expensive part of a record,
+// its result only changes with the pid.
+const std::string &pidnsPrefix() {
+  thread_local pid_t pid = 0;
+  thread_local std::string prefix;
+  if (auto current = ::getpid(); current != pid) {
+    pid = current;
+    prefix = GetPidnsPid();
+  }
+  return prefix;
+}
+
+int toSyslogLevel(Logger::Level level) {
+  switch (level) {
+    case Logger::Debug:
+      return LOG_DEBUG;
+    case Logger::Info:
+      return LOG_INFO;
+    case Logger::Warning:
+      return LOG_WARNING;
+    case Logger::Error:
+    case Logger::Fatal:
+      return LOG_ERR;
+  }
+  return LOG_DEBUG;
+}
+
+// The line written to stdout, without the trailing newline.
+void formatLine(std::string &out, Logger::Level level, std::string_view pidns,
+                const char *function, int line, std::string_view message) {
+  const char *prefix = "[DBG |";
+  const char *color = "";
+  switch (level) {
+    case Logger::Debug:
+      break;
+    case Logger::Info:
+      prefix = "[IFO |";
+      color = "\033[1;96m";
+      break;
+    case Logger::Warning:
+      prefix = "[WAN |";
+      color = "\033[1;93m";
+      break;
+    case Logger::Error:
+      prefix = "[ERR |";
+      color = "\033[1;31m";
+      break;
+    case Logger::Fatal:
+      prefix = "[FAL |";
+      color = "\033[1;91m";
+      break;
+  }
+
+  out.append(color)
+      .append(prefix)
+      .append(" ")
+      .append(pidns)
+      .append(" | ")
+      .append(function)
+      .append(":")
+      .append(std::to_string(line))
+      .append(" ] ")
+      .append(message);
+  if (level != Logger::Debug) {
+    out.append("\033[0m");
+  }
+}
+
+struct logRecord {
+  std::atomic<uint64_t> sequence{0};
+  Logger::Level level{Logger::Debug};
+  const char *function{nullptr};
+  int line{0};
+  uint32_t length{0};
+  bool truncated{false};
+  char text[kLogRecordSize];
+};
+
+// A bounded multi-producer queue, consumed by whoever holds
+// asyncLogger::draining. Each slot's sequence says whether it is free for
+// position pos (== pos) or holds the record for it (== pos + 1).
+class logRing {
+ public:
+  logRing() {
+    for (size_t i = 0; i < kLogRingSlots; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(Logger::Level level, const char *function, int line,
+            std::string_view message) noexcept {
+    auto pos = head.load(std::memory_order_relaxed);
+    logRecord *record = nullptr;
+    while (true) {
+      record = &slots[pos % kLogRingSlots];
+      auto sequence = record->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+
+    record->level = level;
+    record->function = function;
+    record->line = line;
+    record->truncated = message.size() > kLogRecordSize;
+    record->length = std::min(message.size(), kLogRecordSize);
+    std::memcpy(record->text, message.data(), record->length);
+    record->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only called by the holder of asyncLogger::draining.
+  logRecord *front() noexcept {
+    auto *record = &slots[tail % kLogRingSlots];
+    if (record->sequence.load(std::memory_order_acquire) != tail + 1) {
+      return nullptr;
+    }
+    return record;
+  }
+
+  void pop() noexcept {
+    slots[tail % kLogRingSlots].sequence.store(tail + kLogRingSlots,
+                                               std::memory_order_release);
+    ++tail;
+  }
+
+ private:
+  std::array<logRecord, kLogRingSlots> slots;
+  std::atomic<uint64_t> head{0};
+  uint64_t tail{0};
+};
+
+// Only the process whose pid is in owner, the one started with
+// LINGLONG_LOG_ASYNC=1, touches the other members. Children inherit a copy of
+// them in whatever state they were in at fork time and must leave them alone:
+// fork() clears owner in the child, since pids repeat across pid namespaces,
+// and children of a raw clone get a backend of their own from rearmLogs.
+class asyncLogger {
+ public:
+  bool owns() const noexcept {
+    auto pid = owner.load(std::memory_order_relaxed);
+    return pid != 0 && ::getpid() == pid;
+  }
+
+  void request() noexcept { owner.store(::getpid()); }
+
+  void disown() noexcept { owner.store(0, std::memory_order_relaxed); }
+
+  // whether the process this was copied from logs asynchronously
+  bool requested() const noexcept {
+    return owner.load(std::memory_order_relaxed) != 0;
+  }
+
+  bool push(Logger::Level level, const char *function, int line,
+            std::string_view message) noexcept {
+    if (!start()) {
+      return false;
+    }
+
+    while (!ring->push(level, function, line, message)) {
+      // full, write out a batch ourselves rather than dropping the record
+      drain();
+    }
+
+    if (!wakeupPending.exchange(true)) {
+      ::eventfd_write(wakeFd, 1);
+    }
+    return true;
+  }
+
+  void drain() noexcept {
+    if (!owns() || !started.load()) {
+      return;
+    }
+    while (draining.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    drainLocked();
+    draining.clear(std::memory_order_release);
+  }
+
+  // Takes draining for the caller, false if there is no drainer to hold off.
+  bool pause() noexcept {
+    if (!owns() || !started.load()) {
+      return false;
+    }
+    while (draining.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  void resume() noexcept { draining.clear(std::memory_order_release); }
+
+  void stop() noexcept {
+    if (!owns() || !started.load()) {
+      return;
+    }
+    stopping.store(true);
+    ::eventfd_write(wakeFd, 1);
+    if (drainer.joinable()) {
+      drainer.join();
+    }
+    // a signal handler may exit while this thread is draining, skip the last
+    // batch rather than deadlock
+    if (!draining.test_and_set(std::memory_order_acquire)) {
+      drainLocked();
+      draining.clear(std::memory_order_release);
+    }
+  }
+
+ private:
+  bool start() noexcept try {
+    if (started.load(std::memory_order_acquire)) {
+      return true;
+    }
+
+    std::lock_guard<std::mutex> guard(startLock);
+    if (started.load(std::memory_order_relaxed)) {
+      return true;
+    }
+
+    wakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd == -1) {
+      owner.store(0);
+      return false;
+    }
+
+    syslogFd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (syslogFd != -1) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      std::strncpy(address.sun_path, _PATH_LOG, sizeof(address.sun_path) - 1);
+      if (::connect(syslogFd, reinterpret_cast<sockaddr *>(&address),
+                    sizeof(address)) == -1) {
+        ::close(syslogFd);
+        syslogFd = -1;
+      }
+    }
+
+    ring = std::make_unique<logRing>();
+    lines.reserve(kLogBatchSize);
+    messages.reserve(kLogBatchSize);
+    drainer = std::thread([this]() { run(); });
+    // inherited by rearmed children, which must not register it again
+    if (!atexitRegistered) {
+      std::atexit(flushLogsAtExit);
+      atexitRegistered = true;
+    }
+    started.store(true, std::memory_order_release);
+    return true;
+  } catch (...) {
+    // no memory or no thread, log synchronously from now on
+    owner.store(0);
+    return false;
+  }
+
+  void run() noexcept {
+    while (!stopping.load()) {
+      pollfd fd{.fd = wakeFd, .events = POLLIN, .revents = 0};
+      ::poll(&fd, 1, kLogDrainIntervalMs);
+      eventfd_t count = 0;
+      ::eventfd_read(wakeFd, &count);
+      // cleared before draining, a record pushed after this either gets
+      // drained now or wakes us up again
+      wakeupPending.store(false);
+      drain();
+    }
+  }
+
+  void drainLocked() noexcept try {
+    while (true) {
+      lines.clear();
+      messages.clear();
+      const auto &pidns = pidnsPrefix();
+
+      for (auto *record = ring->front();
+           record != nullptr && lines.size() < kLogBatchSize;
+           record = ring->front()) {
+        std::string_view text{record->text, record->length};
+        auto &line = lines.emplace_back();
+        formatLine(line, record->level, pidns, record->function, record->line,
+                   text);
+        if (record->truncated) {
+          line.append(" [truncated]");
+        }
+        line.push_back('\n');
+
+        auto &message = messages.emplace_back();
+        message.append("<")
+            .append(std::to_string(LOG_USER | toSyslogLevel(record->level)))
+            .append(">ll-box[")
+            .append(std::to_string(::getpid()))
+            .append("]: ")
+            .append(pidns)
+            .append("|")
+            .append(record->function)
+            .append(":")
+            .append(std::to_string(record->line))
+            .append(" ")
+            .append(text);
+        ring->pop();
+      }
+
+      if (lines.empty()) {
+        return;
+      }
+      writeLines();
+      sendMessages();
+    }
+  } catch (...) {
+    // out of memory while formatting, the records stay queued
+  }
+
+  void writeLines() noexcept {
+    std::array<iovec, kLogBatchSize> iov{};
+    size_t count = 0;
+    for (auto &line : lines) {
+      iov[count++] = {.iov_base = line.data(), .iov_len = line.size()};
+    }
+
+    auto *next = iov.data();
+    while (count > 0) {
+      auto written = ::writev(STDOUT_FILENO, next, static_cast<int>(count));
+      if (written == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      while (count > 0 && static_cast<size_t>(written) >= next->iov_len) {
+        written -= static_cast<ssize_t>(next->iov_len);
+        ++next;
+        --count;
+      }
+      if (count > 0) {
+        next->iov_base = static_cast<char *>(next->iov_base) + written;
+        next->iov_len -= written;
+      }
+    }
+  }
+
+  void sendMessages() noexcept {
+    if (syslogFd == -1) {
+      return;
+    }
+
+    std::array<iovec, kLogBatchSize> iov{};
+    std::array<mmsghdr, kLogBatchSize> headers{};
+    for (size_t i = 0; i < messages.size(); ++i) {
+      iov[i] = {.iov_base = messages[i].data(), .iov_len = messages[i].size()};
+      headers[i].msg_hdr.msg_iov = &iov[i];
+      headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while (sent < messages.size()) {
+      auto ret = ::sendmmsg(syslogFd, headers.data() + sent,
+                            messages.size() - sent, MSG_NOSIGNAL);
+      if (ret == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      sent += ret;
+    }
+  }
+
+  static void flushLogsAtExit() noexcept;
+  static bool atexitRegistered;
+
+  std::atomic<pid_t> owner{0};
+  std::atomic<bool> started{false};
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> wakeupPending{false};
+  std::atomic_flag draining = ATOMIC_FLAG_INIT;
+  std::mutex startLock;
+  std::unique_ptr<logRing> ring;
+  std::thread drainer;
+  int wakeFd{-1};
+  int syslogFd{-1};
+  std::vector<std::string> lines;
+  std::vector<std::string> messages;
+};
+
+bool asyncLogger::atexitRegistered{false};
+
+// Never destroyed: a child calling exit() would otherwise run the destructor
+// of a std::thread it inherited but doesn't own. rearmLogs replaces it in
+// children, the copy left behind is leaked for the same reason.
+asyncLogger *&asyncBackendSlot() {
+  static auto *backend = new asyncLogger;
+  return backend;
+}
+
+asyncLogger &asyncBackend() { return *asyncBackendSlot(); }
+
+void asyncLogger::flushLogsAtExit() noexcept { asyncBackend().stop(); }
+
+}  // namespace
+
+void flushLogs() noexcept { asyncBackend().drain(); }
+
+void rearmLogs() noexcept try {
+  auto *&backend = asyncBackendSlot();
+  if (!backend->requested()) {
+    return;
+  }
+  // the records queued in the inherited ring are written by the parent
+  auto *fresh = new asyncLogger;
+  fresh->request();
+  backend = fresh;
+} catch (...) {
+  // no memory, the inherited backend keeps this process synchronous
+}
+
+LogDrainPause::LogDrainPause() noexcept : held(asyncBackend().pause()) {}
+
+LogDrainPause::~LogDrainPause() {
+  if (held) {
+    asyncBackend().resume();
+  }
+}
+
+Logger::~Logger() {
+  if (level < LOGLEVEL) {
+    return;
+  }
+
+  auto message = ss.str();
+  if (level != Fatal && asyncBackend().owns() &&
+      asyncBackend().push(level, function, line, message)) {
+    return;
+  }
+
+  if (level == Fatal) {
+    flushLogs();
+  }
+
+  const auto &pidns = pidnsPrefix();
+  syslog(toSyslogLevel(level), "%s|%s:%d %s", pidns.c_str(), function, line,
+         message.c_str());
+
+  std::string text;
+  formatLine(text, level, pidns, function, line, message);
+  std::cout << text << std::endl;
+
+  if (level == Fatal) {
+    exit(-1);
+  }
+}
+
 std::string errnoString() {
   return format("errno(%d): %s", errno, strerror(errno));
 }
@@ -52,6 +536,11 @@ static Logger::Level getLogLevelFromStr(const std::string& str) {
 
 static Logger::Level initLogLevel() {
   openlog("ll-box", LOG_PID, LOG_USER);
+  if (auto *async = getenv("LINGLONG_LOG_ASYNC");
+      async != nullptr && std::string_view{async} == "1") {
+    asyncBackend().request();
+    ::pthread_atfork(nullptr, nullptr, [] { asyncBackend().disown(); });
+  }
   auto *env = getenv("LINGLONG_LOG_LEVEL");
   return getLogLevelFromStr(env ? env : "Error");
 }
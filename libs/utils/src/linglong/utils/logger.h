@@ -19,6 +19,34 @@ std::string errnoString();
 std::string RetErrString(int);
 std::string GetPidnsPid();
 
+// With LINGLONG_LOG_ASYNC=1 in the environment, records logged by the process
+// ll-box was started as go to a preallocated ring buffer, which a background
+// thread writes out in batches. The supervisors PlatformClone starts, ll-box
+// entry and init, get a ring and a thread of their own. Processes forked from
+// any of them keep logging synchronously, they may exec at any point. Fatal
+// records flush the buffer before they exit, so does a normal exit.
+//
+// Writes out the queued records, for code that is about to exec or _exit.
+void flushLogs() noexcept;
+
+// Gives a child cloned from a process with a ring one of its own, to be
+// called first thing in the child. The ring it inherited is its parent's.
+void rearmLogs() noexcept;
+
+// Keeps the thread writing out queued records idle while it lives. Taken
+// around a raw clone, so the child can't inherit a malloc or stdio lock that
+// thread happened to hold.
+class LogDrainPause {
+ public:
+  LogDrainPause() noexcept;
+  ~LogDrainPause();
+  LogDrainPause(const LogDrainPause &) = delete;
+  LogDrainPause &operator=(const LogDrainPause &) = delete;
+
+ private:
+  bool held;
+};
+
 class Logger {
  public:
   enum Level {
@@ -29,74 +57,21 @@ class Logger {
     Fatal,
   };
 
+  // Levels below this one are compiled out, see STRIP_VERBOSE_LOGS.
+#ifdef LINGLONG_BOX_STRIP_VERBOSE_LOGS
+  static constexpr Level kMinLevel = Warning;
+#else
+  static constexpr Level kMinLevel = Debug;
+#endif
+
+  static bool enabled(Level l) noexcept {
+    return l >= kMinLevel && l >= LOGLEVEL;
+  }
+
   explicit Logger(Level l, const char *fn, int line)
       : level(l), function(fn), line(line){};
 
-  ~Logger() {
-    if (level < LOGLEVEL) {
-      return;
-    }
-
-    std::string prefix;
-    auto pid_ns = GetPidnsPid();
-    int syslogLevel = LOG_DEBUG;
-    switch (level) {
-      case Debug:
-        syslogLevel = LOG_DEBUG;
-        break;
-      case Info:
-        syslogLevel = LOG_INFO;
-        break;
-      case Warning:
-        syslogLevel = LOG_WARNING;
-        break;
-      case Error:
-        syslogLevel = LOG_ERR;
-        break;
-      case Fatal:
-        syslogLevel = LOG_ERR;
-        break;
-    }
-    syslog(syslogLevel, "%s|%s:%d %s", pid_ns.c_str(), function, line,
-           ss.str().c_str());
-
-    switch (level) {
-      case Debug:
-        prefix = "[DBG |";
-        std::cout << prefix << " " << pid_ns << " | " << function << ":" << line
-                  << " ] " << ss.str() << std::endl;
-        break;
-      case Info:
-        prefix = "[IFO |";
-        std::cout << "\033[1;96m";
-        std::cout << prefix << " " << pid_ns << " | " << function << ":" << line
-                  << " ] " << ss.str();
-        std::cout << "\033[0m" << std::endl;
-        break;
-      case Warning:
-        prefix = "[WAN |";
-        std::cout << "\033[1;93m";
-        std::cout << prefix << " " << pid_ns << " | " << function << ":" << line
-                  << " ] " << ss.str();
-        std::cout << "\033[0m" << std::endl;
-        break;
-      case Error:
-        prefix = "[ERR |";
-        std::cout << "\033[1;31m";
-        std::cout << prefix << " " << pid_ns << " | " << function << ":" << line
-                  << " ] " << ss.str();
-        std::cout << "\033[0m" << std::endl;
-        break;
-      case Fatal:
-        prefix = "[FAL |";
-        std::cout << "\033[1;91m";
-        std::cout << prefix << " " << pid_ns << " | " << function << ":" << line
-                  << " ] " << ss.str();
-        std::cout << "\033[0m" << std::endl;
-        exit(-1);
-        break;
-    }
-  }
+  ~Logger();
 
   template <class T>
   Logger &operator<<(const T &x) {
@@ -111,21 +86,26 @@ class Logger {
   int line;
   std::ostringstream ss;
 };
+
+// Turns a streaming expression into void, so it can be an operand of ?: next
+// to (void)0. & binds looser than << and tighter than ?:.
+struct LogVoidify {
+  void operator&(const Logger & /*unused*/) const noexcept {}
+};
 }  // namespace linglong::utils
 
-#define logDbg()                                                       \
-  (linglong::utils::Logger(linglong::utils::Logger::Debug, __FUNCTION__, \
-                          __LINE__))
-#define logWan()                                                         \
-  (linglong::utils::Logger(linglong::utils::Logger::Warning, __FUNCTION__, \
-                          __LINE__))
-#define logInf() \
-  (linglong::utils::Logger(linglong::utils::Logger::Info, __FUNCTION__, __LINE__))
-#define logErr()                                                       \
-  (linglong::utils::Logger(linglong::utils::Logger::Error, __FUNCTION__, \
-                          __LINE__))
-#define logFal()                                                       \
-  (linglong::utils::Logger(linglong::utils::Logger::Fatal, __FUNCTION__, \
-                          __LINE__))
+// The operands of << are only evaluated when the level is enabled.
+#define LINGLONG_LOG(LEVEL, FUNCTION, LINE)                            \
+  !linglong::utils::Logger::enabled(linglong::utils::Logger::LEVEL)    \
+      ? (void)0                                                        \
+      : linglong::utils::LogVoidify() &                                \
+            linglong::utils::Logger(linglong::utils::Logger::LEVEL,    \
+                                    FUNCTION, LINE)
+
+#define logDbg() LINGLONG_LOG(Debug, __FUNCTION__, __LINE__)
+#define logWan() LINGLONG_LOG(Warning, __FUNCTION__, __LINE__)
+#define logInf() LINGLONG_LOG(Info, __FUNCTION__, __LINE__)
+#define logErr() LINGLONG_LOG(Error, __FUNCTION__, __LINE__)
+#define logFal() LINGLONG_LOG(Fatal, __FUNCTION__, __LINE__)
 
 #endif /* LINGLONG_BOX_SRC_UTIL_LOGGER_H_ */
@@ -9,10 +9,14 @@
 
 #include <sys/mount.h>
 
+#include <map>
 #include <optional>
+#include <stdexcept>
+#include <string_view>
 
 #include "linglong/utils/common.h"
 #include "linglong/utils/json.h"
+#include "linglong/utils/static_map.h"
 #include "linglong/utils/util.h"
 
 // Compatible with linux kernel which is under 5.10
@@ -100,100 +104,120 @@ struct Mount {
 
 enum Extension { COPY_SYMLINK = 1 };
 
-inline void from_json(const nlohmann::json &j, Mount &o) {
-  const static std::map<std::string_view, Mount::Type> fsTypes = {
-      {"bind", Mount::Bind},     {"proc", Mount::Proc},
-      {"devpts", Mount::Devpts}, {"mqueue", Mount::Mqueue},
-      {"tmpfs", Mount::Tmpfs},   {"sysfs", Mount::Sysfs},
-      {"cgroup", Mount::Cgroup}, {"cgroup2", Mount::Cgroup2},
-  };
-
-  struct mountFlag {
-    bool clear{false};
-    uint32_t flag{0};
-  };
-
-  const static std::map<std::string_view, mountFlag> optionFlags = {
-      {"acl", {false, MS_POSIXACL}},
-      {"async", {true, MS_SYNCHRONOUS}},
-      {"atime", {true, MS_NOATIME}},
-      {"bind", {false, MS_BIND}},
-      {"defaults", {false, 0}},
-      {"dev", {true, MS_NODEV}},
-      {"diratime", {true, MS_NODIRATIME}},
-      {"dirsync", {false, MS_DIRSYNC}},
-      {"exec", {true, MS_NOEXEC}},
-      {"iversion", {false, MS_I_VERSION}},
-      {"lazytime", {false, MS_LAZYTIME}},
-      {"loud", {true, MS_SILENT}},
-      {"mand", {false, MS_MANDLOCK}},
-      {"noacl", {true, MS_POSIXACL}},
-      {"noatime", {false, MS_NOATIME}},
-      {"nodev", {false, MS_NODEV}},
-      {"nodiratime", {false, MS_NODIRATIME}},
-      {"noexec", {false, MS_NOEXEC}},
-      {"noiversion", {true, MS_I_VERSION}},
-      {"nolazytime", {true, MS_LAZYTIME}},
-      {"nomand", {true, MS_MANDLOCK}},
-      {"norelatime", {true, MS_RELATIME}},
-      {"nostrictatime", {true, MS_STRICTATIME}},
-      {"nosuid", {false, MS_NOSUID}},
-      {"nosymfollow", {false, LINGLONG_MS_NOSYMFOLLOW}},  // since kernel 5.10
-      {"rbind", {false, MS_BIND | MS_REC}},
-      {"relatime", {false, MS_RELATIME}},
-      {"remount", {false, MS_REMOUNT}},
-      {"ro", {false, MS_RDONLY}},
-      {"rw", {true, MS_RDONLY}},
-      {"silent", {false, MS_SILENT}},
-      {"strictatime", {false, MS_STRICTATIME}},
-      {"suid", {true, MS_NOSUID}},
-      {"sync", {false, MS_SYNCHRONOUS}},
-      // {"symfollow",{true, MS_NOSYMFOLLOW}}, // since kernel 5.10
-  };
-
-  const static std::map<std::string_view, uint32_t> propagationFlags{
-      {"rprivate", MS_PRIVATE | MS_REC},       {"private", MS_PRIVATE},
-      {"rslave", MS_SLAVE | MS_REC},           {"slave", MS_SLAVE},
-      {"rshared", MS_SHARED | MS_REC},         {"shared", MS_SHARED},
-      {"runbindable", MS_UNBINDABLE | MS_REC}, {"unbindable", MS_UNBINDABLE}};
+// The string to flag conversions below are shared by every JSON backend.
+
+inline constexpr auto mountTypes = makeStaticMap<Mount::Type>({
+    {"bind", Mount::Bind},
+    {"proc", Mount::Proc},
+    {"devpts", Mount::Devpts},
+    {"mqueue", Mount::Mqueue},
+    {"tmpfs", Mount::Tmpfs},
+    {"sysfs", Mount::Sysfs},
+    {"cgroup", Mount::Cgroup},
+    {"cgroup2", Mount::Cgroup2},
+});
+
+struct MountFlag {
+  bool clear{false};
+  uint32_t flag{0};
+};
 
-  const static std::map<std::string_view, mountFlag> extensionFlags{
-      {"copy-symlink", {false, Extension::COPY_SYMLINK}}};
+inline constexpr auto mountOptionFlags = makeStaticMap<MountFlag>({
+    {"acl", {false, MS_POSIXACL}},
+    {"async", {true, MS_SYNCHRONOUS}},
+    {"atime", {true, MS_NOATIME}},
+    {"bind", {false, MS_BIND}},
+    {"defaults", {false, 0}},
+    {"dev", {true, MS_NODEV}},
+    {"diratime", {true, MS_NODIRATIME}},
+    {"dirsync", {false, MS_DIRSYNC}},
+    {"exec", {true, MS_NOEXEC}},
+    {"iversion", {false, MS_I_VERSION}},
+    {"lazytime", {false, MS_LAZYTIME}},
+    {"loud", {true, MS_SILENT}},
+    {"mand", {false, MS_MANDLOCK}},
+    {"noacl", {true, MS_POSIXACL}},
+    {"noatime", {false, MS_NOATIME}},
+    {"nodev", {false, MS_NODEV}},
+    {"nodiratime", {false, MS_NODIRATIME}},
+    {"noexec", {false, MS_NOEXEC}},
+    {"noiversion", {true, MS_I_VERSION}},
+    {"nolazytime", {true, MS_LAZYTIME}},
+    {"nomand", {true, MS_MANDLOCK}},
+    {"norelatime", {true, MS_RELATIME}},
+    {"nostrictatime", {true, MS_STRICTATIME}},
+    {"nosuid", {false, MS_NOSUID}},
+    {"nosymfollow", {false, LINGLONG_MS_NOSYMFOLLOW}},  // since kernel 5.10
+    {"rbind", {false, MS_BIND | MS_REC}},
+    {"relatime", {false, MS_RELATIME}},
+    {"remount", {false, MS_REMOUNT}},
+    {"ro", {false, MS_RDONLY}},
+    {"rw", {true, MS_RDONLY}},
+    {"silent", {false, MS_SILENT}},
+    {"strictatime", {false, MS_STRICTATIME}},
+    {"suid", {true, MS_NOSUID}},
+    {"sync", {false, MS_SYNCHRONOUS}},
+    // {"symfollow",{true, MS_NOSYMFOLLOW}}, // since kernel 5.10
+});
+
+inline constexpr auto mountPropagationFlags = makeStaticMap<uint32_t>({
+    {"rprivate", MS_PRIVATE | MS_REC},
+    {"private", MS_PRIVATE},
+    {"rslave", MS_SLAVE | MS_REC},
+    {"slave", MS_SLAVE},
+    {"rshared", MS_SHARED | MS_REC},
+    {"shared", MS_SHARED},
+    {"runbindable", MS_UNBINDABLE | MS_REC},
+    {"unbindable", MS_UNBINDABLE},
+});
+
+inline constexpr auto mountExtensionFlags = makeStaticMap<MountFlag>({
+    {"copy-symlink", {false, Extension::COPY_SYMLINK}},
+});
+
+inline Mount::Type toMountType(std::string_view type) {
+  auto fsType = mountTypes.find(type);
+  return fsType == nullptr ? Mount::Unknown : *fsType;
+}
+
+// Parse options to data and flags. Options that are not flags are passed on
+// to the filesystem as data.
+// FIXME: support "recursive mount attrs" in the future
+// https://github.com/opencontainers/runc/blob/c83abc503de7e8b3017276e92e7510064eee02a8/libcontainer/specconv/spec_linux.go#L958
+inline void applyMountOption(Mount &o, std::string_view opt) {
+  if (auto option = mountOptionFlags.find(opt);
+      option != nullptr && option->flag != 0) {
+    if (option->clear) {
+      o.flags &= ~option->flag;
+    } else {
+      o.flags |= option->flag;
+    }
+  } else if (auto propagation = mountPropagationFlags.find(opt)) {
+    o.propagationFlags |= *propagation;
+  } else if (auto extension = mountExtensionFlags.find(opt)) {
+    if (extension->clear) {
+      o.extensionFlags &= ~extension->flag;
+    } else {
+      o.extensionFlags |= extension->flag;
+    }
+  } else {
+    o.data.emplace_back(opt);
+  }
+}
 
+inline void from_json(const nlohmann::json &j, Mount &o) {
   o.destination = j.at("destination").get<std::string>();
   o.type = j.at("type").get<std::string>();
-  o.fsType = fsTypes.find(o.type)->second;
+  o.fsType = toMountType(o.type);
   if (o.fsType == Mount::Bind) {
     o.flags = MS_BIND;
   }
   o.source = j.at("source").get<std::string>();
   o.data = {};
 
-  // Parse options to data and flags.
-  // FIXME: support "recursive mount attrs" in the future
-  // https://github.com/opencontainers/runc/blob/c83abc503de7e8b3017276e92e7510064eee02a8/libcontainer/specconv/spec_linux.go#L958
   auto options = j.value("options", str_vec{});
   for (auto const &opt : options) {
-    if (auto it = optionFlags.find(opt);
-        it != optionFlags.cend() && it->second.flag != 0) {
-      if (it->second.clear) {
-        o.flags &= ~it->second.flag;
-      } else {
-        o.flags |= it->second.flag;
-      }
-    } else if (auto it = propagationFlags.find(opt);
-               it != propagationFlags.cend()) {
-      o.propagationFlags |= it->second;
-    } else if (auto it = extensionFlags.find(opt);
-               it != extensionFlags.cend()) {
-      if (it->second.clear) {
-        o.extensionFlags &= ~it->second.flag;
-      } else {
-        o.extensionFlags |= it->second.flag;
-      }
-    } else {
-      o.data.push_back(opt);
-    }
+    applyMountOption(o, opt);
   }
 }
 
@@ -209,24 +233,33 @@ struct Namespace {
   int type;
 };
 
-static std::map<std::string, int> namespaceType = {
-    {"pid", CLONE_NEWPID},     {"uts", CLONE_NEWUTS},
-    {"mount", CLONE_NEWNS},    {"cgroup", CLONE_NEWCGROUP},
-    {"network", CLONE_NEWNET}, {"ipc", CLONE_NEWIPC},
+inline constexpr auto namespaceType = makeStaticMap<int>({
+    {"pid", CLONE_NEWPID},
+    {"uts", CLONE_NEWUTS},
+    {"mount", CLONE_NEWNS},
+    {"cgroup", CLONE_NEWCGROUP},
+    {"network", CLONE_NEWNET},
+    {"ipc", CLONE_NEWIPC},
     {"user", CLONE_NEWUSER},
-};
+});
+
+inline int toNamespaceType(std::string_view type) {
+  return namespaceType.at(type, "namespace type");
+}
 
 inline void from_json(const nlohmann::json &j, Namespace &o) {
-  o.type = namespaceType.find(j.at("type").get<std::string>())->second;
+  o.type = toNamespaceType(j.at("type").get<std::string>());
 }
 
 inline void to_json(nlohmann::json &j, const Namespace &o) {
-  auto matchPair =
-      std::find_if(std::begin(namespaceType), std::end(namespaceType),
-                   [&](const std::pair<std::string, int> &pair) {
-                     return pair.second == o.type;
-                   });
-  j["type"] = matchPair->first;
+  auto matchPair = std::find_if(
+      namespaceType.begin(), namespaceType.end(),
+      [&](const auto &entry) { return entry.value == o.type; });
+  if (matchPair == namespaceType.end()) {
+    throw std::invalid_argument("unknown namespace flag " +
+                                std::to_string(o.type));
+  }
+  j["type"] = matchPair->key;
 }
 
 struct IDMap {
@@ -236,9 +269,9 @@ struct IDMap {
 };
 
 inline void from_json(const nlohmann::json &j, IDMap &o) {
-  o.hostID = j.value("hostID", 0);
-  o.containerID = j.value("containerID", 0);
-  o.size = j.value("size", 0);
+  o.hostID = j.value("hostID", uint64_t{0});
+  o.containerID = j.value("containerID", uint64_t{0});
+  o.size = j.value("size", uint64_t{0});
 }
 
 inline void to_json(nlohmann::json &j, const IDMap &o) {
@@ -315,9 +348,9 @@ struct ResourceMemory {
 };
 
 inline void from_json(const nlohmann::json &j, ResourceMemory &o) {
-  o.limit = j.value("limit", -1);
-  o.reservation = j.value("reservation", -1);
-  o.swap = j.value("swap", -1);
+  o.limit = j.value("limit", int64_t{-1});
+  o.reservation = j.value("reservation", int64_t{-1});
+  o.swap = j.value("swap", int64_t{-1});
 }
 
 inline void to_json(nlohmann::json &j, const ResourceMemory &o) {
@@ -327,42 +360,212 @@ inline void to_json(nlohmann::json &j, const ResourceMemory &o) {
 }
 
 // https://github.com/containers/crun/blob/main/crun.1.md#cpu-controller
-// support v1 and v2 with conversion
+// support v1 and v2 with conversion, zero and empty values are left alone
 struct ResourceCPU {
-  u_int64_t shares = 1024;
-  int64_t quota = 100000;
-  u_int64_t period = 100000;
+  u_int64_t shares = 0;
+  int64_t quota = 0;
+  u_int64_t period = 0;
   //    int64_t realtimeRuntime;
   //    int64_t realtimePeriod;
-  //    std::string cpus;
-  //    std::string mems;
+  std::string cpus;
+  std::string mems;
 };
 
 inline void from_json(const nlohmann::json &j, ResourceCPU &o) {
-  o.shares = j.value("shares", 1024);
-  o.quota = j.value("quota", 100000);
-  o.period = j.value("period", 100000);
+  o.shares = j.value("shares", u_int64_t{0});
+  o.quota = j.value("quota", int64_t{0});
+  o.period = j.value("period", u_int64_t{0});
+  o.cpus = j.value("cpus", "");
+  o.mems = j.value("mems", "");
 }
 
 inline void to_json(nlohmann::json &j, const ResourceCPU &o) {
   j["shares"] = o.shares;
   j["quota"] = o.quota;
   j["period"] = o.period;
+  j["cpus"] = o.cpus;
+  j["mems"] = o.mems;
+}
+
+// https://github.com/opencontainers/runtime-spec/blob/main/config-linux.md#pids
+struct ResourcePids {
+  // zero or negative for no limit
+  int64_t limit = 0;
+};
+
+inline void from_json(const nlohmann::json &j, ResourcePids &o) {
+  o.limit = j.at("limit").get<int64_t>();
+}
+
+inline void to_json(nlohmann::json &j, const ResourcePids &o) {
+  j["limit"] = o.limit;
+}
+
+// https://github.com/opencontainers/runtime-spec/blob/main/config-linux.md#block-io
+struct WeightDevice {
+  int64_t major = 0;
+  int64_t minor = 0;
+  uint16_t weight = 0;
+};
+
+inline void from_json(const nlohmann::json &j, WeightDevice &o) {
+  o.major = j.at("major").get<int64_t>();
+  o.minor = j.at("minor").get<int64_t>();
+  o.weight = j.value("weight", uint16_t{0});
+}
+
+inline void to_json(nlohmann::json &j, const WeightDevice &o) {
+  j["major"] = o.major;
+  j["minor"] = o.minor;
+  j["weight"] = o.weight;
+}
+
+struct ThrottleDevice {
+  int64_t major = 0;
+  int64_t minor = 0;
+  uint64_t rate = 0;
+};
+
+inline void from_json(const nlohmann::json &j, ThrottleDevice &o) {
+  o.major = j.at("major").get<int64_t>();
+  o.minor = j.at("minor").get<int64_t>();
+  o.rate = j.at("rate").get<uint64_t>();
+}
+
+inline void to_json(nlohmann::json &j, const ThrottleDevice &o) {
+  j["major"] = o.major;
+  j["minor"] = o.minor;
+  j["rate"] = o.rate;
+}
+
+// weights are in the cgroup v1 range [10-1000], zero for the default
+struct ResourceBlockIO {
+  uint16_t weight = 0;
+  std::vector<WeightDevice> weightDevice;
+  std::vector<ThrottleDevice> throttleReadBpsDevice;
+  std::vector<ThrottleDevice> throttleWriteBpsDevice;
+  std::vector<ThrottleDevice> throttleReadIOPSDevice;
+  std::vector<ThrottleDevice> throttleWriteIOPSDevice;
+};
+
+inline void from_json(const nlohmann::json &j, ResourceBlockIO &o) {
+  o.weight = j.value("weight", uint16_t{0});
+  o.weightDevice = j.value("weightDevice", std::vector<WeightDevice>{});
+  o.throttleReadBpsDevice =
+      j.value("throttleReadBpsDevice", std::vector<ThrottleDevice>{});
+  o.throttleWriteBpsDevice =
+      j.value("throttleWriteBpsDevice", std::vector<ThrottleDevice>{});
+  o.throttleReadIOPSDevice =
+      j.value("throttleReadIOPSDevice", std::vector<ThrottleDevice>{});
+  o.throttleWriteIOPSDevice =
+      j.value("throttleWriteIOPSDevice", std::vector<ThrottleDevice>{});
+}
+
+inline void to_json(nlohmann::json &j, const ResourceBlockIO &o) {
+  j["weight"] = o.weight;
+  j["weightDevice"] = o.weightDevice;
+  j["throttleReadBpsDevice"] = o.throttleReadBpsDevice;
+  j["throttleWriteBpsDevice"] = o.throttleWriteBpsDevice;
+  j["throttleReadIOPSDevice"] = o.throttleReadIOPSDevice;
+  j["throttleWriteIOPSDevice"] = o.throttleWriteIOPSDevice;
+}
+
+struct Hook {
+  std::string path;
+  std::optional<str_vec> args;
+  std::optional<std::vector<std::string>> env;
+  // seconds until the hook is killed and fails, 0 for no limit
+  int64_t timeout = 0;
+  // Not part of the OCI spec: runs concurrently with the independent hooks
+  // next to it in its phase instead of after them.
+  bool independent = false;
+};
+
+inline void from_json(const nlohmann::json &j, Hook &o) {
+  LLJS_FROM(path);
+  LLJS_FROM_OPT(args);
+  LLJS_FROM_OPT(env);
+  o.timeout = j.value("timeout", int64_t{0});
+  o.independent = j.value("independent", false);
+}
+
+inline void to_json(nlohmann::json &j, const Hook &o) {
+  j["path"] = o.path;
+  j["args"] = o.args;
+  j["env"] = o.env;
+  j["timeout"] = o.timeout;
+  j["independent"] = o.independent;
+}
+
+// A PSI trigger on the cgroup of the container, armed by the supervising
+// ll-box, see Documentation/accounting/psi.rst. Not part of the OCI spec.
+struct PressureTrigger {
+  // cpu, memory or io
+  std::string resource;
+  // some or full
+  std::string type = "some";
+  // fire when tasks stalled for threshold microseconds within window, which
+  // for unprivileged users has to be a multiple of 2s
+  uint64_t threshold = 0;
+  uint64_t window = 2000000;
+  // log, hook, throttle (lower memory.high to memoryHigh) or freeze
+  std::string action = "log";
+  std::optional<Hook> hook;
+  int64_t memoryHigh = -1;
+  // seconds a freeze lasts, 0 leaves the container frozen until
+  // cgroup.freeze is reset by hand
+  uint64_t thawAfter = 0;
+};
+
+inline void from_json(const nlohmann::json &j, PressureTrigger &o) {
+  LLJS_FROM(resource);
+  o.type = j.value("type", "some");
+  LLJS_FROM(threshold);
+  o.window = j.value("window", uint64_t{2000000});
+  o.action = j.value("action", "log");
+  LLJS_FROM_OPT(hook);
+  o.memoryHigh = j.value("memoryHigh", int64_t{-1});
+  o.thawAfter = j.value("thawAfter", uint64_t{0});
+}
+
+inline void to_json(nlohmann::json &j, const PressureTrigger &o) {
+  j["resource"] = o.resource;
+  j["type"] = o.type;
+  j["threshold"] = o.threshold;
+  j["window"] = o.window;
+  j["action"] = o.action;
+  j["hook"] = o.hook;
+  j["memoryHigh"] = o.memoryHigh;
+  j["thawAfter"] = o.thawAfter;
 }
 
 struct Resources {
   ResourceMemory memory;
   ResourceCPU cpu;
+  std::optional<ResourcePids> pids;
+  ResourceBlockIO blockIO;
+  // cgroup v2 files written as they are, e.g. "memory.high"
+  std::map<std::string, std::string> unified;
+  std::vector<PressureTrigger> pressureTriggers;
 };
 
 inline void from_json(const nlohmann::json &j, Resources &o) {
   o.cpu = j.value("cpu", ResourceCPU());
   o.memory = j.value("memory", ResourceMemory());
+  o.pids = optional<decltype(o.pids)::value_type>(j, "pids");
+  o.blockIO = j.value("blockIO", ResourceBlockIO());
+  o.unified = j.value("unified", std::map<std::string, std::string>{});
+  o.pressureTriggers =
+      j.value("pressureTriggers", std::vector<PressureTrigger>{});
 }
 
 inline void to_json(nlohmann::json &j, const Resources &o) {
   j["cpu"] = o.cpu;
   j["memory"] = o.memory;
+  j["pids"] = o.pids;
+  j["blockIO"] = o.blockIO;
+  j["unified"] = o.unified;
+  j["pressureTriggers"] = o.pressureTriggers;
 }
 
 struct Linux {
@@ -419,24 +622,6 @@ inline void to_json(nlohmann::json &j, const Linux &o) {
     }
  */
 
-struct Hook {
-  std::string path;
-  std::optional<str_vec> args;
-  std::optional<std::vector<std::string>> env;
-};
-
-inline void from_json(const nlohmann::json &j, Hook &o) {
-  LLJS_FROM(path);
-  LLJS_FROM_OPT(args);
-  LLJS_FROM_OPT(env);
-}
-
-inline void to_json(nlohmann::json &j, const Hook &o) {
-  j["path"] = o.path;
-  j["args"] = o.args;
-  j["env"] = o.env;
-}
-
 struct Hooks {
   std::optional<std::vector<Hook>> prestart;
   std::optional<std::vector<Hook>> poststart;
@@ -6,27 +6,342 @@
 
 #include "linglong/utils/platform.h"
 
+#include <fcntl.h>
 #include <sched.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <array>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "logger.h"
 
-namespace linglong::utils {
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+#ifndef SYS_open_tree
+#define SYS_open_tree 428
+#endif
+
+#ifndef SYS_move_mount
+#define SYS_move_mount 429
+#endif
+
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr 442
+#endif
+
+namespace {
+
+// struct clone_args from linux/sched.h, kept here to build against old kernel
+// headers
+struct CloneArgs {
+  uint64_t flags;
+  uint64_t pidfd;
+  uint64_t childTid;
+  uint64_t parentTid;
+  uint64_t exitSignal;
+  uint64_t stack;
+  uint64_t stackSize;
+  uint64_t tls;
+  uint64_t setTid;
+  uint64_t setTidSize;
+  uint64_t cgroup;
+};
+
+// struct mount_attr from linux/mount.h
+struct MountAttr {
+  uint64_t attrSet;
+  uint64_t attrClr;
+  uint64_t propagation;
+  uint64_t userns;
+};
+
+// struct open_how from linux/openat2.h
+struct OpenHow {
+  uint64_t flags;
+  uint64_t mode;
+  uint64_t resolve;
+};
 
-int PlatformClone(int (*callback)(void *), int flags, void *arg) {
+constexpr auto kCloneArgsSizeVer0 = 64;  // linux 5.3
+constexpr auto kCloneArgsSizeVer2 = 88;  // linux 5.7, adds cgroup
+
+// P_PIDFD, since linux 5.4
+constexpr auto kIdTypePidfd = static_cast<idtype_t>(3);
+
+bool clone3Unsupported{false};
+
+struct clonedCall {
+  int (*callback)(void *);
+  void *arg;
+};
+
+// The child side of PlatformClone: a supervisor with a log ring of its own,
+// written out before the child exits.
+int runCloned(void *data) {
+  const auto *call = static_cast<const clonedCall *>(data);
+  linglong::utils::rearmLogs();
+  auto ret = call->callback(call->arg);
+  linglong::utils::flushLogs();
+  return ret;
+}
+
+int legacyClone(int (*callback)(void *), int flags, void *arg, int *pidfd) {
   auto *stack = reinterpret_cast<char *>(
       mmap(nullptr, kStackSize, PROT_READ | PROT_WRITE,
            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0));
   if (stack == MAP_FAILED) {
-    return EXIT_FAILURE;
+    return -1;
   }
 
   auto *stackTop = stack + kStackSize;
-  return ::clone(callback, stackTop, flags, arg);
+  int pid{-1};
+  if (pidfd != nullptr) {
+    // the pidfd is returned through parent_tid
+    pid = ::clone(callback, stackTop, flags | CLONE_PIDFD, arg, pidfd);
+  }
+
+  if (pidfd == nullptr || (pid == -1 && errno == EINVAL)) {
+    if (pidfd != nullptr) {
+      *pidfd = -1;
+    }
+    pid = ::clone(callback, stackTop, flags, arg);
+  }
+
+  // Without CLONE_VM the child runs on its own copy of the stack, so the
+  // parent's mapping is no longer needed.
+  if ((flags & CLONE_VM) == 0) {
+    auto savedErrno = errno;
+    ::munmap(stack, kStackSize);
+    errno = savedErrno;
+  }
+
+  return pid;
+}
+
+}  // namespace
+
+namespace linglong::utils {
+
+int PlatformClone(int (*callback)(void *), int flags, void *arg, int *pidfd,
+                  int cgroupFd) {
+  if (pidfd != nullptr) {
+    *pidfd = -1;
+  }
+
+  // the child gets no atfork handlers, nothing else may be mid-write
+  LogDrainPause pause;
+
+  if (!clone3Unsupported) {
+    CloneArgs args{};
+    args.flags = static_cast<uint64_t>(flags) & ~static_cast<uint64_t>(CSIGNAL);
+    args.exitSignal = static_cast<uint64_t>(flags) & CSIGNAL;
+    if (pidfd != nullptr) {
+      args.flags |= CLONE_PIDFD;
+      args.pidfd = reinterpret_cast<uint64_t>(pidfd);  // NOLINT
+    }
+
+    auto size = kCloneArgsSizeVer0;
+    if (cgroupFd != -1) {
+      args.flags |= CLONE_INTO_CGROUP;
+      args.cgroup = static_cast<uint64_t>(cgroupFd);
+      size = kCloneArgsSizeVer2;
+    }
+
+    // Without a stack, clone3 behaves like fork: the child returns here.
+    auto pid = ::syscall(SYS_clone3, &args, size);
+    if (pid == 0) {
+      clonedCall call{callback, arg};
+      ::_exit(runCloned(&call));
+    }
+
+    if (pid > 0) {
+      return static_cast<int>(pid);
+    }
+
+    if (errno != ENOSYS) {
+      return -1;
+    }
+
+    clone3Unsupported = true;
+  }
+
+  if (cgroupFd != -1) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  // a child sharing our memory must leave the logger alone, any other gets
+  // its own copy of call
+  if ((flags & CLONE_VM) != 0) {
+    return legacyClone(callback, flags, arg, pidfd);
+  }
+  clonedCall call{callback, arg};
+  return legacyClone(runCloned, flags, &call, pidfd);
+}
+
+int PidfdOpen(int pid) {
+  return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+}
+
+int PidfdSendSignal(int pidfd, int sig) {
+  return static_cast<int>(
+      ::syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0));
+}
+
+std::optional<uint64_t> ProcessStartTime(int pid) noexcept {
+  char path[32];
+  std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return std::nullopt;
+  }
+
+  char buf[2048];
+  auto size = ::read(fd, buf, sizeof(buf) - 1);
+  ::close(fd);
+  if (size <= 0) {
+    return std::nullopt;
+  }
+  buf[size] = '\0';
+
+  // the command name may contain spaces and parentheses, count the fields
+  // from the last ')', the process state being field 3
+  const char *field = std::strrchr(buf, ')');
+  if (field == nullptr) {
+    return std::nullopt;
+  }
+  for (int i = 2; i < 22 && field != nullptr; ++i) {
+    field = std::strchr(field + 1, ' ');
+  }
+  if (field == nullptr) {
+    return std::nullopt;
+  }
+
+  char *end = nullptr;
+  auto startTime = std::strtoull(field + 1, &end, 10);
+  if (end == field + 1) {
+    return std::nullopt;
+  }
+  return startTime;
+}
+
+int OpenTree(int dirfd, const char *path, unsigned int flags) {
+  return static_cast<int>(::syscall(SYS_open_tree, dirfd, path, flags));
+}
+
+int MoveMount(int fromDirfd, const char *fromPath, int toDirfd,
+              const char *toPath, unsigned int flags) {
+  return static_cast<int>(::syscall(SYS_move_mount, fromDirfd, fromPath,
+                                    toDirfd, toPath, flags));
+}
+
+int MountSetattr(int dirfd, const char *path, unsigned int flags,
+                 uint64_t attrSet, uint64_t attrClr, uint64_t propagation) {
+  MountAttr attr{
+      .attrSet = attrSet,
+      .attrClr = attrClr,
+      .propagation = propagation,
+      .userns = 0,
+  };
+  return static_cast<int>(
+      ::syscall(SYS_mount_setattr, dirfd, path, flags, &attr, sizeof(attr)));
+}
+
+int OpenAt2(int dirfd, const char *path, uint64_t flags, uint64_t resolve) {
+  OpenHow how{
+      .flags = flags,
+      .mode = 0,
+      .resolve = resolve,
+  };
+  return static_cast<int>(
+      ::syscall(SYS_openat2, dirfd, path, &how, sizeof(how)));
+}
+
+bool SendFd(int channel, int fd) noexcept {
+  char dummy = 'F';
+  iovec iov{.iov_base = &dummy, .iov_len = sizeof(dummy)};
+
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  auto *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  ::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  return ::sendmsg(channel, &msg, MSG_NOSIGNAL) == sizeof(dummy);
+}
+
+int ReceiveFd(int channel) noexcept {
+  char dummy{};
+  iovec iov{.iov_base = &dummy, .iov_len = sizeof(dummy)};
+
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  ssize_t len{-1};
+  do {
+    len = ::recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+  } while (len == -1 && errno == EINTR);
+
+  if (len == 0) {
+    // the peer is gone, like a reset connection
+    errno = ECONNRESET;
+    return -1;
+  }
+  if (len < 0) {
+    return -1;
+  }
+
+  auto *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    errno = EBADMSG;
+    return -1;
+  }
+
+  int fd{-1};
+  ::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
 }
 
 int Exec(const str_vec &args,
@@ -47,6 +362,7 @@ int Exec(const str_vec &args,
   targetEnvv.push_back(nullptr);
 
   logDbg() << "execve" << targetArgv[0] << " in pid:" << getpid();
+  flushLogs();
 
   int ret = execvpe(targetArgv[0], const_cast<char **>(targetArgv.data()),
                     const_cast<char **>(targetEnvv.data()));
@@ -108,4 +424,34 @@ static int DoWait(const int pid, int target = 0) {
 // wait all child until pid exit
 int WaitAllUntil(const int pid) { return DoWait(-1, pid); }
 
+int WaitProcess(const int pid, const int pidfd) {
+  if (pidfd == -1) {
+    return WaitAllUntil(pid);
+  }
+
+  siginfo_t info{};
+  while (::waitid(kIdTypePidfd, pidfd, &info, WEXITED) == -1) {
+    if (errno == EINTR) {
+      continue;
+    }
+
+    auto string = errnoString();
+    logErr() << format("waitid on pidfd failed, %s", string.c_str());
+    return -1;
+  }
+
+  auto wstatus = info.si_code == CLD_EXITED ? W_EXITCODE(info.si_status, 0)
+                                            : info.si_status;
+  std::string msg;
+  auto normal = parse_wstatus(wstatus, msg);
+  msg = format("child [%d] [%s].", info.si_pid, msg.c_str());
+  if (normal) {
+    logDbg() << msg;
+  } else {
+    logWan() << msg;
+  }
+
+  return normal ? 0 : -1;
+}
+
 }  // namespace linglong::utils
@@ -17,10 +17,45 @@ constexpr auto kStackSize = (1024 * 1024);
 
 namespace linglong::utils {
 
-int PlatformClone(int (*callback)(void *), int flags, void *arg);
+// PlatformClone runs callback in a new child process created with flags.
+// clone3 is preferred, it needs no user managed stack; older kernels fall back
+// to clone. If pidfd isn't null it receives a pidfd referring to the child, or
+// -1 if the kernel can't provide one. If cgroupFd isn't -1 the child starts in
+// that cgroup (CLONE_INTO_CGROUP); when the kernel can't do that the call
+// fails and the caller may retry without it. Without CLONE_VM the child logs
+// through a ring of its own, see rearmLogs.
+int PlatformClone(int (*callback)(void *), int flags, void *arg,
+                  int *pidfd = nullptr, int cgroupFd = -1);
+int PidfdOpen(int pid);
+int PidfdSendSignal(int pidfd, int sig);
+
+// The start time of pid in clock ticks after boot, field 22 of
+// /proc/<pid>/stat. Together with the pid it tells a process apart from a
+// later one that reused its pid. std::nullopt if there is no such process.
+std::optional<uint64_t> ProcessStartTime(int pid) noexcept;
+// Pass fd over the unix socket channel as SCM_RIGHTS along with one byte.
+// ReceiveFd returns the received fd, with O_CLOEXEC set, or -1 on error with
+// errno set to ECONNRESET at end of file.
+bool SendFd(int channel, int fd) noexcept;
+int ReceiveFd(int channel) noexcept;
+
 int Exec(const str_vec &args,
          std::optional<std::vector<std::string>> env_list);
 int WaitAllUntil(int pid);
+// wait for the child referred to by pidfd, falls back to WaitAllUntil(pid)
+// when pidfd is -1
+int WaitProcess(int pid, int pidfd);
+
+// Thin wrappers of the new mount API (open_tree and move_mount since linux
+// 5.2, mount_setattr since 5.12) and openat2 (5.6). They return -1 with errno
+// set to ENOSYS on older kernels, callers are expected to fall back to
+// mount(2).
+int OpenTree(int dirfd, const char *path, unsigned int flags);
+int MoveMount(int fromDirfd, const char *fromPath, int toDirfd,
+              const char *toPath, unsigned int flags);
+int MountSetattr(int dirfd, const char *path, unsigned int flags,
+                 uint64_t attrSet, uint64_t attrClr, uint64_t propagation);
+int OpenAt2(int dirfd, const char *path, uint64_t flags, uint64_t resolve);
 
 }  // namespace linglong::util
 
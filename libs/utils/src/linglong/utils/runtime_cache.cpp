@@ -0,0 +1,537 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/utils/runtime_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "linglong/utils/binary_codec.h"
+#include "linglong/utils/hash.h"
+#include "linglong/utils/json_backend.h"
+#include "linglong/utils/logger.h"
+#include "linglong/utils/trace.h"
+
+namespace linglong::utils {
+
+namespace {
+
+// bump whenever the encoding or one of the encoded structs changes
+constexpr uint32_t kRuntimeCacheVersion = 7;
+constexpr char kRuntimeCacheMagic[8] = {'L', 'L', 'B', 'O', 'X', 'R', 'T', 0};
+// older entries of a kind are removed once there are more than this many
+constexpr size_t kCacheEntries = 64;
+// the kinds of entries in cacheDirectory(), see pruneCacheDirectory
+constexpr std::string_view kCachePrefixes[] = {"runtime-", "seccomp-",
+                                               "mountplan-"};
+
+struct cacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t hash;
+  // the config the entry was decoded from, which follows the header and is
+  // compared byte for byte, and the encoded Runtime after it
+  uint64_t sourceSize;
+  uint64_t size;
+};
+
+// Local to this file, so the encode and decode overloads below are found by
+// argument dependent lookup wherever the templates are instantiated.
+class writer : public BinaryWriter {};
+
+class reader : public BinaryReader {
+ public:
+  using BinaryReader::BinaryReader;
+};
+
+// optionals are prefixed with a presence byte
+void encode(writer &w, const std::string &o) { w.str(o); }
+
+void decode(reader &r, std::string &o) { o = r.str(); }
+
+void encode(writer &w, bool o) { w.pod<uint8_t>(o ? 1 : 0); }
+
+void decode(reader &r, bool &o) { o = r.pod<uint8_t>() != 0; }
+
+template <class T>
+void encode(writer &w, const std::vector<T> &o) {
+  w.pod(static_cast<uint32_t>(o.size()));
+  for (const auto &item : o) {
+    encode(w, item);
+  }
+}
+
+template <class T>
+void decode(reader &r, std::vector<T> &o) {
+  o.resize(r.count());
+  for (auto &item : o) {
+    decode(r, item);
+  }
+}
+
+template <class T>
+void encode(writer &w, const std::optional<T> &o) {
+  encode(w, o.has_value());
+  if (o) {
+    encode(w, *o);
+  }
+}
+
+template <class T>
+void decode(reader &r, std::optional<T> &o) {
+  bool present{false};
+  decode(r, present);
+  if (!present) {
+    o.reset();
+    return;
+  }
+  decode(r, o.emplace());
+}
+
+void encode(writer &w, const Root &o) {
+  encode(w, o.path);
+  encode(w, o.readonly);
+}
+
+void decode(reader &r, Root &o) {
+  decode(r, o.path);
+  decode(r, o.readonly);
+}
+
+void encode(writer &w, const Process &o) {
+  encode(w, o.args);
+  encode(w, o.env);
+  encode(w, o.cwd);
+}
+
+void decode(reader &r, Process &o) {
+  decode(r, o.args);
+  decode(r, o.env);
+  decode(r, o.cwd);
+}
+
+void encode(writer &w, const Mount &o) {
+  encode(w, o.destination);
+  encode(w, o.type);
+  encode(w, o.source);
+  encode(w, o.data);
+  w.pod(static_cast<uint32_t>(o.fsType));
+  w.pod(o.flags);
+  w.pod(o.propagationFlags);
+  w.pod(o.extensionFlags);
+}
+
+void decode(reader &r, Mount &o) {
+  decode(r, o.destination);
+  decode(r, o.type);
+  decode(r, o.source);
+  decode(r, o.data);
+  o.fsType = static_cast<Mount::Type>(r.pod<uint32_t>());
+  o.flags = r.pod<uint32_t>();
+  o.propagationFlags = r.pod<uint32_t>();
+  o.extensionFlags = r.pod<uint32_t>();
+}
+
+void encode(writer &w, const Namespace &o) { w.pod(o.type); }
+
+void decode(reader &r, Namespace &o) { o.type = r.pod<int>(); }
+
+void encode(writer &w, const IDMap &o) {
+  w.pod(o.containerID);
+  w.pod(o.hostID);
+  w.pod(o.size);
+}
+
+void decode(reader &r, IDMap &o) {
+  o.containerID = r.pod<uint64_t>();
+  o.hostID = r.pod<uint64_t>();
+  o.size = r.pod<uint64_t>();
+}
+
+void encode(writer &w, const SyscallArg &o) {
+  w.pod(o.index);
+  w.pod(o.value);
+  w.pod(o.valueTwo);
+  encode(w, o.op);
+}
+
+void decode(reader &r, SyscallArg &o) {
+  o.index = r.pod<u_int>();
+  o.value = r.pod<u_int64_t>();
+  o.valueTwo = r.pod<u_int64_t>();
+  decode(r, o.op);
+}
+
+void encode(writer &w, const Syscall &o) {
+  encode(w, o.names);
+  encode(w, o.action);
+  encode(w, o.args);
+}
+
+void decode(reader &r, Syscall &o) {
+  decode(r, o.names);
+  decode(r, o.action);
+  decode(r, o.args);
+}
+
+void encode(writer &w, const Seccomp &o) {
+  encode(w, o.defaultAction);
+  encode(w, o.architectures);
+  encode(w, o.syscalls);
+}
+
+void decode(reader &r, Seccomp &o) {
+  decode(r, o.defaultAction);
+  decode(r, o.architectures);
+  decode(r, o.syscalls);
+}
+
+void encode(writer &w, const WeightDevice &o) {
+  w.pod(o.major);
+  w.pod(o.minor);
+  w.pod(o.weight);
+}
+
+void decode(reader &r, WeightDevice &o) {
+  o.major = r.pod<int64_t>();
+  o.minor = r.pod<int64_t>();
+  o.weight = r.pod<uint16_t>();
+}
+
+void encode(writer &w, const ThrottleDevice &o) {
+  w.pod(o.major);
+  w.pod(o.minor);
+  w.pod(o.rate);
+}
+
+void decode(reader &r, ThrottleDevice &o) {
+  o.major = r.pod<int64_t>();
+  o.minor = r.pod<int64_t>();
+  o.rate = r.pod<uint64_t>();
+}
+
+void encode(writer &w, const ResourcePids &o) { w.pod(o.limit); }
+
+void decode(reader &r, ResourcePids &o) { o.limit = r.pod<int64_t>(); }
+
+void encode(writer &w, const Hook &o) {
+  encode(w, o.path);
+  encode(w, o.args);
+  encode(w, o.env);
+  w.pod(o.timeout);
+  encode(w, o.independent);
+}
+
+void decode(reader &r, Hook &o) {
+  decode(r, o.path);
+  decode(r, o.args);
+  decode(r, o.env);
+  o.timeout = r.pod<int64_t>();
+  decode(r, o.independent);
+}
+
+void encode(writer &w, const PressureTrigger &o) {
+  encode(w, o.resource);
+  encode(w, o.type);
+  w.pod(o.threshold);
+  w.pod(o.window);
+  encode(w, o.action);
+  encode(w, o.hook);
+  w.pod(o.memoryHigh);
+  w.pod(o.thawAfter);
+}
+
+void decode(reader &r, PressureTrigger &o) {
+  decode(r, o.resource);
+  decode(r, o.type);
+  o.threshold = r.pod<uint64_t>();
+  o.window = r.pod<uint64_t>();
+  decode(r, o.action);
+  decode(r, o.hook);
+  o.memoryHigh = r.pod<int64_t>();
+  o.thawAfter = r.pod<uint64_t>();
+}
+
+void encode(writer &w, const Resources &o) {
+  w.pod(o.memory.limit);
+  w.pod(o.memory.reservation);
+  w.pod(o.memory.swap);
+  w.pod(o.cpu.shares);
+  w.pod(o.cpu.quota);
+  w.pod(o.cpu.period);
+  encode(w, o.cpu.cpus);
+  encode(w, o.cpu.mems);
+  encode(w, o.pids);
+  w.pod(o.blockIO.weight);
+  encode(w, o.blockIO.weightDevice);
+  encode(w, o.blockIO.throttleReadBpsDevice);
+  encode(w, o.blockIO.throttleWriteBpsDevice);
+  encode(w, o.blockIO.throttleReadIOPSDevice);
+  encode(w, o.blockIO.throttleWriteIOPSDevice);
+  w.pod(static_cast<uint32_t>(o.unified.size()));
+  for (const auto &[file, value] : o.unified) {
+    encode(w, file);
+    encode(w, value);
+  }
+  encode(w, o.pressureTriggers);
+}
+
+void decode(reader &r, Resources &o) {
+  o.memory.limit = r.pod<int64_t>();
+  o.memory.reservation = r.pod<int64_t>();
+  o.memory.swap = r.pod<int64_t>();
+  o.cpu.shares = r.pod<u_int64_t>();
+  o.cpu.quota = r.pod<int64_t>();
+  o.cpu.period = r.pod<u_int64_t>();
+  decode(r, o.cpu.cpus);
+  decode(r, o.cpu.mems);
+  decode(r, o.pids);
+  o.blockIO.weight = r.pod<uint16_t>();
+  decode(r, o.blockIO.weightDevice);
+  decode(r, o.blockIO.throttleReadBpsDevice);
+  decode(r, o.blockIO.throttleWriteBpsDevice);
+  decode(r, o.blockIO.throttleReadIOPSDevice);
+  decode(r, o.blockIO.throttleWriteIOPSDevice);
+  o.unified.clear();
+  for (auto size = r.count(); size > 0; --size) {
+    std::string file;
+    std::string value;
+    decode(r, file);
+    decode(r, value);
+    o.unified.emplace(std::move(file), std::move(value));
+  }
+  decode(r, o.pressureTriggers);
+}
+
+void encode(writer &w, const Linux &o) {
+  encode(w, o.namespaces);
+  encode(w, o.uidMappings);
+  encode(w, o.gidMappings);
+  encode(w, o.seccomp);
+  encode(w, o.cgroupsPath);
+  encode(w, o.resources);
+}
+
+void decode(reader &r, Linux &o) {
+  decode(r, o.namespaces);
+  decode(r, o.uidMappings);
+  decode(r, o.gidMappings);
+  decode(r, o.seccomp);
+  decode(r, o.cgroupsPath);
+  decode(r, o.resources);
+}
+
+void encode(writer &w, const Hooks &o) {
+  encode(w, o.prestart);
+  encode(w, o.poststart);
+  encode(w, o.poststop);
+  encode(w, o.startContainer);
+}
+
+void decode(reader &r, Hooks &o) {
+  decode(r, o.prestart);
+  decode(r, o.poststart);
+  decode(r, o.poststop);
+  decode(r, o.startContainer);
+}
+
+void encode(writer &w, const Runtime &o) {
+  encode(w, o.version);
+  encode(w, o.root);
+  encode(w, o.process);
+  encode(w, o.hostname);
+  encode(w, o.linux);
+  encode(w, o.mounts);
+  encode(w, o.hooks);
+}
+
+void decode(reader &r, Runtime &o) {
+  decode(r, o.version);
+  decode(r, o.root);
+  decode(r, o.process);
+  decode(r, o.hostname);
+  decode(r, o.linux);
+  decode(r, o.mounts);
+  decode(r, o.hooks);
+}
+
+}  // namespace
+
+std::filesystem::path cacheDirectory() noexcept {
+  return std::filesystem::path("/run") / "user" / std::to_string(::getuid()) /
+         "linglong" / "box-cache";
+}
+
+std::optional<Runtime> loadRuntimeCache(const std::filesystem::path &file,
+                                        uint64_t hash,
+                                        std::string_view content) noexcept try {
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return std::nullopt;
+  }
+  defer closeFd{[fd] { ::close(fd); }};
+
+  struct stat st {};
+  if (::fstat(fd, &st) == -1 ||
+      static_cast<size_t>(st.st_size) < sizeof(cacheHeader)) {
+    return std::nullopt;
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  auto *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    logWan() << "failed to map" << file.string() << errnoString();
+    return std::nullopt;
+  }
+  defer unmap{[data, size] { ::munmap(data, size); }};
+
+  cacheHeader header{};
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kRuntimeCacheMagic, sizeof(header.magic)) !=
+          0 ||
+      header.version != kRuntimeCacheVersion || header.hash != hash ||
+      header.size != size - sizeof(header) ||
+      header.sourceSize != content.size() || header.sourceSize > header.size) {
+    logDbg() << "ignore runtime cache" << file.string();
+    return std::nullopt;
+  }
+
+  // the hash only picks the file, a colliding config must not get the
+  // Runtime of another one
+  const auto *source = static_cast<const char *>(data) + sizeof(header);
+  if (std::memcmp(source, content.data(), content.size()) != 0) {
+    logDbg() << "runtime cache" << file.string() << "is of another config";
+    return std::nullopt;
+  }
+
+  reader r{source + header.sourceSize, header.size - header.sourceSize};
+  Runtime runtime;
+  decode(r, runtime);
+  if (!r.done()) {
+    logWan() << "trailing data in runtime cache" << file.string();
+    return std::nullopt;
+  }
+
+  return runtime;
+} catch (const std::exception &e) {
+  logWan() << "failed to load runtime cache" << file.string() << e.what();
+  return std::nullopt;
+}
+
+bool saveRuntimeCache(const std::filesystem::path &file, uint64_t hash,
+                      std::string_view content,
+                      const Runtime &runtime) noexcept try {
+  writer w;
+  w.buffer.resize(sizeof(cacheHeader));
+  w.buffer.append(content);
+  encode(w, runtime);
+
+  cacheHeader header{};
+  std::memcpy(header.magic, kRuntimeCacheMagic, sizeof(header.magic));
+  header.version = kRuntimeCacheVersion;
+  header.hash = hash;
+  header.sourceSize = content.size();
+  header.size = w.buffer.size() - sizeof(header);
+  std::memcpy(w.buffer.data(), &header, sizeof(header));
+
+  // write to a private file and rename it, concurrent launches of the same
+  // config may race here
+  auto tmp = file;
+  tmp += "." + std::to_string(::getpid());
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    logWan() << "failed to create" << tmp.string() << errnoString();
+    return false;
+  }
+
+  auto written = ::write(fd, w.buffer.data(), w.buffer.size());
+  ::close(fd);
+  if (written != static_cast<ssize_t>(w.buffer.size()) ||
+      ::rename(tmp.c_str(), file.c_str()) == -1) {
+    logWan() << "failed to write runtime cache" << file.string()
+             << errnoString();
+    ::unlink(tmp.c_str());
+    return false;
+  }
+
+  return true;
+} catch (const std::exception &e) {
+  logWan() << "failed to save runtime cache" << file.string() << e.what();
+  return false;
+}
+
+// Temporary files, <entry>.<pid>, count towards the kind of their entry. One
+// left behind by a writer that died is old enough to go first, the one a
+// writer is busy with is among the newest.
+void pruneCacheDirectory(const std::filesystem::path &dir) noexcept try {
+  using dated =
+      std::pair<std::filesystem::file_time_type, std::filesystem::path>;
+  std::vector<dated> entries[std::size(kCachePrefixes)];
+  std::error_code ec;
+  for (const auto &file : std::filesystem::directory_iterator{dir}) {
+    auto name = file.path().filename().string();
+    for (size_t i = 0; i < std::size(kCachePrefixes); ++i) {
+      if (name.rfind(kCachePrefixes[i], 0) != 0) {
+        continue;
+      }
+      // skip files removed since the directory was read
+      auto time = file.last_write_time(ec);
+      if (!ec) {
+        entries[i].emplace_back(time, file.path());
+      }
+      break;
+    }
+  }
+
+  for (auto &kind : entries) {
+    if (kind.size() <= kCacheEntries) {
+      continue;
+    }
+    std::sort(kind.begin(), kind.end());
+    for (size_t i = 0; i < kind.size() - kCacheEntries; ++i) {
+      std::filesystem::remove(kind[i].second, ec);
+    }
+  }
+} catch (const std::exception &e) {
+  logWan() << "failed to prune" << dir.string() << e.what();
+}
+
+Runtime runtimeFromConfig(const std::string &content) {
+  TraceSpan span("runtimeFromConfig");
+  auto hash = Hasher{}.update(content).digest();
+  auto dir = cacheDirectory();
+  auto file = dir / format("runtime-%016llx",
+                           static_cast<unsigned long long>(hash));
+
+  if (auto runtime = loadRuntimeCache(file, hash, content); runtime) {
+    span.arg("cache", "hit");
+    return std::move(*runtime);
+  }
+  span.arg("cache", "miss");
+
+  auto runtime = parseRuntime(content);
+
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    logWan() << "failed to create" << dir.string() << ec.message();
+    return runtime;
+  }
+  if (saveRuntimeCache(file, hash, content, runtime)) {
+    pruneCacheDirectory(dir);
+  }
+
+  return runtime;
+}
+
+}  // namespace linglong::utils
@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_RUNTIME_CACHE_H_
+#define LINGLONG_BOX_SRC_UTIL_RUNTIME_CACHE_H_
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "linglong/utils/oci_runtime.h"
+
+namespace linglong::utils {
+
+// Per-user directory for caches ll-box derives from its inputs,
+// /run/user/$UID/linglong/box-cache. Every entry in there can be removed at
+// any time.
+std::filesystem::path cacheDirectory() noexcept;
+
+// Removes the oldest entries of each kind in dir, parsed configs, seccomp
+// programs and mount plans, past a fixed number per kind. Called after
+// writing a new entry.
+void pruneCacheDirectory(const std::filesystem::path &dir) noexcept;
+
+// Decode an OCI config. The decoded Runtime is kept in a compact binary file
+// in cacheDirectory(), named after a hash of content, so launching the same
+// config again skips the JSON parser and the from_json conversions.
+Runtime runtimeFromConfig(const std::string &content);
+
+// The binary encoding used by runtimeFromConfig. An entry holds content
+// next to the Runtime decoded from it, load returns std::nullopt for a
+// missing, truncated or foreign file and for one made from other content.
+std::optional<Runtime> loadRuntimeCache(const std::filesystem::path &file,
+                                        uint64_t hash,
+                                        std::string_view content) noexcept;
+bool saveRuntimeCache(const std::filesystem::path &file, uint64_t hash,
+                      std::string_view content,
+                      const Runtime &runtime) noexcept;
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_RUNTIME_CACHE_H_ */
@@ -0,0 +1,134 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_STATIC_MAP_H_
+#define LINGLONG_BOX_SRC_UTIL_STATIC_MAP_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace linglong::utils {
+
+template <class V>
+struct StaticEntry {
+  std::string_view key;
+  V value;
+};
+
+// A read-only table keyed by strings, for the fixed vocabularies of the OCI
+// config. The seed of its hash function is searched for at compile time
+// until every key lands in a slot of its own, so a lookup hashes the key once
+// and compares it with at most one candidate, whatever the size of the table.
+//
+// Build it with makeStaticMap in a constexpr context, a table that can't be
+// laid out (duplicate keys) fails to compile.
+template <class V, std::size_t N>
+class StaticMap {
+ public:
+  using Entry = StaticEntry<V>;
+
+  constexpr explicit StaticMap(const Entry (&init)[N]) {
+    for (std::size_t i = 0; i < N; ++i) {
+      entries[i] = init[i];
+    }
+
+    for (uint64_t candidate = 0; candidate < kMaxSeeds; ++candidate) {
+      if (place(candidate)) {
+        seed = candidate;
+        return;
+      }
+    }
+    throw std::logic_error("no perfect hash seed found");
+  }
+
+  // The value stored for key, nullptr if there is none.
+  [[nodiscard]] constexpr const V *find(std::string_view key) const noexcept {
+    auto slot = slots[hash(key, seed) & (kSlots - 1)];
+    if (slot == 0 || entries[slot - 1].key != key) {
+      return nullptr;
+    }
+    return &entries[slot - 1].value;
+  }
+
+  // Like find, but throws std::invalid_argument naming what was looked up.
+  [[nodiscard]] const V &at(std::string_view key,
+                            std::string_view what = "key") const {
+    if (auto value = find(key)) {
+      return *value;
+    }
+    throw std::invalid_argument("unknown " + std::string(what) + " \"" +
+                                std::string(key) + "\"");
+  }
+
+  // The entries in the order they were given.
+  [[nodiscard]] constexpr auto begin() const noexcept {
+    return entries.begin();
+  }
+  [[nodiscard]] constexpr auto end() const noexcept { return entries.end(); }
+  [[nodiscard]] constexpr std::size_t size() const noexcept { return N; }
+
+ private:
+  static constexpr std::size_t slotCount() noexcept {
+    // at a load factor of 1/4 a working seed is found within a few tries
+    std::size_t count = 1;
+    while (count < N * 4) {
+      count <<= 1;
+    }
+    return count;
+  }
+
+  static constexpr std::size_t kSlots = slotCount();
+  static constexpr uint64_t kMaxSeeds = 1 << 12;
+  static_assert(N > 0 && N < UINT16_MAX, "unsupported table size");
+
+  // FNV-1a with the seed mixed into the offset basis, the high bits are
+  // folded down as only the low ones pick the slot.
+  static constexpr uint64_t hash(std::string_view key, uint64_t seed) noexcept {
+    uint64_t value = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (auto c : key) {
+      value ^= static_cast<uint8_t>(c);
+      value *= 0x100000001b3ULL;
+    }
+    return value ^ (value >> 32);
+  }
+
+  constexpr bool place(uint64_t candidate) {
+    for (auto &slot : slots) {
+      slot = 0;
+    }
+
+    for (std::size_t i = 0; i < N; ++i) {
+      auto &slot = slots[hash(entries[i].key, candidate) & (kSlots - 1)];
+      if (slot != 0) {
+        if (entries[slot - 1].key == entries[i].key) {
+          throw std::logic_error("duplicate key in static map");
+        }
+        return false;
+      }
+      slot = static_cast<uint16_t>(i + 1);
+    }
+
+    return true;
+  }
+
+  std::array<Entry, N> entries{};
+  // index + 1 into entries, 0 marks an empty slot
+  std::array<uint16_t, kSlots> slots{};
+  uint64_t seed{0};
+};
+
+template <class V, std::size_t N>
+constexpr StaticMap<V, N> makeStaticMap(const StaticEntry<V> (&entries)[N]) {
+  return StaticMap<V, N>(entries);
+}
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_STATIC_MAP_H_ */
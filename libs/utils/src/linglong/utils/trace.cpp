@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/utils/trace.h"
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <ctime>
+
+#include "linglong/utils/logger.h"
+
+namespace linglong::utils {
+
+int Tracer::fd = -1;
+Tracer::Process Tracer::process = Tracer::Box;
+
+bool Tracer::open(const std::string &path) noexcept {
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+              0644);
+  if (fd == -1) {
+    logErr() << "failed to open trace file" << path << errnoString();
+    return false;
+  }
+
+  // The first event is written without a leading separator, every following
+  // one is prefixed with ",\n". This keeps the file valid JSON even though
+  // the processes appending to it don't know about each other.
+  static const std::string header = "[\n";
+  if (::write(fd, header.c_str(), header.size()) == -1) {
+    logErr() << "failed to write trace file" << path << errnoString();
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  nlohmann::json meta = {
+      {"name", "process_name"}, {"ph", "M"},
+      {"pid", process},         {"tid", 0},
+      {"args", {{"name", "ll-box"}}},
+  };
+  auto first = meta.dump();
+  if (::write(fd, first.c_str(), first.size()) == -1) {
+    logWan() << "failed to write trace file" << path << errnoString();
+  }
+
+  return true;
+}
+
+void Tracer::close() noexcept {
+  if (fd == -1) {
+    return;
+  }
+
+  // Chrome accepts the array format without the closing bracket, so an
+  // aborted launch still produces a loadable trace.
+  static const std::string footer = "\n]\n";
+  if (::write(fd, footer.c_str(), footer.size()) == -1) {
+    logWan() << "failed to finish trace file" << errnoString();
+  }
+  ::close(fd);
+  fd = -1;
+}
+
+void Tracer::setProcess(Process newProcess, const char *name) noexcept {
+  if (fd == -1) {
+    return;
+  }
+
+  process = newProcess;
+  nlohmann::json meta = {
+      {"name", "process_name"}, {"ph", "M"},
+      {"pid", process},         {"tid", 0},
+      {"args", {{"name", name}}},
+  };
+  emit(meta.dump());
+}
+
+int64_t Tracer::now() noexcept {
+  struct timespec ts {};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void Tracer::complete(const char *name, int64_t begin, int64_t end,
+                      const nlohmann::json &args) noexcept try {
+  if (fd == -1) {
+    return;
+  }
+
+  // trace-event timestamps are microseconds, keep nanosecond precision
+  nlohmann::json event = {
+      {"name", name},
+      {"cat", "ll-box"},
+      {"ph", "X"},
+      {"ts", static_cast<double>(begin) / 1000},
+      {"dur", static_cast<double>(end - begin) / 1000},
+      {"pid", process},
+      {"tid", ::syscall(SYS_gettid)},
+  };
+  if (!args.is_null()) {
+    event["args"] = args;
+  }
+  emit(event.dump());
+} catch (const std::exception &e) {
+  logWan() << "failed to record trace event" << name << e.what();
+}
+
+void Tracer::emit(const std::string &event) noexcept {
+  auto line = ",\n" + event;
+  if (::write(fd, line.c_str(), line.size()) == -1) {
+    logWan() << "failed to write trace event" << errnoString();
+  }
+}
+
+TraceSpan::TraceSpan(const char *name) noexcept : name(name) {
+  if (Tracer::enabled()) {
+    begin = Tracer::now();
+  }
+}
+
+void TraceSpan::end() noexcept {
+  if (begin == -1) {
+    return;
+  }
+
+  Tracer::complete(name, begin, Tracer::now(), args);
+  begin = -1;
+}
+
+}  // namespace linglong::utils
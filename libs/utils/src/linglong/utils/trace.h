@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_BOX_SRC_UTIL_TRACE_H_
+#define LINGLONG_BOX_SRC_UTIL_TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace linglong::utils {
+
+// Tracer writes Chrome trace-event JSON (array format) to a single file shared
+// by every ll-box process of a launch. The file descriptor is opened with
+// O_APPEND before the first clone, so each event is emitted with exactly one
+// write() and events from different processes never interleave.
+class Tracer {
+ public:
+  enum Process {
+    Box = 1,
+    Entry = 2,
+    Init = 3,
+    Container = 4,
+  };
+
+  static bool open(const std::string &path) noexcept;
+  static void close() noexcept;
+  static bool enabled() noexcept { return fd != -1; }
+
+  // Label the current process in the trace viewer, call it once right after
+  // clone/fork.
+  static void setProcess(Process process, const char *name) noexcept;
+
+  static int64_t now() noexcept;
+  static void complete(const char *name, int64_t begin, int64_t end,
+                       const nlohmann::json &args) noexcept;
+
+ private:
+  static void emit(const std::string &event) noexcept;
+
+  static int fd;
+  static Process process;
+};
+
+// TraceSpan records a complete event ("ph":"X") covering its own lifetime, or
+// up to the first call of end().
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char *name) noexcept;
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+  ~TraceSpan() { end(); }
+
+  template <class T>
+  TraceSpan &arg(const char *key, const T &value) {
+    if (begin != -1) {
+      args[key] = value;
+    }
+    return *this;
+  }
+
+  void end() noexcept;
+
+ private:
+  const char *name;
+  int64_t begin{-1};
+  nlohmann::json args;
+};
+
+}  // namespace linglong::utils
+
+#endif /* LINGLONG_BOX_SRC_UTIL_TRACE_H_ */